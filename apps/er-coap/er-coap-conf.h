@@ -63,11 +63,25 @@
 #define COAP_MAX_HEADER_SIZE           (4 + COAP_TOKEN_LEN + 3 + 1 + COAP_ETAG_LEN + 4 + 4 + 30)  /* 65 */
 #endif /* COAP_MAX_HEADER_SIZE */
 
-/* Number of observer slots (each takes abot xxx bytes) */
+/* Number of observer slots. Notifying an observer does not take a transaction, so this is not bound to COAP_MAX_OPEN_TRANSACTIONS. */
 #ifndef COAP_MAX_OBSERVERS
-#define COAP_MAX_OBSERVERS    COAP_MAX_OPEN_TRANSACTIONS - 1
+#define COAP_MAX_OBSERVERS    (COAP_MAX_OPEN_TRANSACTIONS - 1)
 #endif /* COAP_MAX_OBSERVERS */
 
+/* Number of rendered notifications that can be in flight at the same time. Each is shared by all observers of a resource, and held until its confirmable notifications are acknowledged. A change that finds none free is rendered once one is. */
+#ifndef COAP_MAX_NOTIFICATIONS
+#define COAP_MAX_NOTIFICATIONS         2
+#endif /* COAP_MAX_NOTIFICATIONS */
+
+/* Number of notifications sent in one go, and the pause before the next ones when a resource has more observers. */
+#ifndef COAP_OBSERVE_BURST
+#define COAP_OBSERVE_BURST             4
+#endif /* COAP_OBSERVE_BURST */
+
+#ifndef COAP_OBSERVE_PACE
+#define COAP_OBSERVE_PACE              (CLOCK_SECOND / 16)
+#endif /* COAP_OBSERVE_PACE */
+
 /* Interval in notifies in which NON notifies are changed to CON notifies to check client. */
 #define COAP_OBSERVE_REFRESH_INTERVAL  20
 
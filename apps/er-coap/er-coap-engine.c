@@ -233,6 +233,9 @@ coap_receive(void)
         } else if(message->type == COAP_TYPE_ACK) {
           /* transactions are closed through lookup below */
           PRINTF("Received ACK\n");
+          /* confirmable notifications are not transactions */
+          coap_ack_observer_by_mid(&UIP_IP_BUF->srcipaddr,
+                                   UIP_UDP_BUF->srcport, message->mid);
         } else if(message->type == COAP_TYPE_RST) {
           PRINTF("Received RST\n");
           /* cancel possible subscriptions */
@@ -52,9 +52,107 @@
 #define PRINTLLADDR(addr)
 #endif
 
+/* Notifications are rendered with this Observe value, as it takes the
+   three bytes any sequence number fits into */
+#define OBSERVE_PLACEHOLDER 0xFFFFFF
+
 /*---------------------------------------------------------------------------*/
 MEMB(observers_memb, coap_observer_t, COAP_MAX_OBSERVERS);
 LIST(observers_list);
+MEMB(notifications_memb, coap_notification_t, COAP_MAX_NOTIFICATIONS);
+
+/* The observers waiting to be notified, each queued once at most */
+static coap_observer_t *send_queue[COAP_MAX_OBSERVERS];
+static uint16_t send_queue_head;
+static uint16_t send_queue_len;
+static struct ctimer send_timer;
+
+/* The resources that changed while no notification buffer was free,
+   in order. Each had an observer when it was deferred. */
+static resource_t *deferred[COAP_MAX_OBSERVERS];
+static uint16_t deferred_len;
+static struct ctimer deferred_timer;
+
+/* A notification as sent to one observer */
+static uint8_t send_buffer[COAP_MAX_PACKET_SIZE + 1 + COAP_TOKEN_LEN];
+
+static void retransmit_notification(void *ptr);
+/*---------------------------------------------------------------------------*/
+static void
+undefer_notification(resource_t *resource)
+{
+  uint16_t i;
+
+  for(i = 0; i < deferred_len; i++) {
+    if(deferred[i] == resource) {
+      deferred_len--;
+      memmove(deferred + i, deferred + i + 1,
+              (deferred_len - i) * sizeof(deferred[0]));
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+defer_notification(resource_t *resource)
+{
+  uint16_t i;
+
+  for(i = 0; i < deferred_len; i++) {
+    if(deferred[i] == resource) {
+      /* the newest state is rendered when its turn comes */
+      return;
+    }
+  }
+  if(deferred_len < COAP_MAX_OBSERVERS) {
+    deferred[deferred_len++] = resource;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+notify_deferred(void *ptr)
+{
+  resource_t *resource;
+
+  /* A resource that still finds no buffer is deferred again, last */
+  while(deferred_len > 0 && memb_numfree(&notifications_memb) > 0) {
+    resource = deferred[0];
+    undefer_notification(resource);
+    coap_notify_observers(resource);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+release_notification(coap_notification_t *n)
+{
+  if(n != NULL && --n->refs == 0) {
+    memb_free(&notifications_memb, n);
+    if(deferred_len > 0) {
+      /* not from here: the caller may be walking the observers */
+      ctimer_set(&deferred_timer, 0, notify_deferred, NULL);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+unqueue_observer(coap_observer_t *o)
+{
+  uint16_t i;
+
+  for(i = 0; i < send_queue_len; i++) {
+    if(send_queue[(send_queue_head + i) % COAP_MAX_OBSERVERS] == o) {
+      break;
+    }
+  }
+  if(i == send_queue_len) {
+    return;
+  }
+  for(i++; i < send_queue_len; i++) {
+    send_queue[(send_queue_head + i - 1) % COAP_MAX_OBSERVERS] =
+      send_queue[(send_queue_head + i) % COAP_MAX_OBSERVERS];
+  }
+  send_queue_len--;
+}
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -74,6 +172,8 @@ coap_add_observer(uip_ipaddr_t *addr, uint16_t port, const uint8_t *token,
     o->token_len = token_len;
     memcpy(o->token, token, token_len);
     o->last_mid = 0;
+    o->sent = NULL;
+    o->pending = NULL;
 
     PRINTF("Adding observer (%u/%u) for /%s [0x%02X%02X]\n",
            list_length(observers_list) + 1, COAP_MAX_OBSERVERS,
@@ -92,6 +192,15 @@ coap_remove_observer(coap_observer_t *o)
   PRINTF("Removing observer for /%s [0x%02X%02X]\n", o->url, o->token[0],
          o->token[1]);
 
+  if(o->pending != NULL) {
+    unqueue_observer(o);
+    release_notification(o->pending);
+  }
+  if(o->sent != NULL) {
+    ctimer_stop(&o->retrans_timer);
+    release_notification(o->sent);
+  }
+
   memb_free(&observers_memb, o);
   list_remove(observers_list, o);
 }
@@ -172,57 +281,229 @@ coap_remove_observer_by_mid(uip_ipaddr_t *addr, uint16_t port, uint16_t mid)
   }
   return removed;
 }
+void
+coap_ack_observer_by_mid(uip_ipaddr_t *addr, uint16_t port, uint16_t mid)
+{
+  coap_observer_t *obs = NULL;
+
+  for(obs = (coap_observer_t *)list_head(observers_list); obs;
+      obs = obs->next) {
+    if(obs->sent != NULL && obs->last_mid == mid
+       && uip_ipaddr_cmp(&obs->addr, addr) && obs->port == port) {
+      PRINTF("Notification %u acknowledged\n", mid);
+      ctimer_stop(&obs->retrans_timer);
+      release_notification(obs->sent);
+      obs->sent = NULL;
+    }
+  }
+}
 /*---------------------------------------------------------------------------*/
 /*- Notification ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
-void
-coap_notify_observers(resource_t *resource)
+/* Returns the offset of the value of the Observe option in a rendered
+   notification, or 0 if it has none */
+static uint16_t
+find_observe_option(const coap_notification_t *n)
+{
+  const uint8_t *option = n->packet + COAP_HEADER_LEN;
+  const uint8_t *end = n->packet + n->len;
+  unsigned int number = 0;
+  unsigned int delta, length;
+
+  while(option < end && *option != 0xFF) {
+    delta = *option >> 4;
+    length = *option & COAP_HEADER_OPTION_SHORT_LENGTH_MASK;
+    ++option;
+    if(delta == 13) {
+      delta += *option++;
+    } else if(delta == 14) {
+      delta = 269 + (option[0] << 8) + option[1];
+      option += 2;
+    }
+    if(length == 13) {
+      length += *option++;
+    } else if(length == 14) {
+      length = 269 + (option[0] << 8) + option[1];
+      option += 2;
+    }
+    number += delta;
+    if(number == COAP_OPTION_OBSERVE) {
+      return option - n->packet;
+    } else if(number > COAP_OPTION_OBSERVE) {
+      break;
+    }
+    option += length;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static coap_notification_t *
+render_notification(resource_t *resource)
 {
-  /* build notification */
   coap_packet_t notification[1]; /* this way the packet can be treated as pointer as usual */
+  coap_notification_t *n;
+
+  n = memb_alloc(&notifications_memb);
+  if(n == NULL) {
+    return NULL;
+  }
+
   coap_init_message(notification, COAP_TYPE_NON, CONTENT_2_05, 0);
-  coap_observer_t *obs = NULL;
+  resource->get_handler(NULL, notification,
+                        n->packet + COAP_MAX_HEADER_SIZE,
+                        REST_MAX_CHUNK_SIZE, NULL);
+  if(notification->code < BAD_REQUEST_4_00) {
+    coap_set_header_observe(notification, OBSERVE_PLACEHOLDER);
+  }
 
-  PRINTF("Observe: Notification from %s\n", resource->url);
+  n->refs = 0;
+  n->len = coap_serialize_message(notification, n->packet);
+  n->observe_offset = find_observe_option(n);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_notification(coap_observer_t *obs, coap_notification_t *n,
+                  coap_message_type_t type, uint32_t observe)
+{
+  uint8_t *value;
 
-  /* iterate over observers */
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
-    if(obs->url == resource->url) {     /* using RESOURCE url pointer as handle */
-      coap_transaction_t *transaction = NULL;
+  send_buffer[0] = (n->packet[0] & COAP_HEADER_VERSION_MASK)
+    | (type << COAP_HEADER_TYPE_POSITION)
+    | (obs->token_len << COAP_HEADER_TOKEN_LEN_POSITION);
+  send_buffer[1] = n->packet[1];
+  send_buffer[2] = (uint8_t)(obs->last_mid >> 8);
+  send_buffer[3] = (uint8_t)(obs->last_mid);
+  memcpy(send_buffer + COAP_HEADER_LEN, obs->token, obs->token_len);
+  memcpy(send_buffer + COAP_HEADER_LEN + obs->token_len,
+         n->packet + COAP_HEADER_LEN, n->len - COAP_HEADER_LEN);
 
-      /*TODO implement special transaction for CON, sharing the same buffer to allow for more observers */
+  if(n->observe_offset) {
+    value = send_buffer + obs->token_len + n->observe_offset;
+    value[0] = (uint8_t)(observe >> 16);
+    value[1] = (uint8_t)(observe >> 8);
+    value[2] = (uint8_t)(observe);
+  }
 
-      if((transaction = coap_new_transaction(coap_get_mid(), &obs->addr, obs->port))) {
-        if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
-          PRINTF("           Force Confirmable for\n");
-          notification->type = COAP_TYPE_CON;
-        }
+  PRINTF("           Observer ");
+  PRINT6ADDR(&obs->addr);
+  PRINTF(":%u (%s %u)\n", obs->port, type == COAP_TYPE_CON ? "CON" : "NON",
+         obs->last_mid);
 
-        PRINTF("           Observer ");
-        PRINT6ADDR(&obs->addr);
-        PRINTF(":%u\n", obs->port);
+  coap_send_message(&obs->addr, obs->port, send_buffer,
+                    obs->token_len + n->len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+notify_observer(coap_observer_t *obs)
+{
+  coap_notification_t *n = obs->pending;
 
-        /* update last MID for RST matching */
-        obs->last_mid = transaction->mid;
+  obs->pending = NULL;
 
-        /* prepare response */
-        notification->mid = transaction->mid;
+  /* update last MID for ACK and RST matching */
+  obs->last_mid = coap_get_mid();
 
-        resource->get_handler(NULL, notification,
-                              transaction->packet + COAP_MAX_HEADER_SIZE,
-                              REST_MAX_CHUNK_SIZE, NULL);
+  if(obs->sent != NULL) {
+    /* a newer state replaces the notification still waiting for its ACK;
+       it is confirmable too and takes over the retransmission */
+    release_notification(obs->sent);
+    obs->sent = n;
+    send_notification(obs, n, COAP_TYPE_CON, obs->obs_counter);
+  } else if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
+    PRINTF("           Force Confirmable for\n");
+    obs->sent = n;
+    obs->retrans_counter = 0;
+    obs->retrans_interval = COAP_RESPONSE_TIMEOUT_TICKS +
+      (random_rand() % (clock_time_t)COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
+    send_notification(obs, n, COAP_TYPE_CON, obs->obs_counter);
+    ctimer_set(&obs->retrans_timer, obs->retrans_interval,
+               retransmit_notification, obs);
+  } else {
+    send_notification(obs, n, COAP_TYPE_NON, obs->obs_counter);
+    release_notification(n);
+  }
 
-        if(notification->code < BAD_REQUEST_4_00) {
-          coap_set_header_observe(notification, (obs->obs_counter)++);
-        }
-        coap_set_token(notification, obs->token, obs->token_len);
+  if(n->observe_offset) {
+    obs->obs_counter = (obs->obs_counter + 1) & OBSERVE_PLACEHOLDER;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+retransmit_notification(void *ptr)
+{
+  coap_observer_t *obs = ptr;
+  uip_ipaddr_t addr;
+
+  if(++(obs->retrans_counter) < COAP_MAX_RETRANSMIT) {
+    PRINTF("Retransmitting notification %u (%u)\n", obs->last_mid,
+           obs->retrans_counter);
+    send_notification(obs, obs->sent, COAP_TYPE_CON,
+                      (obs->obs_counter - 1) & OBSERVE_PLACEHOLDER);
+    obs->retrans_interval <<= 1;  /* double */
+    ctimer_set(&obs->retrans_timer, obs->retrans_interval,
+               retransmit_notification, obs);
+  } else {
+    PRINTF("Timeout\n");
+    uip_ipaddr_copy(&addr, &obs->addr);
+    coap_remove_observer_by_client(&addr, obs->port);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_queued_notifications(void *ptr)
+{
+  coap_observer_t *obs;
+  uint8_t burst;
+
+  for(burst = 0; burst < COAP_OBSERVE_BURST && send_queue_len > 0; burst++) {
+    obs = send_queue[send_queue_head];
+    send_queue_head = (send_queue_head + 1) % COAP_MAX_OBSERVERS;
+    send_queue_len--;
+    notify_observer(obs);
+  }
+
+  if(send_queue_len > 0) {
+    ctimer_set(&send_timer, COAP_OBSERVE_PACE, send_queued_notifications,
+               NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_notify_observers(resource_t *resource)
+{
+  coap_notification_t *n = NULL;
+  coap_observer_t *obs = NULL;
 
-        transaction->packet_len =
-          coap_serialize_message(notification, transaction->packet);
+  PRINTF("Observe: Notification from %s\n", resource->url);
 
-        coap_send_transaction(transaction);
+  /* the representation is rendered once and shared by all observers */
+  for(obs = (coap_observer_t *)list_head(observers_list); obs;
+      obs = obs->next) {
+    if(obs->url == resource->url) {     /* using RESOURCE url pointer as handle */
+      if(n == NULL && (n = render_notification(resource)) == NULL) {
+        PRINTF("Observe: no notification buffer for %s, deferred\n",
+               resource->url);
+        defer_notification(resource);
+        return;
+      }
+      n->refs++;
+      if(obs->pending != NULL) {
+        /* still queued: only the newest state is sent */
+        release_notification(obs->pending);
+      } else {
+        send_queue[(send_queue_head + send_queue_len) % COAP_MAX_OBSERVERS] =
+          obs;
+        send_queue_len++;
       }
+      obs->pending = n;
+    }
+  }
+
+  if(n != NULL) {
+    undefer_notification(resource);
+    if(ctimer_expired(&send_timer)) {
+      send_queued_notifications(NULL);
     }
   }
 }
@@ -42,6 +42,7 @@
 #include "er-coap.h"
 #include "er-coap-transactions.h"
 #include "stimer.h"
+#include "ctimer.h"
 
 typedef struct coap_observable {
   uint32_t observe_clock;
@@ -51,6 +52,17 @@ typedef struct coap_observable {
   uint8_t buffer[COAP_MAX_PACKET_SIZE + 1];
 } coap_observable_t;
 
+/* A notification rendered once for all observers of a resource. It has no
+   token, and the Observe option, if any, always takes three bytes at
+   observe_offset: the type, MID, token and Observe value are filled in
+   for each observer as it is sent. */
+typedef struct coap_notification {
+  uint16_t refs;
+  uint16_t observe_offset;
+  uint16_t len;
+  uint8_t packet[COAP_MAX_PACKET_SIZE + 1];
+} coap_notification_t;
+
 typedef struct coap_observer {
   struct coap_observer *next;   /* for LIST */
 
@@ -63,7 +75,12 @@ typedef struct coap_observer {
 
   int32_t obs_counter;
 
-  struct etimer retrans_timer;
+  /* the confirmable notification waiting for its ACK, if any */
+  coap_notification_t *sent;
+  /* the notification waiting in the send queue, if any */
+  coap_notification_t *pending;
+  struct ctimer retrans_timer;
+  clock_time_t retrans_interval;
   uint8_t retrans_counter;
 } coap_observer_t;
 
@@ -81,6 +98,8 @@ int coap_remove_observer_by_uri(uip_ipaddr_t *addr, uint16_t port,
                                 const char *uri);
 int coap_remove_observer_by_mid(uip_ipaddr_t *addr, uint16_t port,
                                 uint16_t mid);
+void coap_ack_observer_by_mid(uip_ipaddr_t *addr, uint16_t port,
+                              uint16_t mid);
 
 void coap_notify_observers(resource_t *resource);
 
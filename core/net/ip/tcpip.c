@@ -543,6 +543,9 @@ tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if UIP_CONF_IPV6_RPL
+  uip_ipaddr_t srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL */
 
   if(uip_len == 0) {
     return;
@@ -564,6 +567,18 @@ tcpip_ipv6_output(void)
     /* Next hop determination */
     nbr = NULL;
 
+#if UIP_CONF_IPV6_RPL
+    /* The root of a non-storing DODAG routes down by source routing,
+       the next hop of a source routed packet is its destination. */
+    if(rpl_insert_srh_header() < 0) {
+      uip_len = 0;
+      return;
+    }
+    if(rpl_get_srh_next_hop(&srh_nexthop)) {
+      nexthop = &srh_nexthop;
+    } else
+#endif /* UIP_CONF_IPV6_RPL */
+
     /* We first check if the destination address is on our immediate
        link. If so, we simply use the destination address as our
        nexthop address. */
@@ -667,12 +682,13 @@ tcpip_ipv6_output(void)
         uip_len = 0;
         return;
       } else {
+        /* The packet may leave uip_buf for the queue: keep its source */
+        uip_ipaddr_t src;
+
+        uip_ipaddr_copy(&src, &UIP_IP_BUF->srcipaddr);
 #if UIP_CONF_IPV6_QUEUE_PKT
-        /* Copy outgoing pkt in the queuing buffer for later transmit. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        /* Move outgoing pkt to the queue for later transmit. */
+        uip_packetqueue_enqueue(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
       /* RFC4861, 7.2.2:
        * "If the source address of the packet prompting the solicitation is the
@@ -680,9 +696,9 @@ tcpip_ipv6_output(void)
        * address SHOULD be placed in the IP Source Address of the outgoing
        * solicitation.  Otherwise, any one of the addresses assigned to the
        * interface should be used."*/
-       if(uip_ds6_is_my_addr(&UIP_IP_BUF->srcipaddr)){
+       if(uip_ds6_is_my_addr(&src)){
 		PRINTF("tcpip_ipv6_output: NS output with my IP address as source\n");
-          uip_nd6_ns_output(&UIP_IP_BUF->srcipaddr, NULL, &nbr->ipaddr);
+          uip_nd6_ns_output(&src, NULL, &nbr->ipaddr);
         } else {
 		PRINTF("tcpip_ipv6_output: NS output with NULL as source\n");
           uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr);
@@ -690,6 +706,7 @@ tcpip_ipv6_output(void)
 
         stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
         nbr->nscount = 1;
+        uip_ds6_nbr_schedule(nbr);
       }
 #endif /* UIP_ND6_SEND_NA */
     } else {
@@ -697,12 +714,8 @@ tcpip_ipv6_output(void)
       if(nbr->state == NBR_INCOMPLETE) {
         PRINTF("tcpip_ipv6_output: nbr cache entry incomplete\n");
 #if UIP_CONF_IPV6_QUEUE_PKT
-        /* Copy outgoing pkt in the queuing buffer for later transmit and set
-           the destination nbr to nbr. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        /* Append outgoing pkt to the neighbor's queue for later transmit. */
+        uip_packetqueue_enqueue(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME);
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
         uip_len = 0;
         return;
@@ -713,6 +726,7 @@ tcpip_ipv6_output(void)
         nbr->state = NBR_DELAY;
         stimer_set(&nbr->reachable, UIP_ND6_DELAY_FIRST_PROBE_TIME);
         nbr->nscount = 0;
+        uip_ds6_nbr_schedule(nbr);
         PRINTF("tcpip_ipv6_output: nbr cache entry stale moving to delay\n");
       }
 }
@@ -725,24 +739,26 @@ tcpip_ipv6_output(void)
 	return;
 	}
 #endif
-      tcpip_output(uip_ds6_nbr_get_ll(nbr));
-
 #if UIP_CONF_IPV6_QUEUE_PKT
       /*
-       * Send the queued packets from here, may not be 100% perfect though.
-       * This happens in a few cases, for example when instead of receiving a
-       * NA after sendiong a NS, you receive a NS with SLLAO: the entry moves
-       * to STALE, and you must both send a NA and the queued packet.
+       * Send the queued packets from here. This happens in a few cases, for
+       * example when instead of receiving a NA after sending a NS, you
+       * receive a NS with SLLAO: the entry moves to STALE, and you must both
+       * send a NA and the queued packets. To keep the packets in order, the
+       * current one goes behind them unless the queue has no room left.
        */
-      if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-        uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-        memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-        uip_packetqueue_free(&nbr->packethandle);
+      if(uip_packetqueue_len(&nbr->packethandle) == 0 ||
+         uip_packetqueue_len(&nbr->packethandle) >= UIP_PACKETQUEUE_MAX_PER_HANDLE ||
+         !uip_packetqueue_enqueue(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME)) {
         tcpip_output(uip_ds6_nbr_get_ll(nbr));
       }
-#endif /*UIP_CONF_IPV6_QUEUE_PKT*/
+      uip_ds6_nbr_send_queued(nbr);
+#else /* UIP_CONF_IPV6_QUEUE_PKT */
+      tcpip_output(uip_ds6_nbr_get_ll(nbr));
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
 
       uip_len = 0;
+      uip_ext_len = 0;
       return;
   }
   /* Multicast IP destination address. */
@@ -816,6 +832,9 @@ tcpip_uipcall(void)
 PROCESS_THREAD(tcpip_process, ev, data)
 {
   PROCESS_BEGIN();
+
+  /* The events of the network stack go ahead of those of applications */
+  process_set_priority(PROCESS_CURRENT(), PROCESS_PRIORITY_HIGH);
   
 #if UIP_TCP
  {
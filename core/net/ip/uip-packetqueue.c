@@ -1,13 +1,16 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "net/ip/uip.h"
 
 #include "lib/memb.h"
 
 #include "net/ip/uip-packetqueue.h"
+#include "net/ipv6/uip-bufpool.h"
 
-#define MAX_NUM_QUEUED_PACKETS 2
-MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
+MEMB(packets_memb, struct uip_packetqueue_packet, UIP_PACKETQUEUE_NUM);
+
+struct uip_packetqueue_stats uip_packetqueue_stats;
 
 #define DEBUG 0
 #if DEBUG
@@ -17,57 +20,145 @@ MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+packet_unlink(struct uip_packetqueue_packet *p)
+{
+  struct uip_packetqueue_handle *h = p->handle;
+  struct uip_packetqueue_packet **pp;
+
+  for(pp = &h->packet; *pp != NULL; pp = &(*pp)->next) {
+    if(*pp == p) {
+      *pp = p->next;
+      h->len--;
+      break;
+    }
+  }
+  ctimer_stop(&p->lifetimer);
+  uip_bufpool_free(p->buf);
+  memb_free(&packets_memb, p);
+}
 /*---------------------------------------------------------------------------*/
 static void
 packet_timedout(void *ptr)
 {
-  struct uip_packetqueue_handle *h = ptr;
+  struct uip_packetqueue_packet *p = ptr;
 
-  PRINTF("uip_packetqueue_free timed out %p\n", h);
-  memb_free(&packets_memb, h->packet);
-  h->packet = NULL;
+  PRINTF("uip_packetqueue_free timed out %p\n", p->handle);
+  uip_packetqueue_stats.timedout++;
+  packet_unlink(p);
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_packetqueue_new(struct uip_packetqueue_handle *handle)
 {
+  struct uip_packetqueue_packet *p;
+  int i;
+
   PRINTF("uip_packetqueue_new %p\n", handle);
   handle->packet = NULL;
+  handle->len = 0;
+
+  /* The handle may be reused, e.g. with its neighbor entry: the packets
+     still queued for its previous owner are dropped, not left to time
+     out. The old list is not trusted, the pool is searched instead. */
+  p = (struct uip_packetqueue_packet *)packets_memb.mem;
+  for(i = 0; i < packets_memb.num; i++) {
+    if(packets_memb.count[i] != 0 && p[i].handle == handle) {
+      uip_packetqueue_stats.flushed++;
+      packet_unlink(&p[i]);
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime)
 {
+  struct uip_packetqueue_packet *p;
+  struct uip_packetqueue_packet **pp;
+
   PRINTF("uip_packetqueue_alloc %p\n", handle);
-  if(handle->packet != NULL) {
-    PRINTF("alloced\n");
+  if(handle->len >= UIP_PACKETQUEUE_MAX_PER_HANDLE) {
+    PRINTF("queue full\n");
+    uip_packetqueue_stats.full++;
     return NULL;
   }
-  handle->packet = memb_alloc(&packets_memb);
-  if(handle->packet != NULL) {
-    ctimer_set(&handle->packet->lifetimer, lifetime,
-               packet_timedout, handle);
-  } else {
+  p = memb_alloc(&packets_memb);
+  if(p == NULL) {
     PRINTF("uip_packetqueue_alloc failed\n");
+    uip_packetqueue_stats.nomem++;
+    return NULL;
   }
-  return handle->packet;
+  p->next = NULL;
+  p->buf = NULL;
+  p->queue_buf_len = 0;
+  p->handle = handle;
+  for(pp = &handle->packet; *pp != NULL; pp = &(*pp)->next);
+  *pp = p;
+  handle->len++;
+  ctimer_set(&p->lifetimer, lifetime, packet_timedout, p);
+  return p;
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_free %p\n", handle);
-  if(handle->packet != NULL) {
-    ctimer_stop(&handle->packet->lifetimer);
-    memb_free(&packets_memb, handle->packet);
-    handle->packet = NULL;
+  while(handle->packet != NULL) {
+    uip_packetqueue_stats.flushed++;
+    packet_unlink(handle->packet);
   }
 }
 /*---------------------------------------------------------------------------*/
+int
+uip_packetqueue_enqueue(struct uip_packetqueue_handle *h, clock_time_t lifetime)
+{
+  struct uip_packetqueue_packet *p;
+
+  p = uip_packetqueue_alloc(h, lifetime);
+  if(p == NULL) {
+    return 0;
+  }
+  /* The packet keeps its buffer, uip_buf is given an empty one */
+  p->buf = uip_bufpool_take();
+  if(p->buf == NULL) {
+    PRINTF("uip_packetqueue_enqueue no buffer left\n");
+    uip_packetqueue_stats.nomem++;
+    packet_unlink(p);
+    return 0;
+  }
+  p->queue_buf_len = uip_len;
+  uip_packetqueue_stats.queued++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_packetqueue_dequeue(struct uip_packetqueue_handle *h)
+{
+  struct uip_packetqueue_packet *p = h->packet;
+
+  if(p == NULL) {
+    return 0;
+  }
+  uip_len = p->queue_buf_len;
+  uip_bufpool_give(p->buf);
+  p->buf = NULL;
+  packet_unlink(p);
+  uip_packetqueue_stats.sent++;
+  return uip_len;
+}
+/*---------------------------------------------------------------------------*/
+int
+uip_packetqueue_len(struct uip_packetqueue_handle *h)
+{
+  return h->len;
+}
+/*---------------------------------------------------------------------------*/
 uint8_t *
 uip_packetqueue_buf(struct uip_packetqueue_handle *h)
 {
-  return h->packet != NULL? h->packet->queue_buf: NULL;
+  return h->packet != NULL && h->packet->buf != NULL?
+    &h->packet->buf->u8[UIP_LLH_LEN]: NULL;
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
@@ -3,30 +3,69 @@
 
 #include "sys/ctimer.h"
 
+/* Number of packets, shared by all queues. Their buffers come from
+   uip-bufpool. */
+#ifdef UIP_PACKETQUEUE_CONF_NUM
+#define UIP_PACKETQUEUE_NUM UIP_PACKETQUEUE_CONF_NUM
+#else
+#define UIP_PACKETQUEUE_NUM 4
+#endif
+
+/* Maximum number of packets in a single queue */
+#ifdef UIP_PACKETQUEUE_CONF_MAX_PER_HANDLE
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE UIP_PACKETQUEUE_CONF_MAX_PER_HANDLE
+#else
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE 2
+#endif
+
 struct uip_packetqueue_handle;
 
 struct uip_packetqueue_packet {
-  struct uip_ds6_queued_packet *next;
-  uint8_t queue_buf[UIP_BUFSIZE - UIP_LLH_LEN];
+  struct uip_packetqueue_packet *next;
+  /* The buffer uip_buf had when the packet was queued, a uip_buf_t */
+  union uip_packet_buffer *buf;
   uint16_t queue_buf_len;
   struct ctimer lifetimer;
   struct uip_packetqueue_handle *handle;
 };
 
+/* A FIFO of packets, oldest first */
 struct uip_packetqueue_handle {
   struct uip_packetqueue_packet *packet;
+  uint8_t len;
 };
 
-void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
+struct uip_packetqueue_stats {
+  uint16_t queued;
+  uint16_t sent;
+  uint16_t full;          /* not queued, UIP_PACKETQUEUE_MAX_PER_HANDLE reached */
+  uint16_t nomem;         /* not queued, no packet or buffer left */
+  uint16_t timedout;      /* dropped when their lifetime expired */
+  uint16_t flushed;       /* dropped with their queue, e.g. neighbor removed */
+};
+
+extern struct uip_packetqueue_stats uip_packetqueue_stats;
 
+void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
 
+/* Appends a packet to the queue, NULL if the queue or the pool is full */
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime);
 
-
+/* Frees all the packets of the queue */
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle);
 
+/* Copies uip_buf to the tail of the queue. Returns 0 if it was dropped. */
+int uip_packetqueue_enqueue(struct uip_packetqueue_handle *h, clock_time_t lifetime);
+
+/* Moves the oldest packet to uip_buf and returns its length, 0 if the
+ * queue is empty */
+uint16_t uip_packetqueue_dequeue(struct uip_packetqueue_handle *h);
+
+int uip_packetqueue_len(struct uip_packetqueue_handle *h);
+
+/* Oldest packet of the queue */
 uint8_t *uip_packetqueue_buf(struct uip_packetqueue_handle *h);
 uint16_t uip_packetqueue_buflen(struct uip_packetqueue_handle *h);
 void uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len);
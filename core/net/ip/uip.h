@@ -525,15 +525,26 @@ void uip_reass_over(void);
  \endcode
 */
 
-typedef union {
+typedef union uip_packet_buffer {
   uint32_t u32[(UIP_BUFSIZE + 3) / 4];
   uint8_t u8[UIP_BUFSIZE];
 } uip_buf_t;
 
 CCIF extern uip_buf_t uip_aligned_buf;
 
+#if NETSTACK_CONF_WITH_IPV6
+/**
+ * The buffer holding the current packet. It starts as uip_aligned_buf
+ * and changes when a packet is handed over to or from uip-bufpool.
+ */
+CCIF extern uip_buf_t *uip_bufp;
+
+/** Macro to access the current buffer as an array of bytes */
+#define uip_buf (uip_bufp->u8)
+#else /* NETSTACK_CONF_WITH_IPV6 */
 /** Macro to access uip_aligned_buf as an array of bytes */
 #define uip_buf (uip_aligned_buf.u8)
+#endif /* NETSTACK_CONF_WITH_IPV6 */
 
 
 /** @} */
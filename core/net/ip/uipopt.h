@@ -570,6 +570,35 @@ void uip_log(char *msg);
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * Number of datagrams the 6lowpan layer can reassemble at the same
+ * time. Each context in use holds a buffer of uip-bufpool.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS (SICSLOWPAN_CONF_REASS_CONTEXTS)
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
+/**
+ * Routers relay the fragments of the packets they only route, without
+ * reassembling them: the first fragment sets up an entry mapping its
+ * sender and tag to the next hop, and the other fragments are relayed
+ * as they arrive (virtual reassembly buffer).
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARD
+#define SICSLOWPAN_FRAG_FORWARD (SICSLOWPAN_CONF_FRAG_FORWARD)
+#else
+#define SICSLOWPAN_FRAG_FORWARD 0
+#endif
+
+/** Number of packets whose fragments can be relayed at the same time */
+#ifdef SICSLOWPAN_CONF_VRB_ENTRIES
+#define SICSLOWPAN_VRB_ENTRIES (SICSLOWPAN_CONF_VRB_ENTRIES)
+#else
+#define SICSLOWPAN_VRB_ENTRIES 4
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
@@ -584,6 +613,17 @@ void uip_log(char *msg);
 #define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 1
 #endif
 
+/**
+ * If we use IPHC compression, for how many recent (source, destination,
+ * link-layer destination) tuples do we remember the compressed
+ * addresses (default: none)
+ */
+#ifdef SICSLOWPAN_CONF_HC06_CACHE_ENTRIES
+#define SICSLOWPAN_HC06_CACHE_ENTRIES (SICSLOWPAN_CONF_HC06_CACHE_ENTRIES)
+#else
+#define SICSLOWPAN_HC06_CACHE_ENTRIES 0
+#endif
+
 /**
  * Do we support 6lowpan fragmentation
  */
@@ -64,10 +64,19 @@
 #include "dev/watchdog.h"
 #include "net/ip/tcpip.h"
 #include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/uip-ds6-nbr.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/ipv6/uip-bufpool.h"
 #include "net/rime/rime.h"
 #include "net/ipv6/sicslowpan.h"
 #include "net/netstack.h"
+#include "net/link-stats.h"
+#include "net/queuebuf.h"
+#include "lib/memb.h"
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif /* UIP_CONF_IPV6_RPL */
 
 #include <stdio.h>
 
@@ -209,11 +218,6 @@ static int packetbuf_payload_len;
  * is used this includes the UDP header in addition to the IP header).
  */
 static uint8_t uncomp_hdr_len;
-
-/**
- * the result of the last transmitted fragment
- */
-static int last_tx_status;
 /** @} */
 
 #if SICSLOWPAN_CONF_FRAG
@@ -221,35 +225,101 @@ static int last_tx_status;
  *  @{
  */
 
-static uint16_t sicslowpan_len;
-
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * A reassembly context. Each one holds a buffer with the IPv6 packet
+ * (no MAC header, 6lowpan, etc) being rebuilt from the fragments of one
+ * datagram, identified by the sender, the datagram tag and size.
+ * The buffer is the one the first fragment was uncompressed in, taken
+ * from uip_buf, and it is handed back to uip_buf once the packet is
+ * complete (see uip-bufpool).
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+struct reass_context {
+  uip_buf_t *buf;
+  /** The total length of the IPv6 packet in buf, 0 if the context is free */
+  uint16_t len;
+  /**
+   * length of the ip packet already received.
+   * It includes IP and transport headers.
+   */
+  uint16_t processed;
+  /** The tag in the fragments being merged. */
+  uint16_t tag;
+  /** The source address of the fragments being merged */
+  linkaddr_t sender;
+  /** Reassembly %process %timer. */
+  struct timer timer;
+};
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+static struct reass_context reass_contexts[SICSLOWPAN_REASS_CONTEXTS];
 
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * The buffer the current packet is uncompressed into: the buffer of its
+ * reassembly context, or uip_buf if it is not fragmented.
  */
-static uint16_t processed_ip_in_len;
+static uip_buf_t *sicslowpan_aligned_buf;
+#define sicslowpan_buf (sicslowpan_aligned_buf->u8)
 
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+/** Marks the fragments of the packet being sent as one group for the
+    MAC, never 0: the MAC takes 0 for an unfragmented packet. */
+static uint16_t my_frag_group;
+
+/**
+ * Transmission state of a fragmented packet. The MAC reports each
+ * fragment to frag_sent(), the IP layer is told once about the packet.
+ */
+struct frag_tx {
+  /** Fragments not reported yet, plus one while output() queues them */
+  uint8_t pending;
+  /** MAC_TX_OK, or the status of the first fragment that failed */
+  uint8_t status;
+  /** Highest number of transmissions of a fragment */
+  uint8_t transmissions;
+};
+
+/** Number of fragmented packets that can be queued in the MAC at a time */
+#ifdef SICSLOWPAN_CONF_FRAG_TX_MAX
+#define SICSLOWPAN_FRAG_TX_MAX SICSLOWPAN_CONF_FRAG_TX_MAX
+#else
+#define SICSLOWPAN_FRAG_TX_MAX 2
+#endif
+
+MEMB(frag_tx_memb, struct frag_tx, SICSLOWPAN_FRAG_TX_MAX);
 
-/** When reassembling, the source address of the fragments being merged */
-linkaddr_t frag_sender;
+/** Attributes of the packet being fragmented, restored for each fragment */
+static struct packetbuf_attr frag_attrs[PACKETBUF_NUM_ATTRS];
+static struct packetbuf_addr frag_addrs[PACKETBUF_NUM_ADDRS];
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+#if SICSLOWPAN_FRAG_FORWARD && UIP_CONF_ROUTER
+#define SICSLOWPAN_VRB 1
+/**
+ * A virtual reassembly buffer: the fragments of a packet we only route
+ * are relayed as they arrive, with the tag changed to one of ours.
+ */
+struct vrb_entry {
+  /** The sender of the fragments */
+  linkaddr_t prev;
+  /** The next hop the fragments are relayed to */
+  linkaddr_t next;
+  /** The tag in the fragments received */
+  uint16_t tag;
+  /** The size of the packet, 0 if the entry is free */
+  uint16_t size;
+  /** The tag in the fragments relayed */
+  uint16_t out_tag;
+  /** Bytes of the packet relayed so far, from its start without a gap */
+  uint16_t relayed;
+  struct timer timer;
+};
+
+static struct vrb_entry vrb_table[SICSLOWPAN_VRB_ENTRIES];
+#else /* SICSLOWPAN_FRAG_FORWARD && UIP_CONF_ROUTER */
+#define SICSLOWPAN_VRB 0
+#endif /* SICSLOWPAN_FRAG_FORWARD && UIP_CONF_ROUTER */
+
+struct sicslowpan_reass_stats sicslowpan_reass_stats;
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -327,6 +397,28 @@ static struct sicslowpan_addr_context *context;
 /** pointer to the byte where to write next inline field. */
 static uint8_t *hc06_ptr;
 
+#if SICSLOWPAN_HC06_CACHE_ENTRIES > 0
+/**
+ * The address part of a compressed header: the address bits of the
+ * second IPHC byte, the context byte and the inline address bytes,
+ * for a (source, destination, link-layer destination) tuple. The
+ * address contexts are only set at init, so entries do not go stale.
+ */
+struct hc06_cache_entry {
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  linkaddr_t link_destaddr;
+  uint8_t used;
+  uint8_t iphc1;
+  uint8_t cid;
+  uint8_t inline_len;
+  uint8_t inline_addr[32];
+};
+static struct hc06_cache_entry hc06_cache[SICSLOWPAN_HC06_CACHE_ENTRIES];
+/** The entry replaced by the next miss */
+static uint8_t hc06_cache_next;
+#endif /* SICSLOWPAN_HC06_CACHE_ENTRIES > 0 */
+
 /* Uncompression of linklocal */
 /*   0 -> 16 bytes from packet  */
 /*   1 -> 2 bytes from prefix - bunch of zeroes and 8 from packet */
@@ -454,6 +546,145 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
   PRINTF("\n");
 }
 
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the source and destination addresses of the IP
+ * header in uip_buf at hc06_ptr
+ * \param iphc1 the second IPHC byte so far
+ * \param link_destaddr L2 destination address, needed to compress IP
+ * dest
+ * \return the second IPHC byte with the address bits set
+ */
+static uint8_t
+compress_addr_hc06(uint8_t iphc1, linkaddr_t *link_destaddr)
+{
+  /* source address - cannot be multicast */
+  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("IPHC: compressing unspecified - setting SAC\n");
+    iphc1 |= SICSLOWPAN_IPHC_SAC;
+    iphc1 |= SICSLOWPAN_IPHC_SAM_00;
+  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
+     != NULL) {
+    /* elide the prefix - indicate by CID and set context + SAC */
+    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
+	   context->number);
+    iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
+    PACKETBUF_IPHC_BUF[2] |= context->number << 4;
+    /* compession compare with this nodes address (source) */
+
+    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+    /* No context found for this address */
+  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
+	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
+    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+  } else {
+    /* send the full address => SAC = 0, SAM = 00 */
+    iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
+    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
+    hc06_ptr += 16;
+  }
+
+  /* dest address*/
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    /* Address is multicast, try to compress */
+    iphc1 |= SICSLOWPAN_IPHC_M;
+    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_11;
+      /* use last byte */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
+      hc06_ptr += 1;
+    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_10;
+      /* second byte + the last three */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
+      hc06_ptr += 4;
+    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_01;
+      /* second byte + the last five */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
+      hc06_ptr += 6;
+    } else {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_00;
+      /* full address */
+      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
+      hc06_ptr += 16;
+    }
+  } else {
+    /* Address is unicast, try to compress */
+    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
+      /* elide the prefix */
+      iphc1 |= SICSLOWPAN_IPHC_DAC;
+      PACKETBUF_IPHC_BUF[2] |= context->number;
+      /* compession compare with link adress (destination) */
+
+      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+	       &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+      /* No context found for this address */
+    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
+	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
+      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+    } else {
+      /* send the full address */
+      iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
+      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
+      hc06_ptr += 16;
+    }
+  }
+
+  return iphc1;
+}
+#if SICSLOWPAN_HC06_CACHE_ENTRIES > 0
+/*--------------------------------------------------------------------*/
+/** \brief find the compressed addresses of the IP header in uip_buf */
+static struct hc06_cache_entry *
+hc06_cache_lookup(linkaddr_t *link_destaddr)
+{
+  struct hc06_cache_entry *e;
+
+  for(e = hc06_cache; e < hc06_cache + SICSLOWPAN_HC06_CACHE_ENTRIES; e++) {
+    if(e->used &&
+       uip_ipaddr_cmp(&e->destipaddr, &UIP_IP_BUF->destipaddr) &&
+       uip_ipaddr_cmp(&e->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+       linkaddr_cmp(&e->link_destaddr, link_destaddr)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/** \brief remember the compressed addresses of the IP header in uip_buf */
+static void
+hc06_cache_add(linkaddr_t *link_destaddr, uint8_t iphc1,
+               const uint8_t *inline_addr, uint8_t inline_len)
+{
+  struct hc06_cache_entry *e;
+
+  if(inline_len > sizeof(e->inline_addr)) {
+    return;
+  }
+  e = &hc06_cache[hc06_cache_next];
+  hc06_cache_next = (hc06_cache_next + 1) % SICSLOWPAN_HC06_CACHE_ENTRIES;
+
+  uip_ipaddr_copy(&e->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&e->destipaddr, &UIP_IP_BUF->destipaddr);
+  linkaddr_copy(&e->link_destaddr, link_destaddr);
+  e->iphc1 = iphc1;
+  e->cid = PACKETBUF_IPHC_BUF[2];
+  e->inline_len = inline_len;
+  memcpy(e->inline_addr, inline_addr, inline_len);
+  e->used = 1;
+}
+#endif /* SICSLOWPAN_HC06_CACHE_ENTRIES > 0 */
+
 /*--------------------------------------------------------------------*/
 /**
  * \brief Compress IP/UDP header
@@ -493,6 +724,9 @@ static void
 compress_hdr_hc06(linkaddr_t *link_destaddr)
 {
   uint8_t tmp, iphc0, iphc1;
+#if SICSLOWPAN_HC06_CACHE_ENTRIES > 0
+  struct hc06_cache_entry *cached;
+#endif /* SICSLOWPAN_HC06_CACHE_ENTRIES > 0 */
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
@@ -523,6 +757,15 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
    */
 
 
+#if SICSLOWPAN_HC06_CACHE_ENTRIES > 0
+  cached = hc06_cache_lookup(link_destaddr);
+  if(cached != NULL) {
+    /* the addresses are compressed as last time, CID included */
+    if(cached->iphc1 & SICSLOWPAN_IPHC_CID) {
+      hc06_ptr++;
+    }
+  } else
+#endif /* SICSLOWPAN_HC06_CACHE_ENTRIES > 0 */
   /* check if dest context exists (for allocating third byte) */
   /* TODO: fix this so that it remembers the looked up values for
      avoiding two lookups - or set the lookup values immediately */
@@ -618,87 +861,23 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
       break;
   }
 
-  /* source address - cannot be multicast */
-  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
-    PRINTF("IPHC: compressing unspecified - setting SAC\n");
-    iphc1 |= SICSLOWPAN_IPHC_SAC;
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00;
-  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
-     != NULL) {
-    /* elide the prefix - indicate by CID and set context + SAC */
-    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
-	   context->number);
-    iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
-    PACKETBUF_IPHC_BUF[2] |= context->number << 4;
-    /* compession compare with this nodes address (source) */
-
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-    /* No context found for this address */
-  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
-	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-  } else {
-    /* send the full address => SAC = 0, SAM = 00 */
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
-    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
-    hc06_ptr += 16;
-  }
-
-  /* dest address*/
-  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
-    /* Address is multicast, try to compress */
-    iphc1 |= SICSLOWPAN_IPHC_M;
-    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_11;
-      /* use last byte */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
-      hc06_ptr += 1;
-    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_10;
-      /* second byte + the last three */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
-      hc06_ptr += 4;
-    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_01;
-      /* second byte + the last five */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
-      hc06_ptr += 6;
-    } else {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00;
-      /* full address */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
-      hc06_ptr += 16;
+#if SICSLOWPAN_HC06_CACHE_ENTRIES > 0
+  if(cached != NULL) {
+    iphc1 = cached->iphc1;
+    if(iphc1 & SICSLOWPAN_IPHC_CID) {
+      PACKETBUF_IPHC_BUF[2] = cached->cid;
     }
+    memcpy(hc06_ptr, cached->inline_addr, cached->inline_len);
+    hc06_ptr += cached->inline_len;
   } else {
-    /* Address is unicast, try to compress */
-    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
-      /* elide the prefix */
-      iphc1 |= SICSLOWPAN_IPHC_DAC;
-      PACKETBUF_IPHC_BUF[2] |= context->number;
-      /* compession compare with link adress (destination) */
+    uint8_t *addr_ptr = hc06_ptr;
 
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-	       &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
-      /* No context found for this address */
-    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
-	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
-    } else {
-      /* send the full address */
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
-      hc06_ptr += 16;
-    }
+    iphc1 = compress_addr_hc06(iphc1, link_destaddr);
+    hc06_cache_add(link_destaddr, iphc1, addr_ptr, hc06_ptr - addr_ptr);
   }
+#else /* SICSLOWPAN_HC06_CACHE_ENTRIES > 0 */
+  iphc1 = compress_addr_hc06(iphc1, link_destaddr);
+#endif /* SICSLOWPAN_HC06_CACHE_ENTRIES > 0 */
 
   uncomp_hdr_len = UIP_IPH_LEN;
 
@@ -1314,16 +1493,49 @@ packet_sent(void *ptr, int status, int transmissions)
   if(callback != NULL) {
     callback->output_callback(status);
   }
-  last_tx_status = status;
 }
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Drop a reference to a fragmented packet, and report it to the
+ * IP layer once all its fragments are done with.
+ */
+static void
+frag_tx_release(struct frag_tx *tx)
+{
+  if(--tx->pending == 0) {
+    packet_sent(NULL, tx->status, tx->transmissions);
+    memb_free(&frag_tx_memb, tx);
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * Callback function for the MAC sent callback of a fragment
+ */
+static void
+frag_sent(void *ptr, int status, int transmissions)
+{
+  struct frag_tx *tx = ptr;
+
+  if(status != MAC_TX_OK && tx->status == MAC_TX_OK) {
+    tx->status = status;
+  }
+  if(transmissions > tx->transmissions) {
+    tx->transmissions = transmissions;
+  }
+  frag_tx_release(tx);
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /**
  * \brief This function is called by the 6lowpan code to send out a
  * packet.
  * \param dest the link layer destination address of the packet
+ * \param sent the function the MAC calls with the result
+ * \param ptr the pointer passed to sent
  */
 static void
-send_packet(linkaddr_t *dest)
+send_packet(linkaddr_t *dest, mac_callback_t sent, void *ptr)
 {
   /* Set the link layer destination address for the packet as a
    * packetbuf attribute. The MAC layer can access the destination
@@ -1338,7 +1550,7 @@ send_packet(linkaddr_t *dest)
 
   /* Provide a callback function to receive the result of
      a packet transmission. */
-  NETSTACK_LLSEC.send(&packet_sent, NULL);
+  NETSTACK_LLSEC.send(sent, ptr);
 
   /* If we are sending multiple packets in a row, we need to let the
      watchdog know that we are still alive. */
@@ -1376,6 +1588,11 @@ output(const uip_lladdr_t *localdest)
 
   packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
                      SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  /* The MAC sends neighbor discovery and RPL ahead of data */
+  packetbuf_set_attr(PACKETBUF_ATTR_NETWORK_ID, UIP_IP_BUF->proto);
+  if(UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+    packetbuf_set_attr(PACKETBUF_ATTR_ICMP6_TYPE, UIP_ICMP_BUF->type);
+  }
 
   if(callback) {
     /* call the attribution when the callback comes, but set attributes
@@ -1447,21 +1664,39 @@ output(const uip_lladdr_t *localdest)
 
   if((int)uip_len - (int)uncomp_hdr_len > max_payload - (int)packetbuf_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
-    struct queuebuf *q;
+    struct frag_tx *tx;
+    int fragn_payload_len;
+    int fragments;
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
      * The first fragment contains frag1 dispatch, then
      * IPv6/HC1/HC06/HC_UDP dispatchs/headers.
      * The following fragments contain only the fragn dispatch.
+     *
+     * Each fragment is built once, straight from uip_buf, and handed to
+     * the MAC without waiting for the previous one to be sent, so that
+     * the MAC can send the whole packet as a burst.
      */
-    int estimated_fragments = ((int)uip_len) / ((int)MAC_MAX_PAYLOAD - SICSLOWPAN_FRAGN_HDR_LEN) + 1;
-    int freebuf = queuebuf_numfree() - 1;
-    PRINTFO("uip_len: %d, fragments: %d, free bufs: %d\n", uip_len, estimated_fragments, freebuf);
-    if(freebuf < estimated_fragments) {
+    packetbuf_payload_len = (max_payload - packetbuf_hdr_len - SICSLOWPAN_FRAG1_HDR_LEN) & 0xfffffff8;
+    fragn_payload_len = (max_payload - SICSLOWPAN_FRAGN_HDR_LEN) & 0xfffffff8;
+    fragments = 1 + ((int)uip_len - uncomp_hdr_len - packetbuf_payload_len +
+                     fragn_payload_len - 1) / fragn_payload_len;
+    PRINTFO("uip_len: %d, fragments: %d, free bufs: %d\n", uip_len, fragments, queuebuf_numfree());
+    if(queuebuf_numfree() < fragments) {
       PRINTFO("Dropping packet, not enough free bufs\n");
       return 0;
     }
+    tx = memb_alloc(&frag_tx_memb);
+    if(tx == NULL) {
+      PRINTFO("Dropping packet, too many fragmented packets queued\n");
+      return 0;
+    }
+    /* Hold a reference until all fragments are queued, the MAC may
+       report the first ones before that */
+    tx->pending = 1;
+    tx->status = MAC_TX_OK;
+    tx->transmissions = 0;
 
     PRINTFO("Fragmentation sending packet len %d\n", uip_len);
 
@@ -1481,51 +1716,50 @@ output(const uip_lladdr_t *localdest)
           ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | uip_len));
 /*     PACKETBUF_FRAG_BUF->tag = uip_htons(my_tag); */
     SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, my_tag);
-    my_tag++;
 
     /* Copy payload and send */
     packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-    packetbuf_payload_len = (max_payload - packetbuf_hdr_len) & 0xfffffff8;
     PRINTFO("(len %d, tag %d)\n", packetbuf_payload_len, my_tag);
     memcpy(packetbuf_ptr + packetbuf_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, packetbuf_payload_len);
     packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-    q = queuebuf_new_from_packetbuf();
-    if(q == NULL) {
-      PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
-      return 0;
-    }
-    send_packet(&dest);
-    queuebuf_to_packetbuf(q);
-    queuebuf_free(q);
-    q = NULL;
-
-    /* Check tx result. */
-    if((last_tx_status == MAC_TX_COLLISION) ||
-       (last_tx_status == MAC_TX_ERR) ||
-       (last_tx_status == MAC_TX_ERR_FATAL)) {
-      PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
-      return 0;
+    packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
+    if(++my_frag_group == 0) {
+      my_frag_group = 1;
     }
+    packetbuf_set_attr(PACKETBUF_ATTR_FRAGMENT_GROUP, my_frag_group);
+    packetbuf_attr_copyto(frag_attrs, frag_addrs);
+    tx->pending++;
+    send_packet(&dest, &frag_sent, tx);
 
     /* set processed_ip_out_len to what we already sent from the IP payload*/
     processed_ip_out_len = packetbuf_payload_len + uncomp_hdr_len;
-    
+
     /*
      * Create following fragments
-     * Datagram tag is already in the buffer, we need to set the
-     * FRAGN dispatch and for each fragment, the offset
+     * The lower layers may have changed packetbuf, each fragment is
+     * rebuilt from the attributes of the packet and uip_buf.
      */
     packetbuf_hdr_len = SICSLOWPAN_FRAGN_HDR_LEN;
-/*     PACKETBUF_FRAG_BUF->dispatch_size = */
-/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
-    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
-          ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
-    packetbuf_payload_len = (max_payload - packetbuf_hdr_len) & 0xfffffff8;
+    packetbuf_payload_len = fragn_payload_len;
     while(processed_ip_out_len < uip_len) {
+      /* A synchronous MAC has already reported a failure, the packet
+         cannot be reassembled anymore */
+      if(tx->status != MAC_TX_OK) {
+        PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
+        break;
+      }
       PRINTFO("sicslowpan output: fragment ");
+      packetbuf_clear();
+      packetbuf_attr_copyfrom(frag_attrs, frag_addrs);
+      packetbuf_ptr = packetbuf_dataptr();
+/*     PACKETBUF_FRAG_BUF->dispatch_size = */
+/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+            ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, my_tag);
       PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] = processed_ip_out_len >> 3;
-      
+
       /* Copy payload and send */
       if(uip_len - processed_ip_out_len < packetbuf_payload_len) {
         /* last fragment */
@@ -1536,24 +1770,14 @@ output(const uip_lladdr_t *localdest)
       memcpy(packetbuf_ptr + packetbuf_hdr_len,
              (uint8_t *)UIP_IP_BUF + processed_ip_out_len, packetbuf_payload_len);
       packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-      q = queuebuf_new_from_packetbuf();
-      if(q == NULL) {
-        PRINTFO("could not allocate queuebuf, dropping fragment\n");
-        return 0;
-      }
-      send_packet(&dest);
-      queuebuf_to_packetbuf(q);
-      queuebuf_free(q);
-      q = NULL;
+      tx->pending++;
+      send_packet(&dest, &frag_sent, tx);
       processed_ip_out_len += packetbuf_payload_len;
-
-      /* Check tx result. */
-      if((last_tx_status == MAC_TX_COLLISION) ||
-         (last_tx_status == MAC_TX_ERR) ||
-         (last_tx_status == MAC_TX_ERR_FATAL)) {
-        PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
-        return 0;
-      }
+    }
+    my_tag++;
+    frag_tx_release(tx);
+    if(processed_ip_out_len < uip_len) {
+      return 0;
     }
 #else /* SICSLOWPAN_CONF_FRAG */
     PRINTFO("sicslowpan output: Packet too large to be sent without fragmentation support; dropping packet\n");
@@ -1568,11 +1792,317 @@ output(const uip_lladdr_t *localdest)
     memcpy(packetbuf_ptr + packetbuf_hdr_len, (uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
            uip_len - uncomp_hdr_len);
     packetbuf_set_datalen(uip_len - uncomp_hdr_len + packetbuf_hdr_len);
-    send_packet(&dest);
+    send_packet(&dest, &packet_sent, NULL);
   }
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/* We are currently reassembling as many packets as we have contexts for,
+ * but have just received the first fragment of another packet. We can
+ * either ignore it and hope to receive the rest of the under-reassembly
+ * packet fragments, or we can discard the oldest packet altogether, and
+ * start reassembling the new packet.
+ *
+ * We discard the oldest packet, and start reassembling the new packet.
+ * This lessens the negative impacts of too high SICSLOWPAN_REASS_MAXAGE.
+ */
+#define PRIORITIZE_NEW_PACKETS 1
+
+/*--------------------------------------------------------------------*/
+/** \brief Free a context and its buffer */
+static void
+reass_free(struct reass_context *c)
+{
+  c->len = 0;
+  uip_bufpool_free(c->buf);
+  c->buf = NULL;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Free the reassembly contexts that timed out */
+static void
+reass_expire(void)
+{
+  struct reass_context *c;
+
+  for(c = reass_contexts; c < reass_contexts + SICSLOWPAN_REASS_CONTEXTS; c++) {
+    if(c->len > 0 && timer_expired(&c->timer)) {
+      PRINTFI("sicslowpan input: reassembly timed out (len %d, tag %d)\n",
+              c->len, c->tag);
+      reass_free(c);
+      sicslowpan_reass_stats.timeouts++;
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/** \brief Find the context of the packet a fragment belongs to */
+static struct reass_context *
+reass_lookup(uint16_t tag, uint16_t size, const linkaddr_t *sender)
+{
+  struct reass_context *c;
+
+  for(c = reass_contexts; c < reass_contexts + SICSLOWPAN_REASS_CONTEXTS; c++) {
+    if(c->len == size && c->tag == tag && linkaddr_cmp(&c->sender, sender)) {
+      return c;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Get a free context for a new packet
+ *
+ * The context is only marked as used (by setting its length) once the
+ * first fragment has been processed.
+ */
+static struct reass_context *
+reass_alloc(void)
+{
+  struct reass_context *c;
+  struct reass_context *oldest = NULL;
+
+  for(c = reass_contexts; c < reass_contexts + SICSLOWPAN_REASS_CONTEXTS; c++) {
+    if(c->len == 0) {
+      return c;
+    }
+    if(oldest == NULL ||
+       timer_remaining(&c->timer) < timer_remaining(&oldest->timer)) {
+      oldest = c;
+    }
+  }
+#if PRIORITIZE_NEW_PACKETS
+  PRINTFI("sicslowpan input: dropping packet being reassembled (len %d, tag %d)\n",
+          oldest->len, oldest->tag);
+  reass_free(oldest);
+  sicslowpan_reass_stats.evicted++;
+  return oldest;
+#else /* PRIORITIZE_NEW_PACKETS */
+  return NULL;
+#endif /* PRIORITIZE_NEW_PACKETS */
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
+
+#if SICSLOWPAN_VRB
+/*--------------------------------------------------------------------*/
+/** \brief Free the relay entries that timed out */
+static void
+vrb_expire(void)
+{
+  struct vrb_entry *e;
+
+  for(e = vrb_table; e < vrb_table + SICSLOWPAN_VRB_ENTRIES; e++) {
+    if(e->size > 0 && timer_expired(&e->timer)) {
+      PRINTFI("sicslowpan input: relay of tag %d timed out\n", e->tag);
+      e->size = 0;
+      sicslowpan_reass_stats.timeouts++;
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/** \brief Find the relay entry of the packet a fragment belongs to */
+static struct vrb_entry *
+vrb_lookup(uint16_t tag, uint16_t size, const linkaddr_t *sender)
+{
+  struct vrb_entry *e;
+
+  for(e = vrb_table; e < vrb_table + SICSLOWPAN_VRB_ENTRIES; e++) {
+    if(e->size == size && e->tag == tag && linkaddr_cmp(&e->prev, sender)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief The link-layer address of the next hop towards dest, as
+ * tcpip_ipv6_output() would pick it, or NULL if there is none yet
+ */
+static const uip_lladdr_t *
+vrb_nexthop(uip_ipaddr_t *dest)
+{
+  uip_ds6_route_t *route;
+  uip_ipaddr_t *nexthop;
+  uip_ds6_nbr_t *nbr;
+
+  if(uip_ds6_is_addr_onlink(dest)) {
+    nexthop = dest;
+  } else if((route = uip_ds6_route_lookup(dest)) != NULL) {
+    nexthop = uip_ds6_route_nexthop(route);
+  } else {
+    nexthop = uip_ds6_defrt_choose();
+  }
+  if(nexthop == NULL) {
+    return NULL;
+  }
+  nbr = uip_ds6_nbr_lookup(nexthop);
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_IPv6
+  if(nbr != NULL && nbr->state == NBR_INCOMPLETE) {
+    return NULL;
+  }
+#endif /* UIP_ND6_ENGINE == UIP_ND6_ENGINE_IPv6 */
+  return nbr == NULL ? NULL : uip_ds6_nbr_get_ll(nbr);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Relay a first fragment, uncompressed in uip_buf, if its packet
+ * is only routed through us
+ * \param tag the tag of the fragment
+ * \param size the size of the packet
+ * \return 1 if the fragment was relayed or dropped, 0 if the packet
+ * must be reassembled
+ *
+ * Packets for us, multicast and link-local packets and packets we have
+ * no next hop for yet are left to the IP layer, as is a hop limit that
+ * runs out since the ICMPv6 error needs the whole packet. The header
+ * is compressed again for the next link, the payload of the fragment
+ * is kept as it is so that the offsets of the following fragments
+ * still hold.
+ */
+static int
+vrb_forward(uint16_t tag, uint16_t size)
+{
+  struct vrb_entry *e;
+  const uip_lladdr_t *nexthop;
+  int framer_hdrlen;
+  int max_payload;
+  /* The part of the packet the fragment carries */
+  uint16_t end = uncomp_hdr_len + packetbuf_payload_len;
+
+  if(uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr) ||
+     uip_ds6_is_my_maddr(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_loopback(&UIP_IP_BUF->destipaddr) ||
+     UIP_IP_BUF->ttl <= 1) {
+    return 0;
+  }
+  nexthop = vrb_nexthop(&UIP_IP_BUF->destipaddr);
+  if(nexthop == NULL) {
+    return 0;
+  }
+  for(e = vrb_table; e < vrb_table + SICSLOWPAN_VRB_ENTRIES; e++) {
+    if(e->size == 0) {
+      break;
+    }
+  }
+  if(e == vrb_table + SICSLOWPAN_VRB_ENTRIES) {
+    PRINTFI("sicslowpan input: relay table full, reassembling\n");
+    return 0;
+  }
+
+#if UIP_CONF_IPV6_RPL
+  /* Update the RPL option as uip_process() does when forwarding */
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    /* The option must be in this fragment: an 8-byte extension header */
+    if(end < UIP_IPH_LEN + 8) {
+      return 0;
+    }
+    if(rpl_update_header_empty()) {
+      uip_len = 0;
+      return 1;
+    }
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+
+  linkaddr_copy(&e->prev, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  linkaddr_copy(&e->next, (const linkaddr_t *)nexthop);
+
+  /* Compress the header again for the next link */
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
+  compress_hdr_hc1(&e->next);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
+  compress_hdr_ipv6(&e->next);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  compress_hdr_hc06(&e->next);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &e->next);
+  framer_hdrlen = NETSTACK_FRAMER.length();
+  if(framer_hdrlen < 0) {
+    framer_hdrlen = 21;
+  }
+  max_payload = MAC_MAX_PAYLOAD - framer_hdrlen - NETSTACK_LLSEC.get_overhead();
+  if(uncomp_hdr_len > end ||
+     SICSLOWPAN_FRAG1_HDR_LEN + packetbuf_hdr_len + end - uncomp_hdr_len > max_payload) {
+    PRINTFI("sicslowpan input: first fragment does not fit the next link, dropping\n");
+    uip_len = 0;
+    return 1;
+  }
+
+  memmove(packetbuf_ptr + SICSLOWPAN_FRAG1_HDR_LEN, packetbuf_ptr, packetbuf_hdr_len);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | size));
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, my_tag);
+  packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+  memcpy(packetbuf_ptr + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, end - uncomp_hdr_len);
+  packetbuf_set_datalen(packetbuf_hdr_len + end - uncomp_hdr_len);
+
+  e->tag = tag;
+  e->size = size;
+  e->out_tag = my_tag++;
+  e->relayed = end;
+  timer_set(&e->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  PRINTFI("sicslowpan input: relaying (len %d, tag %d) as tag %d\n",
+          size, tag, e->out_tag);
+  sicslowpan_reass_stats.relayed++;
+  uip_len = 0;
+
+  send_packet(&e->next, &packet_sent, NULL);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Relay the following fragment in packetbuf */
+static void
+vrb_relay(struct vrb_entry *e)
+{
+  uint16_t len = packetbuf_datalen();
+  uint16_t offset;
+
+  if(len < SICSLOWPAN_FRAGN_HDR_LEN) {
+    return;
+  }
+  offset = (uint16_t)PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] << 3;
+  if(offset < e->relayed) {
+    /* The sender missed our ack: the next hop has this one already */
+    PRINTFI("sicslowpan input: dropping duplicate fragment (offset %d, tag %d)\n",
+            PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET], e->tag);
+    return;
+  }
+  if(offset == e->relayed) {
+    /* A fragment that arrives ahead of a missing one is relayed but
+       not counted, the entry then lives until it times out */
+    e->relayed += len - SICSLOWPAN_FRAGN_HDR_LEN;
+  }
+  PRINTFI("sicslowpan input: relaying fragment (offset %d, tag %d) as tag %d\n",
+          PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET], e->tag, e->out_tag);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, e->out_tag);
+
+  /* Keep the fragment, drop what the MAC left of the received frame */
+  packetbuf_compact();
+  packetbuf_clear_hdr();
+  packetbuf_attr_clear();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  send_packet(&e->next, &packet_sent, NULL);
+
+  if(e->relayed >= e->size) {
+    e->size = 0;
+  }
+}
+#endif /* SICSLOWPAN_VRB */
+
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1580,8 +2110,11 @@ output(const uip_lladdr_t *localdest)
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
  *  a non-fragmented packet we first uncompress the IP header. The
  *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
- *  to uip_buf and the IP layer is called.
+ *  copied in the buffer of the packet's reassembly context (or straight
+ *  in uip_buf if the packet is not fragmented). Fragments are matched to
+ *  their context by sender, tag and size, so several packets can be
+ *  reassembled at the same time. If the IP packet is complete it is
+ *  copied to uip_buf and the IP layer is called.
  *
  * \note We do not check for overlapping sicslowpan fragments
  * (it is a SHALL in the RFC 4944 and should never happen)
@@ -1598,6 +2131,8 @@ input(void)
   /* tag of the fragment */
   uint16_t frag_tag = 0;
   uint8_t first_fragment = 0, last_fragment = 0;
+  /* reassembly context of the packet, NULL if it is not fragmented */
+  struct reass_context *reass = NULL;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1610,12 +2145,13 @@ input(void)
   /* Save the RSSI of the incoming packet in case the upper layer will
      want to query us for it later. */
   last_rssi = (signed short)packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  link_stats_input_callback(packetbuf_addr(PACKETBUF_ADDR_SENDER));
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
+  /* cancel the reassemblies that timed out */
+  reass_expire();
+#if SICSLOWPAN_VRB
+  vrb_expire();
+#endif /* SICSLOWPAN_VRB */
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1647,77 +2183,71 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d packetbuf_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - packetbuf_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - packetbuf_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       is_fragment = 1;
       break;
     default:
       break;
   }
 
-  /* We are currently reassembling a packet, but have just received the first
-   * fragment of another packet. We can either ignore it and hope to receive
-   * the rest of the under-reassembly packet fragments, or we can discard the
-   * previous packet altogether, and start reassembling the new packet.
-   *
-   * We discard the previous packet, and start reassembling the new packet.
-   * This lessens the negative impacts of too high SICSLOWPAN_REASS_MAXAGE.
-   */
-#define PRIORITIZE_NEW_PACKETS 1
-#if PRIORITIZE_NEW_PACKETS
-
-  if(!is_fragment) {
-    /* Prioritize non-fragment packets too. */
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  } else if(processed_ip_in_len > 0 && first_fragment
-      && !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
-#endif /* PRIORITIZE_NEW_PACKETS */
+  if(is_fragment) {
+    if(frag_size == 0 || frag_size > UIP_BUFSIZE) {
+      PRINTFI("sicslowpan input: bad fragment size %d\n", frag_size);
+      return;
+    }
+    reass = reass_lookup(frag_tag, frag_size, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+#if SICSLOWPAN_VRB
+    {
+      struct vrb_entry *e;
 
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
+      e = vrb_lookup(frag_tag, frag_size, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      if(e != NULL && reass == NULL) {
+        if(!first_fragment) {
+          vrb_relay(e);
+        }
+        return;
+      }
+    }
+#endif /* SICSLOWPAN_VRB */
+    if(first_fragment) {
+      if(reass != NULL) {
+        /* Duplicate of a first fragment we already have */
+        PRINTFI("sicslowpan input: Dropping duplicate FRAG1\n");
+        return;
+      }
+#if !SICSLOWPAN_VRB
+      reass = reass_alloc();
+#endif /* !SICSLOWPAN_VRB */
+    }
+    if(reass == NULL && !(SICSLOWPAN_VRB && first_fragment)) {
       /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
+       * the packet is a fragment that does not belong to any packet
+       * being reassembled.
        */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+      PRINTFI("sicslowpan input: Dropping 6lowpan fragment of no packet being reassembled\n");
+      sicslowpan_reass_stats.dropped++;
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      /* We are currently not reassembling a packet, but have received a packet fragment
-       * that is not the first one. */
-      if(is_fragment && !first_fragment) {
-        return;
-      }
 
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      linkaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    /* If this is the last fragment, we may shave off any extrenous
+       bytes at the end. We must be liberal in what we accept. A first
+       fragment has no context yet with fragment forwarding. */
+    if(!first_fragment) {
+      PRINTFI("last_fragment?: processed %d packetbuf_payload_len %d frag_size %d\n",
+              reass->processed, packetbuf_datalen() - packetbuf_hdr_len, frag_size);
+      if(reass->processed + packetbuf_datalen() - packetbuf_hdr_len >= frag_size) {
+        last_fragment = 1;
+      }
     }
+    /*
+     * A first fragment is uncompressed in uip_buf, whose buffer the
+     * context then takes over. With fragment forwarding, its header
+     * also tells whether the packet is relayed or reassembled.
+     */
+    sicslowpan_aligned_buf = reass != NULL && !first_fragment ?
+      reass->buf : uip_bufp;
+  } else {
+    /* Not fragmented: uncompress straight into uip_buf */
+    sicslowpan_aligned_buf = uip_bufp;
   }
 
   if(packetbuf_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1790,66 +2320,90 @@ input(void)
 
   memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), packetbuf_ptr + packetbuf_hdr_len, packetbuf_payload_len);
   
-  /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
+  /* update the reassembly context if fragment, uip_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
+  if(is_fragment) {
     if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
+#if SICSLOWPAN_VRB
+      if(vrb_forward(frag_tag, frag_size)) {
+        return;
+      }
+      reass = reass_alloc();
+      if(reass == NULL) {
+        sicslowpan_reass_stats.dropped++;
+        return;
+      }
+#endif /* SICSLOWPAN_VRB */
+      reass->buf = uip_bufpool_take();
+      if(reass->buf == NULL) {
+        sicslowpan_reass_stats.dropped++;
+        return;
+      }
+      reass->len = frag_size;
+      reass->tag = frag_tag;
+      linkaddr_copy(&reass->sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      timer_set(&reass->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+              reass->len, reass->tag);
+      sicslowpan_reass_stats.started++;
+      /* Add the size of the header only for the first fragment. */
+      reass->processed = uncomp_hdr_len;
     }
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
     if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
+      reass->processed = frag_size;
     } else {
-      processed_ip_in_len += packetbuf_payload_len;
+      reass->processed += packetbuf_payload_len;
     }
-    PRINTF("processed_ip_in_len %d, packetbuf_payload_len %d\n", processed_ip_in_len, packetbuf_payload_len);
+    PRINTF("processed %d, packetbuf_payload_len %d\n", reass->processed, packetbuf_payload_len);
 
-  } else {
-#endif /* SICSLOWPAN_CONF_FRAG */
-    sicslowpan_len = packetbuf_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
-  }
+    if(reass->processed < reass->len) {
+      return;
+    }
+    if(reass->processed > reass->len) {
+      PRINTFI("sicslowpan input: Dropping packet larger than its fragment size\n");
+      reass_free(reass);
+      sicslowpan_reass_stats.dropped++;
+      return;
+    }
 
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
+    /*
+     * We have a full IP packet in the reassembly buffer, deliver it to
+     * the IP stack
+     */
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n", reass->len);
+    uip_bufpool_give(reass->buf);
+    reass->buf = NULL;
+    uip_len = reass->len;
+    reass->len = 0;
+    sicslowpan_reass_stats.completed++;
+  } else
 #endif /* SICSLOWPAN_CONF_FRAG */
+  {
+    uip_len = packetbuf_payload_len + uncomp_hdr_len;
+  }
 
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
@@ -1865,6 +2419,8 @@ sicslowpan_init(void)
    */
   tcpip_set_outputfunc(output);
 
+  link_stats_init();
+
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
 /* Preinitialize any address contexts for better header compression
  * (Saves up to 13 bytes per 6lowpan packet)
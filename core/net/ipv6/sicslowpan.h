@@ -321,6 +321,18 @@ struct sicslowpan_nh_compressor {
 
 int sicslowpan_get_last_rssi(void);
 
+/** Reassembly counters, kept when fragmentation is enabled */
+struct sicslowpan_reass_stats {
+  uint16_t started;    /**< FRAG1 received for a new datagram */
+  uint16_t completed;  /**< datagrams passed up to the IP layer */
+  uint16_t timeouts;   /**< contexts reclaimed after SICSLOWPAN_REASS_MAXAGE */
+  uint16_t evicted;    /**< contexts given up to make room for a new datagram */
+  uint16_t dropped;    /**< fragments that matched no context */
+  uint16_t relayed;    /**< packets relayed fragment by fragment */
+};
+
+extern struct sicslowpan_reass_stats sicslowpan_reass_stats;
+
 extern const struct network_driver sicslowpan_driver;
 
 #endif /* SICSLOWPAN_H_ */
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    The packet buffers shared by uIP, 6lowpan reassembly and the
+ *    neighbor packet queues.
+ */
+
+#include "net/ipv6/uip-bufpool.h"
+#include "lib/memb.h"
+
+MEMB(bufs_memb, uip_buf_t, UIP_BUFPOOL_NUM);
+
+/* uip_aligned_buf circulates like the other buffers: it is in the pool
+   when this is set */
+static uint8_t aligned_buf_free;
+/*---------------------------------------------------------------------------*/
+static uip_buf_t *
+buf_alloc(void)
+{
+  if(aligned_buf_free) {
+    aligned_buf_free = 0;
+    return &uip_aligned_buf;
+  }
+  return memb_alloc(&bufs_memb);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_bufpool_free(uip_buf_t *buf)
+{
+  if(buf == &uip_aligned_buf) {
+    aligned_buf_free = 1;
+  } else if(buf != NULL) {
+    memb_free(&bufs_memb, buf);
+  }
+}
+/*---------------------------------------------------------------------------*/
+uip_buf_t *
+uip_bufpool_take(void)
+{
+  uip_buf_t *buf;
+  uip_buf_t *empty;
+
+  empty = buf_alloc();
+  if(empty == NULL) {
+    return NULL;
+  }
+  buf = uip_bufp;
+  uip_bufp = empty;
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_bufpool_give(uip_buf_t *buf)
+{
+  uip_bufpool_free(uip_bufp);
+  uip_bufp = buf;
+}
+/*---------------------------------------------------------------------------*/
+int
+uip_bufpool_available(void)
+{
+  return memb_numfree(&bufs_memb) + aligned_buf_free;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    The packet buffers shared by uIP, 6lowpan reassembly and the
+ *    neighbor packet queues. A packet changes hands by exchanging
+ *    buffers with uip_buf instead of being copied.
+ */
+
+#ifndef UIP_BUFPOOL_H_
+#define UIP_BUFPOOL_H_
+
+#include "net/ip/uip.h"
+
+/**
+ * Number of buffers besides uip_aligned_buf. They hold the packets
+ * being reassembled and the packets queued for neighbors being resolved.
+ */
+#ifdef UIP_BUFPOOL_CONF_NUM
+#define UIP_BUFPOOL_NUM UIP_BUFPOOL_CONF_NUM
+#else
+#define UIP_BUFPOOL_NUM 4
+#endif
+
+/**
+ * \brief Take the packet in uip_buf over
+ * \return The buffer holding the packet, NULL if the pool is empty
+ *
+ * uip_buf is given an empty buffer from the pool. If there is none,
+ * uip_buf is left untouched.
+ */
+uip_buf_t *uip_bufpool_take(void);
+
+/**
+ * \brief Hand a packet over to uip_buf
+ * \param buf The buffer holding the packet, taken with uip_bufpool_take()
+ *
+ * The buffer uip_buf used returns to the pool.
+ */
+void uip_bufpool_give(uip_buf_t *buf);
+
+/**
+ * \brief Return a buffer taken with uip_bufpool_take() to the pool
+ */
+void uip_bufpool_free(uip_buf_t *buf);
+
+/** \brief Number of buffers left in the pool */
+int uip_bufpool_available(void);
+
+#endif /* UIP_BUFPOOL_H_ */
+/** @} */
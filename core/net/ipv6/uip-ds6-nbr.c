@@ -48,6 +48,7 @@
 #include <stddef.h>
 #include "lib/list.h"
 #include "net/linkaddr.h"
+#include "net/link-stats.h"
 #include "net/packetbuf.h"
 #include "net/ipv6/uip-ds6-nbr.h"
 #include "net/ipv6/uip-ds6-route.h"
@@ -71,10 +72,307 @@ void LINK_NEIGHBOR_CALLBACK(const linkaddr_t *addr, int status, int numtx);
 
 NBR_TABLE_GLOBAL(uip_ds6_nbr_t, ds6_neighbors);
 
+#if NBR_TABLE_MAX_NEIGHBORS < 0xff
+typedef uint8_t nbr_index_t;
+#define NBR_INDEX_NONE 0xff
+#else
+typedef uint16_t nbr_index_t;
+#define NBR_INDEX_NONE 0xffff
+#endif
+
+#if UIP_DS6_NBR_INDEX
+/* Secondary index: IPv6 address -> nbr_table slot, linear probing */
+static nbr_index_t nbr_index[UIP_DS6_NBR_INDEX_SIZE];
+#endif /* UIP_DS6_NBR_INDEX */
+
+#if UIP_DS6_NBR_DEADLINES
+/* Binary min-heap of nbr_table slots ordered by the time (clock_seconds)
+ * at which the neighbor needs attention from uip_ds6_neighbor_periodic() */
+static nbr_index_t deadline_heap[NBR_TABLE_MAX_NEIGHBORS];
+static nbr_index_t deadline_pos[NBR_TABLE_MAX_NEIGHBORS];
+static unsigned long deadline[NBR_TABLE_MAX_NEIGHBORS];
+static uint16_t deadline_heap_len;
+#define DEADLINE_BEFORE(a, b) ((long)((a) - (b)) < 0)
+#endif /* UIP_DS6_NBR_DEADLINES */
+
+#if UIP_DS6_NBR_STATS
+struct uip_ds6_nbr_stats uip_ds6_nbr_stats;
+#endif /* UIP_DS6_NBR_STATS */
+
+#if UIP_DS6_NBR_INDEX
+/*---------------------------------------------------------------------------*/
+static uint16_t
+nbr_index_hash(const uip_ipaddr_t *ipaddr)
+{
+  /* Mostly the interface identifier, plus the first prefix word so that
+   * the link-local and global addresses of a node do not collide */
+  uint16_t h = ipaddr->u16[0];
+  h = (h * 31) ^ ipaddr->u16[4];
+  h = (h * 31) ^ ipaddr->u16[5];
+  h = (h * 31) ^ ipaddr->u16[6];
+  h = (h * 31) ^ ipaddr->u16[7];
+  return h % UIP_DS6_NBR_INDEX_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_nbr_t *
+nbr_index_item(uint16_t pos)
+{
+  return item_from_index(ds6_neighbors, nbr_index[pos]);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the index slot that refers to nbr, NBR_INDEX_NONE if none */
+static uint16_t
+nbr_index_find(const uip_ipaddr_t *ipaddr, const uip_ds6_nbr_t *nbr)
+{
+  uint16_t pos = nbr_index_hash(ipaddr);
+  uint16_t n;
+
+  for(n = 0; n < UIP_DS6_NBR_INDEX_SIZE && nbr_index[pos] != NBR_INDEX_NONE; n++) {
+    uip_ds6_nbr_t *item = nbr_index_item(pos);
+    if(nbr != NULL ? item == nbr : uip_ipaddr_cmp(&item->ipaddr, ipaddr)) {
+      return pos;
+    }
+    pos = (pos + 1) % UIP_DS6_NBR_INDEX_SIZE;
+  }
+  return NBR_INDEX_NONE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+nbr_index_insert(const uip_ds6_nbr_t *nbr)
+{
+  uint16_t pos = nbr_index_hash(&nbr->ipaddr);
+
+  while(nbr_index[pos] != NBR_INDEX_NONE) {
+    pos = (pos + 1) % UIP_DS6_NBR_INDEX_SIZE;
+  }
+  nbr_index[pos] = index_from_item(ds6_neighbors, nbr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+nbr_index_remove(const uip_ds6_nbr_t *nbr)
+{
+  uint16_t pos = nbr_index_find(&nbr->ipaddr, nbr);
+  uint16_t next;
+  uint16_t home;
+
+  if(pos == NBR_INDEX_NONE) {
+    return;
+  }
+  /* Backward shift deletion, no tombstones */
+  nbr_index[pos] = NBR_INDEX_NONE;
+  next = pos;
+  for(;;) {
+    next = (next + 1) % UIP_DS6_NBR_INDEX_SIZE;
+    if(nbr_index[next] == NBR_INDEX_NONE) {
+      return;
+    }
+    home = nbr_index_hash(&nbr_index_item(next)->ipaddr);
+    if(pos <= next ? (pos < home && home <= next) : (pos < home || home <= next)) {
+      continue;
+    }
+    nbr_index[pos] = nbr_index[next];
+    nbr_index[next] = NBR_INDEX_NONE;
+    pos = next;
+  }
+}
+#endif /* UIP_DS6_NBR_INDEX */
+#if UIP_DS6_NBR_DEADLINES
+/*---------------------------------------------------------------------------*/
+static void
+deadline_heap_swap(uint16_t a, uint16_t b)
+{
+  nbr_index_t tmp = deadline_heap[a];
+  deadline_heap[a] = deadline_heap[b];
+  deadline_heap[b] = tmp;
+  deadline_pos[deadline_heap[a]] = a;
+  deadline_pos[deadline_heap[b]] = b;
+}
+/*---------------------------------------------------------------------------*/
+static void
+deadline_heap_fix(uint16_t pos)
+{
+  uint16_t child;
+
+  while(pos > 0 && DEADLINE_BEFORE(deadline[deadline_heap[pos]],
+                                   deadline[deadline_heap[(pos - 1) / 2]])) {
+    deadline_heap_swap(pos, (pos - 1) / 2);
+    pos = (pos - 1) / 2;
+  }
+  for(;;) {
+    child = 2 * pos + 1;
+    if(child >= deadline_heap_len) {
+      return;
+    }
+    if(child + 1 < deadline_heap_len &&
+       DEADLINE_BEFORE(deadline[deadline_heap[child + 1]],
+                       deadline[deadline_heap[child]])) {
+      child++;
+    }
+    if(!DEADLINE_BEFORE(deadline[deadline_heap[child]],
+                        deadline[deadline_heap[pos]])) {
+      return;
+    }
+    deadline_heap_swap(pos, child);
+    pos = child;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+deadline_set(uint16_t slot, unsigned long when)
+{
+  deadline[slot] = when;
+  if(deadline_pos[slot] == NBR_INDEX_NONE) {
+    deadline_pos[slot] = deadline_heap_len;
+    deadline_heap[deadline_heap_len++] = slot;
+  }
+  deadline_heap_fix(deadline_pos[slot]);
+}
+/*---------------------------------------------------------------------------*/
+static void
+deadline_clear(uint16_t slot)
+{
+  uint16_t pos = deadline_pos[slot];
+
+  if(pos == NBR_INDEX_NONE) {
+    return;
+  }
+  deadline_pos[slot] = NBR_INDEX_NONE;
+  if(pos != --deadline_heap_len) {
+    deadline_heap[pos] = deadline_heap[deadline_heap_len];
+    deadline_pos[deadline_heap[pos]] = pos;
+    deadline_heap_fix(pos);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+stimer_deadline(const struct stimer *t)
+{
+  return t->start + t->interval;
+}
+/*---------------------------------------------------------------------------*/
+/* Computes when uip_ds6_neighbor_periodic() next has something to do for
+ * nbr, mirroring its per-state processing. Returns 0 if nothing is
+ * pending until the neighbor state changes again. */
+static int
+nbr_deadline(const uip_ds6_nbr_t *nbr, unsigned long *when)
+{
+  switch(nbr->state) {
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo
+  case NBR_REACHABLE:
+#if !UIP_CONF_ROUTER
+    if(nbr->is_register_to_state == REG_TO_BE_REGISTERED ||
+       nbr->is_register_to_state == REG_TENTATIVE ||
+       nbr->is_register_to_state == REG_REGISTERED) {
+      *when = stimer_deadline(&nbr->sendns);
+      if(DEADLINE_BEFORE(stimer_deadline(&nbr->reachable), *when)) {
+        *when = stimer_deadline(&nbr->reachable);
+      }
+      if(nbr->nscount > UIP_ND6_MAX_RTR_SOLICITATIONS) {
+        *when = clock_seconds();
+      }
+      return 1;
+    }
+#endif /* !UIP_CONF_ROUTER */
+    *when = stimer_deadline(&nbr->reachable);
+    return 1;
+#if !UIP_CONF_ROUTER
+  case NBR_STALE:
+    if(nbr->is_register_to_state == REG_TENTATIVE ||
+       nbr->is_register_to_state == REG_REGISTERED) {
+      *when = nbr->nscount > UIP_ND6_MAX_RTR_SOLICITATIONS ?
+        clock_seconds() : stimer_deadline(&nbr->sendns);
+      return 1;
+    }
+    return 0;
+#endif /* !UIP_CONF_ROUTER */
+#endif /* UIP_ND6_ENGINE_6Lo */
+
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_IPv6
+#if UIP_CONF_ND6_SEND_NA
+  case NBR_REACHABLE:
+  case NBR_DELAY:
+    *when = stimer_deadline(&nbr->reachable);
+    return 1;
+  case NBR_INCOMPLETE:
+  case NBR_PROBE:
+    *when = nbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT ?
+      clock_seconds() : stimer_deadline(&nbr->sendns);
+    return 1;
+#endif /* UIP_CONF_ND6_SEND_NA */
+#endif /* UIP_ND6_ENGINE_IPv6 */
+
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
+  case NBR_REACHABLE:
+    *when = stimer_deadline(&nbr->reachable);
+    return 1;
+#endif /* UIP_ND6_ENGINE_RPL */
+  default:
+    return 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+nbr_reschedule(const uip_ds6_nbr_t *nbr)
+{
+  unsigned long when;
+  uint16_t slot = index_from_item(ds6_neighbors, nbr);
+
+  if(nbr_deadline(nbr, &when)) {
+    deadline_set(slot, when);
+  } else {
+    deadline_clear(slot);
+  }
+}
+#endif /* UIP_DS6_NBR_DEADLINES */
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_schedule(uip_ds6_nbr_t *nbr)
+{
+#if UIP_DS6_NBR_DEADLINES
+  if(nbr == NULL) {
+    return;
+  }
+  /* Timers are often set right after this call, so only mark the neighbor
+   * as due: the next periodic pass computes its actual deadline */
+  deadline_set(index_from_item(ds6_neighbors, nbr), clock_seconds());
+  uip_ds6_periodic_wakeup();
+#endif /* UIP_DS6_NBR_DEADLINES */
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+uip_ds6_nbr_next_deadline(void)
+{
+#if UIP_DS6_NBR_DEADLINES
+  unsigned long now;
+  unsigned long when;
+
+  if(deadline_heap_len == 0) {
+    return UIP_DS6_NBR_NO_DEADLINE;
+  }
+  now = clock_seconds();
+  when = deadline[deadline_heap[0]];
+  if(!DEADLINE_BEFORE(now, when)) {
+    return 0;
+  }
+  if(when - now == 1) {
+    return UIP_DS6_PERIOD_FINE;
+  }
+  return (clock_time_t)(when - now - 1) * CLOCK_SECOND;
+#else /* UIP_DS6_NBR_DEADLINES */
+  return 0;
+#endif /* UIP_DS6_NBR_DEADLINES */
+}
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_neighbors_init(void)
 {
+#if UIP_DS6_NBR_INDEX
+  memset(nbr_index, 0xff, sizeof(nbr_index));
+#endif /* UIP_DS6_NBR_INDEX */
+#if UIP_DS6_NBR_DEADLINES
+  memset(deadline_pos, 0xff, sizeof(deadline_pos));
+  deadline_heap_len = 0;
+#endif /* UIP_DS6_NBR_DEADLINES */
   nbr_table_register(ds6_neighbors, (nbr_table_callback *)uip_ds6_nbr_rm);
 }
 /*---------------------------------------------------------------------------*/
@@ -82,12 +380,23 @@ uip_ds6_nbr_t *
 uip_ds6_nbr_add(const uip_ipaddr_t *ipaddr, const uip_lladdr_t *lladdr,
                 uint8_t isrouter, uint8_t state)
 {
-  uip_ds6_nbr_t *nbr = nbr_table_add_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
+  uip_ds6_nbr_t *nbr;
+#if UIP_DS6_NBR_INDEX
+  /* An existing entry for this lladdr is reused and its address replaced */
+  nbr = nbr_table_get_from_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
+  if(nbr != NULL) {
+    nbr_index_remove(nbr);
+  }
+#endif /* UIP_DS6_NBR_INDEX */
+  nbr = nbr_table_add_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
   if(nbr) {
     uip_ipaddr_copy(&nbr->ipaddr, ipaddr);
+#if UIP_DS6_NBR_INDEX
+    nbr_index_insert(nbr);
+#endif /* UIP_DS6_NBR_INDEX */
     nbr->isrouter = isrouter;
     nbr->state = state;
-  #if NETSTACK_CONF_WITH_IPV6_QUEUE_PKT
+  #if UIP_CONF_IPV6_QUEUE_PKT
     uip_packetqueue_new(&nbr->packethandle);
   #endif /* UIP_CONF_IPV6_QUEUE_PKT */
   stimer_set(&nbr->reachable, 0);
@@ -100,6 +409,7 @@ uip_ds6_nbr_add(const uip_ipaddr_t *ipaddr, const uip_lladdr_t *lladdr,
     stimer_set(&nbr->sendns, 0);
     nbr->nscount = 0;
   #endif
+    uip_ds6_nbr_schedule(nbr);
     PRINTF("Adding neighbor with ip addr ");
     PRINT6ADDR(ipaddr);
     PRINTF(" link addr ");
@@ -122,11 +432,17 @@ void
 uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 {
   if(nbr != NULL) {
-#if NETSTACK_CONF_WITH_IPV6_QUEUE_PKT
+#if UIP_CONF_IPV6_QUEUE_PKT
     uip_packetqueue_free(&nbr->packethandle);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
     PRINTF("RPL-ND: neighbor state change: a neighbor is removed.\n");
     NEIGHBOR_STATE_CHANGED(nbr);
+#if UIP_DS6_NBR_INDEX
+    nbr_index_remove(nbr);
+#endif /* UIP_DS6_NBR_INDEX */
+#if UIP_DS6_NBR_DEADLINES
+    deadline_clear(index_from_item(ds6_neighbors, nbr));
+#endif /* UIP_DS6_NBR_DEADLINES */
 #if UIP_ND6_ENGINE != UIP_ND6_ENGINE_IPv6
    nbr->state = NBR_GARBAGE_COLLECTABLE;
 #endif
@@ -135,6 +451,17 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
   return;
 }
 
+#if UIP_CONF_IPV6_QUEUE_PKT
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_send_queued(uip_ds6_nbr_t *nbr)
+{
+  while(uip_packetqueue_dequeue(&nbr->packethandle) > 0) {
+    tcpip_output(uip_ds6_nbr_get_ll(nbr));
+  }
+  uip_len = 0;
+}
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
 /*---------------------------------------------------------------------------*/
 const uip_ipaddr_t *
 uip_ds6_nbr_get_ipaddr(const uip_ds6_nbr_t *nbr)
@@ -167,16 +494,30 @@ uip_ds6_nbr_num(void)
 uip_ds6_nbr_t *
 uip_ds6_nbr_lookup(const uip_ipaddr_t *ipaddr)
 {
-  uip_ds6_nbr_t *nbr = nbr_table_head(ds6_neighbors);
+  uip_ds6_nbr_t *nbr = NULL;
+#if UIP_DS6_NBR_INDEX
+  uint16_t pos;
   if(ipaddr != NULL) {
-    while(nbr != NULL) {
-      if(uip_ipaddr_cmp(&nbr->ipaddr, ipaddr)) {
-        return nbr;
-      }
+    pos = nbr_index_find(ipaddr, NULL);
+    if(pos != NBR_INDEX_NONE) {
+      nbr = nbr_index_item(pos);
+    }
+  }
+#else /* UIP_DS6_NBR_INDEX */
+  if(ipaddr != NULL) {
+    nbr = nbr_table_head(ds6_neighbors);
+    while(nbr != NULL && !uip_ipaddr_cmp(&nbr->ipaddr, ipaddr)) {
       nbr = nbr_table_next(ds6_neighbors, nbr);
     }
   }
-  return NULL;
+#endif /* UIP_DS6_NBR_INDEX */
+#if UIP_DS6_NBR_STATS
+  uip_ds6_nbr_stats.lookups++;
+  if(nbr != NULL) {
+    uip_ds6_nbr_stats.hits++;
+  }
+#endif /* UIP_DS6_NBR_STATS */
+  return nbr;
 }
 /*---------------------------------------------------------------------------*/
 uip_ds6_nbr_t *
@@ -208,6 +549,10 @@ uip_ds6_link_neighbor_callback(int status, int numtx)
   if(linkaddr_cmp(dest, &linkaddr_null)) {
     return;
   }
+
+  /* Update the link statistics before RPL and ND look at them */
+  link_stats_packet_sent(dest, status, numtx);
+
   #if UIP_CONF_IPV6_RPL ==   1  
   PRINTF("RPL-ND: link neighbor callback start! \n");  
   LINK_NEIGHBOR_CALLBACK(dest, status, numtx);
@@ -229,13 +574,16 @@ uip_ds6_link_neighbor_callback(int status, int numtx)
       #endif
       nbr->state = NBR_REACHABLE;
       stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      uip_ds6_nbr_schedule(nbr);
       PRINTF("uip-ds6-neighbor : received a link layer ACK : ");
       PRINTLLADDR((uip_lladdr_t *)dest);
       PRINTF(" is reachable.\n");
     }
   }
   #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
-  if(status == MAC_TX_NOACK) {
+  /* A single missing ACK is no proof the neighbor is gone: remove it
+     only after LINK_STATS_MAX_NOACKS transmissions in a row failed */
+  if(status == MAC_TX_NOACK && link_stats_is_lost(link_stats_from_lladdr(dest))) {
     uip_ds6_nbr_t *nbr;
     nbr = uip_ds6_nbr_ll_lookup((uip_lladdr_t *)dest);
     uip_ds6_nbr_rm(nbr);
@@ -248,18 +596,60 @@ uip_ds6_link_neighbor_callback(int status, int numtx)
 
 }
 /*---------------------------------------------------------------------------*/
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH
+/* When the registration with nbr is due and the registration with another
+ * router falls due soon as well, refresh both with one NS to all-routers.
+ * Returns 1 if the NS was sent. */
+static int
+ns_refresh_batch(uip_ds6_nbr_t *nbr, uip_ipaddr_t *src)
+{
+  uip_ds6_nbr_t *other;
+  uip_ipaddr_t dest;
+  uint8_t due;
 
-void
-uip_ds6_neighbor_periodic(void)
+  due = 0;
+  for(other = nbr_table_head(ds6_neighbors); other != NULL;
+      other = nbr_table_next(ds6_neighbors, other)) {
+    if(other != nbr && other->is_register_to_state == REG_REGISTERED &&
+       (stimer_expired(&other->sendns) ||
+        stimer_remaining(&other->sendns) <= UIP_ND6_ARO_BATCH_REFRESH)) {
+      due++;
+    }
+  }
+  if(due == 0) {
+    return 0;
+  }
+
+  uip_create_linklocal_allrouters_mcast(&dest);
+  uip_ds6_select_src(src, &dest);
+  uip_nd6_ns_output(src, &dest, src);
+  PRINTF("Refreshing %u registrations with one NS\n", due + 1);
+
+  for(other = nbr_table_head(ds6_neighbors); other != NULL;
+      other = nbr_table_next(ds6_neighbors, other)) {
+    if(other == nbr || (other->is_register_to_state == REG_REGISTERED &&
+       (stimer_expired(&other->sendns) ||
+        stimer_remaining(&other->sendns) <= UIP_ND6_ARO_BATCH_REFRESH))) {
+      other->nscount++;
+      stimer_set(&other->sendns, UIP_ND6_NS_REG_TIMER);
+      if(other != nbr) {
+        uip_ds6_nbr_schedule(other);
+      }
+    }
+  }
+  return 1;
+}
+#endif /* UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH */
+/*---------------------------------------------------------------------------*/
+/* Per-neighbor part of uip_ds6_neighbor_periodic(). Returns 1 if the
+ * neighbor was removed from the cache. */
+static int
+nbr_periodic(uip_ds6_nbr_t *nbr)
 {
-  /* Periodic processing on neighbors */
- // PRINTF("Start periodic neighbor cache management ! \n");
-  uip_ds6_nbr_t *nbr = nbr_table_head(ds6_neighbors);
-  uip_ipaddr_t *src;
-  if (nbr == NULL)
-	return;
-  while(nbr != NULL) {
-    switch(nbr->state) {
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER
+  uip_ipaddr_t src;
+#endif
+  switch(nbr->state) {
 
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo
     case NBR_REACHABLE:
@@ -304,6 +694,7 @@ uip_ds6_neighbor_periodic(void)
     case NBR_INCOMPLETE:
       if(nbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
         uip_ds6_nbr_rm(nbr);
+        return 1;
       } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
         nbr->nscount++;
         PRINTF("NBR_INCOMPLETE: NS %u\n", nbr->nscount);
@@ -329,6 +720,7 @@ uip_ds6_neighbor_periodic(void)
           }
         }
         uip_ds6_nbr_rm(nbr);
+        return 1;
       } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
         nbr->nscount++;
         PRINTF("PROBE: NS %u\n", nbr->nscount);
@@ -353,38 +745,71 @@ uip_ds6_neighbor_periodic(void)
 #endif /* UIP_ND6_ENGINE_RPL */
     default:
       break;
-    }
-    nbr = nbr_table_next(ds6_neighbors, nbr);
   }
-  if (nbr == NULL)
-	return;
+  return 0;
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo  
 #if !UIP_CONF_ROUTER
-defrt_rm:
-   	uip_ds6_defrt_rm(uip_ds6_defrt_lookup(&nbr->ipaddr));
-	uip_ds6_send_rs();
-	return;
 ns_retrans:
 	if(nbr->nscount > UIP_ND6_MAX_RTR_SOLICITATIONS) {
 		nbr->is_register_to_state = 0;
 		uip_ds6_nbr_rm(nbr);
 		nbr->state = 0;
 		nbr->nscount = 0;
-		goto defrt_rm;
+		uip_ds6_defrt_rm(uip_ds6_defrt_lookup(&nbr->ipaddr));
+		uip_ds6_send_rs();
+		return 1;
 	} else {
-		if (stimer_expired(&nbr->sendns)){
-		uip_ds6_select_src(src, &nbr->ipaddr);
-		uip_nd6_ns_output(src, &nbr->ipaddr, src);		
+		if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
+#if UIP_ND6_ARO_BATCH
+		if(nbr->is_register_to_state == REG_REGISTERED &&
+		   ns_refresh_batch(nbr, &src)) {
+			return 0;
+		}
+#endif /* UIP_ND6_ARO_BATCH */
+		uip_ds6_select_src(&src, &nbr->ipaddr);
+		uip_nd6_ns_output(&src, &nbr->ipaddr, &src);
 		nbr->nscount++;
 		PRINTF("ns stimer set : %u\n", UIP_ND6_NS_REG_TIMER);
 		stimer_set(&nbr->sendns, UIP_ND6_NS_REG_TIMER);	
 		}
 	}
-	return;
+	return 0;
 #endif
 #endif	/* UIP_ND6_ENGINE_6Lo */
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_ds6_neighbor_periodic(void)
+{
+  /* Periodic processing on neighbors */
+  uip_ds6_nbr_t *nbr;
+#if UIP_DS6_NBR_DEADLINES
+  uint16_t slot;
+  uint16_t n;
+
+  /* Only visit the neighbors whose deadline passed. Stop once a packet was
+   * generated: uip_buf holds a single outgoing packet per periodic pass. */
+  for(n = 0; n < NBR_TABLE_MAX_NEIGHBORS && deadline_heap_len > 0 &&
+        uip_len == 0; n++) {
+    slot = deadline_heap[0];
+    if(DEADLINE_BEFORE(clock_seconds(), deadline[slot])) {
+      break;
+    }
+    nbr = item_from_index(ds6_neighbors, slot);
+    if(!nbr_periodic(nbr)) {
+      nbr_reschedule(nbr);
+    }
+  }
+#else /* UIP_DS6_NBR_DEADLINES */
+  uip_ds6_nbr_t *next;
+
+  for(nbr = nbr_table_head(ds6_neighbors); nbr != NULL; nbr = next) {
+    next = nbr_table_next(ds6_neighbors, nbr);
+    nbr_periodic(nbr);
+  }
+#endif /* UIP_DS6_NBR_DEADLINES */
+}
+/*---------------------------------------------------------------------------*/
 uip_ds6_nbr_t *
 uip_ds6_get_least_lifetime_neighbor(void)
 {
@@ -97,6 +97,52 @@
 
 NBR_TABLE_DECLARE(ds6_neighbors);
 
+/** \brief Maintain a hash index from IPv6 address to neighbor table slot
+ *  so that uip_ds6_nbr_lookup() does not walk the whole table */
+#ifdef UIP_DS6_NBR_CONF_INDEX
+#define UIP_DS6_NBR_INDEX UIP_DS6_NBR_CONF_INDEX
+#else
+#define UIP_DS6_NBR_INDEX 1
+#endif
+
+/** \brief Number of slots of the address index (open addressing), at
+ *  least twice the neighbor table size keeps probe sequences short */
+#ifdef UIP_DS6_NBR_CONF_INDEX_SIZE
+#define UIP_DS6_NBR_INDEX_SIZE UIP_DS6_NBR_CONF_INDEX_SIZE
+#else
+#define UIP_DS6_NBR_INDEX_SIZE (2 * NBR_TABLE_MAX_NEIGHBORS + 1)
+#endif
+
+/** \brief Keep the neighbors ordered by their next timer deadline so that
+ *  uip_ds6_neighbor_periodic() only visits those whose timers expired, and
+ *  the ds6 periodic timer can sleep until the earliest one */
+#ifdef UIP_DS6_NBR_CONF_DEADLINES
+#define UIP_DS6_NBR_DEADLINES UIP_DS6_NBR_CONF_DEADLINES
+#else
+#define UIP_DS6_NBR_DEADLINES 1
+#endif
+
+/** \brief Returned by uip_ds6_nbr_next_deadline() when no neighbor timer
+ *  is pending */
+#define UIP_DS6_NBR_NO_DEADLINE ((clock_time_t)~0)
+
+/** \brief Count neighbor cache lookups and hits in uip_ds6_nbr_stats */
+#ifdef UIP_DS6_NBR_CONF_STATS
+#define UIP_DS6_NBR_STATS UIP_DS6_NBR_CONF_STATS
+#else
+#define UIP_DS6_NBR_STATS 0
+#endif
+
+#if UIP_DS6_NBR_STATS
+/** \brief Neighbor cache lookup counters */
+struct uip_ds6_nbr_stats {
+  uint32_t lookups;  /**< Calls to uip_ds6_nbr_lookup() */
+  uint32_t hits;     /**< Lookups that found an entry */
+};
+
+extern struct uip_ds6_nbr_stats uip_ds6_nbr_stats;
+#endif /* UIP_DS6_NBR_STATS */
+
 /** \brief An entry in the nbr cache */
 typedef struct uip_ds6_nbr {
   uip_ipaddr_t ipaddr;
@@ -132,6 +178,34 @@ uip_ipaddr_t *uip_ds6_nbr_ipaddr_from_lladdr(const uip_lladdr_t *lladdr);
 const uip_lladdr_t *uip_ds6_nbr_lladdr_from_ipaddr(const uip_ipaddr_t *ipaddr);
 void uip_ds6_link_neighbor_callback(int status, int numtx);
 void uip_ds6_neighbor_periodic(void);
+
+/**
+ * \brief
+ *     Tells the neighbor cache that the state or the timers of a neighbor
+ *     changed, so that uip_ds6_neighbor_periodic() looks at it again. Must
+ *     be called whenever a neighbor enters a timed state or one of its
+ *     timers is set to expire earlier.
+ */
+void uip_ds6_nbr_schedule(uip_ds6_nbr_t *nbr);
+
+/**
+ * \brief
+ *     Time until uip_ds6_neighbor_periodic() has work to do.
+ *
+ * \return
+ *     Clock ticks until the earliest neighbor deadline, 0 if one already
+ *     expired, or UIP_DS6_NBR_NO_DEADLINE if no neighbor timer is pending.
+ */
+clock_time_t uip_ds6_nbr_next_deadline(void);
+
+#if UIP_CONF_IPV6_QUEUE_PKT
+/**
+ * \brief
+ *     Sends the packets queued for a neighbor during address resolution,
+ *     oldest first. Uses uip_buf, which is empty on return.
+ */
+void uip_ds6_nbr_send_queued(uip_ds6_nbr_t *nbr);
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
 int uip_ds6_nbr_num(void);
 
 /**
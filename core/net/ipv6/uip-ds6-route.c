@@ -75,10 +75,204 @@ LIST(notificationlist);
 
 static int num_routes = 0;
 
+/* Routes that expire, ordered by expiry time (clock_seconds()) */
+static uip_ds6_route_t *expiry_head;
+static uip_ds6_route_t *expiry_tail;
+
 #define DEBUG 0
 #include "net/ip/uip-debug.h"
 
 static void rm_routelist_callback(nbr_table_item_t *ptr);
+
+#if UIP_DS6_ROUTE_TRIE
+/* Longest-prefix-match index over the routing table: a path-compressed
+   binary trie. A node either holds a route or is a branching node
+   created where two prefixes diverge, so at most two nodes are needed
+   per route. */
+struct route_trie_node {
+  struct route_trie_node *child[2];
+  uip_ds6_route_t *route;
+  uip_ipaddr_t prefix;
+  uint8_t length;
+};
+MEMB(routetriememb, struct route_trie_node, 2 * UIP_DS6_ROUTE_NB);
+static struct route_trie_node *route_trie_root;
+
+/* Recency stamp, bumped on every successful lookup */
+static uint32_t route_use_stamp;
+
+#define ROUTE_TRIE_BIT(addr, n) (((addr)->u8[(n) >> 3] >> (7 - ((n) & 7))) & 1)
+/*---------------------------------------------------------------------------*/
+/* Number of leading bits (up to max) on which a and b agree */
+static uint8_t
+route_trie_common_bits(const uip_ipaddr_t *a, const uip_ipaddr_t *b,
+                       uint8_t max)
+{
+  uint8_t n = 0;
+  uint8_t x;
+
+  while(n < max) {
+    x = a->u8[n >> 3] ^ b->u8[n >> 3];
+    if(x == 0) {
+      n = (n & ~7) + 8;
+      continue;
+    }
+    while(!(x & 0x80)) {
+      x <<= 1;
+      n++;
+    }
+    return n < max ? n : max;
+  }
+  return max;
+}
+/*---------------------------------------------------------------------------*/
+static struct route_trie_node *
+route_trie_node_new(const uip_ipaddr_t *prefix, uint8_t length,
+                    uip_ds6_route_t *route)
+{
+  struct route_trie_node *n = memb_alloc(&routetriememb);
+  if(n != NULL) {
+    n->child[0] = n->child[1] = NULL;
+    n->route = route;
+    uip_ipaddr_copy(&n->prefix, prefix);
+    n->length = length;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static int
+route_trie_insert(uip_ds6_route_t *route)
+{
+  struct route_trie_node **link = &route_trie_root;
+  struct route_trie_node *n;
+  struct route_trie_node *leaf;
+  struct route_trie_node *branch;
+  const uip_ipaddr_t *key = &route->ipaddr;
+  uint8_t length = route->length;
+  uint8_t common;
+
+  while((n = *link) != NULL) {
+    common = route_trie_common_bits(key, &n->prefix,
+                                    length < n->length ? length : n->length);
+    if(common < n->length) {
+      /* The new prefix diverges from, or covers, this node */
+      leaf = route_trie_node_new(key, length, route);
+      if(leaf == NULL) {
+        return 0;
+      }
+      if(common == length) {
+        leaf->child[ROUTE_TRIE_BIT(&n->prefix, length)] = n;
+        *link = leaf;
+        return 1;
+      }
+      branch = route_trie_node_new(key, common, NULL);
+      if(branch == NULL) {
+        memb_free(&routetriememb, leaf);
+        return 0;
+      }
+      branch->child[ROUTE_TRIE_BIT(&n->prefix, common)] = n;
+      branch->child[ROUTE_TRIE_BIT(key, common)] = leaf;
+      *link = branch;
+      return 1;
+    }
+    if(n->length == length) {
+      n->route = route;
+      return 1;
+    }
+    link = &n->child[ROUTE_TRIE_BIT(key, n->length)];
+  }
+  *link = route_trie_node_new(key, length, route);
+  return *link != NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_trie_remove(uip_ds6_route_t *route)
+{
+  struct route_trie_node **link = &route_trie_root;
+  struct route_trie_node **parent_link = NULL;
+  struct route_trie_node *n;
+  struct route_trie_node *parent;
+  const uip_ipaddr_t *key = &route->ipaddr;
+
+  while((n = *link) != NULL && n->route != route) {
+    if(n->length >= route->length ||
+       route_trie_common_bits(key, &n->prefix, n->length) < n->length) {
+      return;
+    }
+    parent_link = link;
+    link = &n->child[ROUTE_TRIE_BIT(key, n->length)];
+  }
+  if(n == NULL) {
+    return;
+  }
+
+  n->route = NULL;
+  if(n->child[0] != NULL && n->child[1] != NULL) {
+    /* Still needed as a branching node */
+    return;
+  }
+  *link = n->child[0] != NULL ? n->child[0] : n->child[1];
+  memb_free(&routetriememb, n);
+
+  /* A route-less parent left with a single child is collapsed too */
+  if(parent_link != NULL) {
+    parent = *parent_link;
+    if(parent->route == NULL &&
+       (parent->child[0] == NULL || parent->child[1] == NULL)) {
+      *parent_link = parent->child[0] != NULL ? parent->child[0] : parent->child[1];
+      memb_free(&routetriememb, parent);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+route_trie_lookup(const uip_ipaddr_t *addr)
+{
+  struct route_trie_node *n = route_trie_root;
+  uip_ds6_route_t *found = NULL;
+
+  while(n != NULL &&
+        route_trie_common_bits(addr, &n->prefix, n->length) == n->length) {
+    if(n->route != NULL) {
+      found = n->route;
+    }
+    if(n->length == 128) {
+      break;
+    }
+    n = n->child[ROUTE_TRIE_BIT(addr, n->length)];
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+route_trie_exact(const uip_ipaddr_t *prefix, uint8_t length)
+{
+  struct route_trie_node *n = route_trie_root;
+
+  while(n != NULL && n->length <= length &&
+        route_trie_common_bits(prefix, &n->prefix, n->length) == n->length) {
+    if(n->length == length) {
+      return n->route;
+    }
+    n = n->child[ROUTE_TRIE_BIT(prefix, n->length)];
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+route_least_recently_used(void)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *oldest = uip_ds6_route_head();
+
+  for(r = oldest; r != NULL; r = uip_ds6_route_next(r)) {
+    if((int32_t)(r->last_used - oldest->last_used) < 0) {
+      oldest = r;
+    }
+  }
+  return oldest;
+}
+#endif /* UIP_DS6_ROUTE_TRIE */
 /*---------------------------------------------------------------------------*/
 #if DEBUG != DEBUG_NONE
 static void
@@ -145,11 +339,67 @@ uip_ds6_notification_rm(struct uip_ds6_notification *n)
 }
 #endif
 /*---------------------------------------------------------------------------*/
+static int
+expiry_queued(uip_ds6_route_t *route)
+{
+  return route->expiry_prev != NULL || expiry_head == route;
+}
+/*---------------------------------------------------------------------------*/
+static void
+expiry_remove(uip_ds6_route_t *route)
+{
+  if(!expiry_queued(route)) {
+    return;
+  }
+  if(route->expiry_prev == NULL) {
+    expiry_head = route->expiry_next;
+  } else {
+    route->expiry_prev->expiry_next = route->expiry_next;
+  }
+  if(route->expiry_next == NULL) {
+    expiry_tail = route->expiry_prev;
+  } else {
+    route->expiry_next->expiry_prev = route->expiry_prev;
+  }
+  route->expiry_next = route->expiry_prev = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+expiry_insert(uip_ds6_route_t *route)
+{
+  uip_ds6_route_t *r;
+
+  /* Lifetimes are mostly the same, a refreshed route goes last: look
+     for its place from the tail */
+  for(r = expiry_tail;
+      r != NULL && (long)(route->expires - r->expires) < 0;
+      r = r->expiry_prev);
+  route->expiry_prev = r;
+  if(r == NULL) {
+    route->expiry_next = expiry_head;
+    expiry_head = route;
+  } else {
+    route->expiry_next = r->expiry_next;
+    r->expiry_next = route;
+  }
+  if(route->expiry_next == NULL) {
+    expiry_tail = route;
+  } else {
+    route->expiry_next->expiry_prev = route;
+  }
+}
+/*---------------------------------------------------------------------------*/
 void
 uip_ds6_route_init(void)
 {
   memb_init(&routememb);
   list_init(routelist);
+  expiry_head = expiry_tail = NULL;
+#if UIP_DS6_ROUTE_TRIE
+  memb_init(&routetriememb);
+  route_trie_root = NULL;
+  route_use_stamp = 0;
+#endif /* UIP_DS6_ROUTE_TRIE */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 
@@ -207,15 +457,20 @@ uip_ds6_route_num_routes(void)
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_TRIE
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_TRIE */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n");
 
 
+#if UIP_DS6_ROUTE_TRIE
+  found_route = route_trie_lookup(addr);
+#else /* UIP_DS6_ROUTE_TRIE */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -227,6 +482,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       found_route = r;
     }
   }
+#endif /* UIP_DS6_ROUTE_TRIE */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -239,12 +495,17 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
   }
 
   if(found_route != NULL) {
+#if UIP_DS6_ROUTE_TRIE
+    /* Only stamp the route, the list order is left untouched */
+    found_route->last_used = ++route_use_stamp;
+#else /* UIP_DS6_ROUTE_TRIE */
     /* If we found a route, we put it at the end of the routeslist
        list. The list is ordered by how recently we looked them up:
        the least recently used route will be at the start of the
        list. */
     list_remove(routelist, found_route);
     list_add(routelist, found_route);
+#endif /* UIP_DS6_ROUTE_TRIE */
   }
 
   return found_route;
@@ -280,6 +541,14 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
     PRINTF(" found, deleting it\n");
     uip_ds6_route_rm(r);
   }
+#if UIP_DS6_ROUTE_TRIE
+  /* A route for the very same prefix may still be there if a longer
+     one matched above */
+  r = route_trie_exact(ipaddr, length);
+  if(r != NULL) {
+    uip_ds6_route_rm(r);
+  }
+#endif /* UIP_DS6_ROUTE_TRIE */
   {
     struct uip_ds6_route_neighbor_routes *routes;
     /* If there is no routing entry, create one. We first need to
@@ -291,7 +560,11 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
          least recently used route is the first route on the list. */
       uip_ds6_route_t *oldest;
 
+#if UIP_DS6_ROUTE_TRIE
+      oldest = route_least_recently_used();
+#else /* UIP_DS6_ROUTE_TRIE */
       oldest = uip_ds6_route_head();
+#endif /* UIP_DS6_ROUTE_TRIE */
       PRINTF("uip_ds6_route_add: dropping route to ");
       PRINT6ADDR(&oldest->ipaddr);
       PRINTF("\n");
@@ -359,11 +632,23 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+  r->expiry_next = r->expiry_prev = NULL;
+  r->expires = 0;
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
 #endif
 
+#if UIP_DS6_ROUTE_TRIE
+  r->last_used = ++route_use_stamp;
+  if(!route_trie_insert(r)) {
+    /* Cannot happen, the trie memb is sized for the route table */
+    PRINTF("uip_ds6_route_add: could not index route\n");
+    uip_ds6_route_rm(r);
+    return NULL;
+  }
+#endif /* UIP_DS6_ROUTE_TRIE */
+
   PRINTF("uip_ds6_route_add: adding route: ");
   PRINT6ADDR(ipaddr);
   PRINTF(" via ");
@@ -397,6 +682,10 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
 
     /* Remove the neighbor from the route list */
     list_remove(routelist, route);
+    expiry_remove(route);
+#if UIP_DS6_ROUTE_TRIE
+    route_trie_remove(route);
+#endif /* UIP_DS6_ROUTE_TRIE */
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
@@ -453,6 +742,37 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
   return;
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_set_lifetime(uip_ds6_route_t *route, unsigned long lifetime)
+{
+  expiry_remove(route);
+  route->expires = clock_seconds() + lifetime;
+  expiry_insert(route);
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+uip_ds6_route_lifetime(uip_ds6_route_t *route)
+{
+  long left;
+
+  if(!expiry_queued(route)) {
+    /* No lifetime was ever set */
+    return 0;
+  }
+  left = (long)(route->expires - clock_seconds());
+  return left > 0 ? left : 0;
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_expired(void)
+{
+  if(expiry_head != NULL &&
+     (long)(expiry_head->expires - clock_seconds()) <= 0) {
+    return expiry_head;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 static void
 rm_routelist(struct uip_ds6_route_neighbor_routes *routes)
 {
@@ -91,6 +91,15 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB UIP_CONF_MAX_ROUTES
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/** \brief Index the routing table with a path-compressed binary trie
+ *  for longest-prefix match. Lookups then no longer reorder the route
+ *  list, the least recently used route is tracked with a use stamp. */
+#ifdef UIP_DS6_ROUTE_CONF_TRIE
+#define UIP_DS6_ROUTE_TRIE UIP_DS6_ROUTE_CONF_TRIE
+#else
+#define UIP_DS6_ROUTE_TRIE 0
+#endif
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -123,6 +132,13 @@ typedef struct uip_ds6_route {
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
+#if UIP_DS6_ROUTE_TRIE
+  uint32_t last_used;
+#endif /* UIP_DS6_ROUTE_TRIE */
+  /* Routes with a lifetime are queued by expiry time, soonest first */
+  struct uip_ds6_route *expiry_next;
+  struct uip_ds6_route *expiry_prev;
+  unsigned long expires;
   uint8_t length;
 } uip_ds6_route_t;
 
@@ -166,6 +182,10 @@ int uip_ds6_route_num_routes(void);
 uip_ds6_route_t *uip_ds6_route_head(void);
 uip_ds6_route_t *uip_ds6_route_next(uip_ds6_route_t *);
 
+void uip_ds6_route_set_lifetime(uip_ds6_route_t *route, unsigned long lifetime);
+unsigned long uip_ds6_route_lifetime(uip_ds6_route_t *route);
+uip_ds6_route_t *uip_ds6_route_expired(void);
+
 /** @} */
 
 #endif /* UIP_DS6_ROUTE_H */
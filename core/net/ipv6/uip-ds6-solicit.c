@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Trickle-paced solicitations (RS, DIS)
+ */
+
+#include "net/ipv6/uip-ds6-solicit.h"
+
+#define DEBUG 0
+#include "net/ip/uip-debug.h"
+
+/*---------------------------------------------------------------------------*/
+static void
+fire(void *ptr, uint8_t tx_allow)
+{
+  struct uip_ds6_solicit *s = ptr;
+
+  if(s->done()) {
+    PRINTF("Solicit: answered after %u sent, %u suppressed\n",
+           s->sent, s->suppressed);
+    trickle_timer_stop(&s->tt);
+    return;
+  }
+  if(tx_allow) {
+    s->sent++;
+    s->send();
+  } else {
+    s->suppressed++;
+    PRINTF("Solicit: suppressed\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_solicit_start(struct uip_ds6_solicit *s, void (*send)(void),
+                      int (*done)(void))
+{
+  if(done()) {
+    return;
+  }
+  if(uip_ds6_solicit_running(s)) {
+    trickle_timer_reset_event(&s->tt);
+    return;
+  }
+  s->send = send;
+  s->done = done;
+  s->sent = 0;
+  s->suppressed = 0;
+  trickle_timer_config(&s->tt, UIP_DS6_SOLICIT_IMIN,
+                       UIP_DS6_SOLICIT_DOUBLINGS, UIP_DS6_SOLICIT_REDUNDANCY);
+  trickle_timer_set(&s->tt, fire, s);
+  /* trickle_timer_set() starts at a random interval, solicit early */
+  trickle_timer_reset_event(&s->tt);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_solicit_stop(struct uip_ds6_solicit *s)
+{
+  if(uip_ds6_solicit_running(s)) {
+    trickle_timer_stop(&s->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_solicit_heard(struct uip_ds6_solicit *s)
+{
+  if(uip_ds6_solicit_running(s)) {
+    trickle_timer_consistency(&s->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Trickle-paced solicitations (RS, DIS)
+ *
+ *    A node that has no router (or no DAG) solicits one at Trickle
+ *    intervals that double from UIP_DS6_SOLICIT_IMIN up to
+ *    UIP_DS6_SOLICIT_IMIN << UIP_DS6_SOLICIT_DOUBLINGS. A solicitation
+ *    overheard from a neighbor within the current interval suppresses our
+ *    own, since the router answers it with a multicast advertisement.
+ */
+
+#ifndef UIP_DS6_SOLICIT_H_
+#define UIP_DS6_SOLICIT_H_
+
+#include "contiki.h"
+#include "lib/trickle-timer.h"
+
+/** Pace RS and DIS with Trickle instead of fixed intervals */
+#ifdef UIP_DS6_CONF_SOLICIT_TRICKLE
+#define UIP_DS6_SOLICIT_TRICKLE UIP_DS6_CONF_SOLICIT_TRICKLE
+#else
+#define UIP_DS6_SOLICIT_TRICKLE 0
+#endif
+
+/** Smallest solicitation interval (clock ticks) */
+#ifdef UIP_DS6_CONF_SOLICIT_IMIN
+#define UIP_DS6_SOLICIT_IMIN UIP_DS6_CONF_SOLICIT_IMIN
+#else
+#define UIP_DS6_SOLICIT_IMIN (2 * CLOCK_SECOND)
+#endif
+
+/** Number of times the interval doubles (2 s << 5 = 64 s) */
+#ifdef UIP_DS6_CONF_SOLICIT_DOUBLINGS
+#define UIP_DS6_SOLICIT_DOUBLINGS UIP_DS6_CONF_SOLICIT_DOUBLINGS
+#else
+#define UIP_DS6_SOLICIT_DOUBLINGS 5
+#endif
+
+/** Solicitations overheard in an interval that suppress ours */
+#ifdef UIP_DS6_CONF_SOLICIT_REDUNDANCY
+#define UIP_DS6_SOLICIT_REDUNDANCY UIP_DS6_CONF_SOLICIT_REDUNDANCY
+#else
+#define UIP_DS6_SOLICIT_REDUNDANCY 1
+#endif
+
+/** \brief A solicitation schedule */
+struct uip_ds6_solicit {
+  struct trickle_timer tt;
+  /** Sends one solicitation */
+  void (*send)(void);
+  /** Returns non-zero once the solicitation was answered */
+  int (*done)(void);
+  uint16_t sent;       /**< Solicitations sent since the start */
+  uint16_t suppressed; /**< Solicitations suppressed since the start */
+};
+
+/**
+ * \brief Start soliciting from the smallest interval, or go back to it if
+ *        already running. Does nothing if s->done() already holds.
+ */
+void uip_ds6_solicit_start(struct uip_ds6_solicit *s, void (*send)(void),
+                           int (*done)(void));
+
+/** \brief Stop soliciting */
+void uip_ds6_solicit_stop(struct uip_ds6_solicit *s);
+
+/** \brief Record a solicitation overheard from a neighbor */
+void uip_ds6_solicit_heard(struct uip_ds6_solicit *s);
+
+/** \brief Non-zero while the schedule runs */
+#define uip_ds6_solicit_running(s) \
+  ((s)->tt.i_cur != TRICKLE_TIMER_IS_STOPPED)
+
+#endif /* UIP_DS6_SOLICIT_H_ */
+/** @} */
@@ -51,6 +51,7 @@
 #include "contiki.h"
 #include "net/ipv6/uip-ds6-route.h"
 #include "net/ipv6/uip-ds6-nbr.h"
+#include "net/ip/tcpip.h"
 #if UIP_CONF_GW == 1
 #include "net/ipv6/uip-gw-fwd.h"
 #endif
@@ -86,6 +87,9 @@ static uint16_t rand_time;                                      /** \brief rando
 #if (UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER) || (UIP_ND6_ENGINE == UIP_ND6_ENGINE_IPv6 && !UIP_CONF_ROUTER)
 struct etimer uip_ds6_timer_rs;                                 /** \brief RS timer, to schedule RS sending */
 static uint8_t rscount;                                         /** \brief number of rs already sent */
+#if UIP_DS6_SOLICIT_TRICKLE
+struct uip_ds6_solicit uip_ds6_rs_solicit;                      /** \brief RS schedule */
+#endif
 #endif /* != UIP_ND6_ENGINE_RPL */
 
 /** \name "DS6" Data structures */
@@ -167,7 +171,11 @@ uip_ds6_init(void)
 #endif
 #if (UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER) || (UIP_ND6_ENGINE == UIP_ND6_ENGINE_IPv6 && !UIP_CONF_ROUTER)
   rscount = 0;
+#if UIP_DS6_SOLICIT_TRICKLE
+  uip_ds6_send_rs();
+#else
   etimer_set(&uip_ds6_timer_rs, UIP_ND6_MAX_RTR_SOLICITATION_DELAY * CLOCK_SECOND + random_rand() % (UIP_ND6_MAX_RTR_SOLICITATION_DELAY * CLOCK_SECOND));
+#endif
 
 #endif /* UIP_ND6_ENGINE_IPv6 */
   etimer_set(&uip_ds6_timer_periodic, UIP_DS6_PERIOD);
@@ -176,6 +184,50 @@ uip_ds6_init(void)
 }
 
 
+#if UIP_DS6_PERIOD_MAX > UIP_DS6_PERIOD
+/*---------------------------------------------------------------------------*/
+/* Time until uip_ds6_periodic() has something to do, within
+ * [UIP_DS6_PERIOD, UIP_DS6_PERIOD_MAX] */
+static clock_time_t
+periodic_interval(void)
+{
+  clock_time_t interval = UIP_DS6_PERIOD_MAX;
+  clock_time_t next;
+
+  if(uip_len > 0) {
+    /* Work was cut short to send this packet */
+    return UIP_DS6_PERIOD;
+  }
+  next = uip_ds6_nbr_next_deadline();
+  if(next < interval) {
+    interval = next;
+  }
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_IPv6
+#if UIP_ND6_DEF_MAXDADNS > 0
+  for(locaddr = uip_ds6_if.addr_list;
+      locaddr < uip_ds6_if.addr_list + UIP_DS6_ADDR_NB; locaddr++) {
+    if(locaddr->isused && locaddr->state == ADDR_TENTATIVE &&
+       locaddr->dadnscount <= uip_ds6_if.maxdadns) {
+      if(timer_expired(&locaddr->dadtimer)) {
+        interval = 0;
+      } else if(timer_remaining(&locaddr->dadtimer) < interval) {
+        interval = timer_remaining(&locaddr->dadtimer);
+      }
+    }
+  }
+#endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+#if UIP_CONF_ROUTER & UIP_ND6_SEND_RA & UIP_ND6_SEND_RA_PERIODIC
+  if(stimer_expired(&uip_ds6_timer_ra)) {
+    interval = 0;
+  } else if(stimer_remaining(&uip_ds6_timer_ra) <= 1 &&
+            UIP_DS6_PERIOD_FINE < interval) {
+    interval = UIP_DS6_PERIOD_FINE;
+  }
+#endif /* UIP_CONF_ROUTER & UIP_ND6_SEND_RA */
+#endif /* UIP_ND6_ENGINE_IPv6 */
+  return interval < UIP_DS6_PERIOD ? UIP_DS6_PERIOD : interval;
+}
+#endif /* UIP_DS6_PERIOD_MAX > UIP_DS6_PERIOD */
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_periodic(void)
@@ -235,9 +287,28 @@ uip_ds6_periodic(void)
 #endif /* UIP_CONF_ROUTER & UIP_ND6_SEND_RA */
 #endif /* UIP_ND6_ENGINE_IPv6 */
 
+#if UIP_DS6_PERIOD_MAX > UIP_DS6_PERIOD
+  etimer_set(&uip_ds6_timer_periodic, periodic_interval());
+#else
   etimer_reset(&uip_ds6_timer_periodic);
+#endif
   return;
 }
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_periodic_wakeup(void)
+{
+#if UIP_DS6_PERIOD_MAX > UIP_DS6_PERIOD
+  /* An expired timer has its event pending already */
+  if(!etimer_expired(&uip_ds6_timer_periodic) &&
+     (clock_time_t)(etimer_expiration_time(&uip_ds6_timer_periodic) -
+                    clock_time()) > UIP_DS6_PERIOD) {
+    PROCESS_CONTEXT_BEGIN(&tcpip_process);
+    etimer_set(&uip_ds6_timer_periodic, UIP_DS6_PERIOD);
+    PROCESS_CONTEXT_END(&tcpip_process);
+  }
+#endif /* UIP_DS6_PERIOD_MAX > UIP_DS6_PERIOD */
+}
 
 /*---------------------------------------------------------------------------*/
 uint8_t
@@ -696,10 +767,16 @@ PRINTF("We send ra sollicited in coordination with ra periodic\n");
       stimer_set(&uip_ds6_timer_ra, rand_time);
     }
   }
+  uip_ds6_periodic_wakeup();
+#else
+#if UIP_DS6_SOLICIT_TRICKLE
+/* Hosts that heard this RS held back their own and wait for our answer */
+uip_nd6_ra_output(NULL);
 #else
 PRINTF("We send ra sollicited with a little delay\n");
 memcpy(&ra_solicited_addr, &UIP_IP_BUF->srcipaddr, 16);
 uip_nd6_ra_output(&UIP_IP_BUF->srcipaddr);
+#endif
 return;
 #endif
 #endif
@@ -741,9 +818,28 @@ uip_ds6_send_ra_periodic(void)
 
 #if (UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER) || (UIP_ND6_ENGINE == UIP_ND6_ENGINE_IPv6 && !UIP_CONF_ROUTER)
 /*---------------------------------------------------------------------------*/
+#if UIP_DS6_SOLICIT_TRICKLE
+static void
+rs_send(void)
+{
+  PRINTF("Sending RS\n");
+  uip_nd6_rs_output();
+  tcpip_ipv6_output();
+}
+/*---------------------------------------------------------------------------*/
+static int
+rs_done(void)
+{
+  return uip_ds6_defrt_choose() != NULL;
+}
+#endif /* UIP_DS6_SOLICIT_TRICKLE */
+/*---------------------------------------------------------------------------*/
 void
 uip_ds6_send_rs(void)
 {
+#if UIP_DS6_SOLICIT_TRICKLE
+  uip_ds6_solicit_start(&uip_ds6_rs_solicit, rs_send, rs_done);
+#else /* UIP_DS6_SOLICIT_TRICKLE */
   if(uip_ds6_defrt_choose() == NULL) {
 	
 	
@@ -760,6 +856,7 @@ uip_ds6_send_rs(void)
     etimer_stop(&uip_ds6_timer_rs);
 	rscount = 0;
   } 
+#endif /* UIP_DS6_SOLICIT_TRICKLE */
   /* Make sure we do not send rs more frequently than UIP_ND6_RTR_SOLICITATION_INTERVAL */
 	
   return;
@@ -767,6 +864,71 @@ uip_ds6_send_rs(void)
 #endif
 
 
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD
+/*---------------------------------------------------------------------------*/
+/* Hosts that all heard the same RA, or all registered right after a router
+ * rebooted, would otherwise re-register in the same second for as long as
+ * they live. Each delay is drawn at random so the hosts drift apart. */
+static uint8_t rereg_backoff;
+
+uint16_t
+uip_ds6_rereg_first(void)
+{
+  return 1 + random_rand() % UIP_ND6_NS_REG_TIMER;
+}
+
+uint16_t
+uip_ds6_rereg_next(uint16_t lifetime)
+{
+  uint16_t span;
+
+  rereg_backoff = 0;
+  /* Refresh in the middle third of the lifetime, which leaves the last
+   * third for NS retransmissions */
+  span = lifetime / 3;
+  if(span < UIP_ND6_NS_REG_TIMER) {
+    return UIP_ND6_NS_REG_TIMER;
+  }
+  return span + random_rand() % (span + 1);
+}
+
+uint16_t
+uip_ds6_rereg_backoff(void)
+{
+  uint16_t window;
+
+  if(rereg_backoff >= UIP_DS6_REREG_BACKOFF_MAX) {
+    rereg_backoff = 0;
+    return 0;
+  }
+  window = UIP_ND6_NS_REG_TIMER << rereg_backoff++;
+  PRINTF("Router neighbor cache full, back-off %u\n", rereg_backoff);
+  return window + random_rand() % window;
+}
+
+uint8_t
+uip_ds6_rereg_queue_depth(void)
+{
+  uip_ds6_nbr_t *nbr;
+  uint8_t depth;
+
+  depth = 0;
+  for(nbr = nbr_table_head(ds6_neighbors); nbr != NULL;
+      nbr = nbr_table_next(ds6_neighbors, nbr)) {
+    if(nbr->is_register_to_state != 0) {
+      depth++;
+    }
+  }
+  return depth;
+}
+
+uint8_t
+uip_ds6_rereg_backoff_level(void)
+{
+  return rereg_backoff;
+}
+#endif /* UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD */
+
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo || UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
 uint16_t 
 rs_rtx_time(uint16_t rtx_count) 
@@ -50,6 +50,7 @@
 #include "net/ipv6/uip-nd6.h"
 #endif
 #include "net/ipv6/uip-nd6-engines.h"
+#include "net/ipv6/uip-ds6-solicit.h"
 
 /*--------------------------------------------------*/
 /** Configuration. For all tables (Neighbor cache, Prefix List, Routing Table,
@@ -141,12 +142,47 @@
 #define UIP_DS6_PERIOD UIP_DS6_CONF_PERIOD
 #endif
 
+/** Longest the periodic task sleeps when no neighbor deadline, DAD or
+ *  outgoing packet needs it sooner. Address, prefix and default router
+ *  lifetimes are checked at least this often. Set it to UIP_DS6_PERIOD to
+ *  run the periodic task at a fixed rate. */
+#ifndef UIP_DS6_CONF_PERIOD_MAX
+#define UIP_DS6_PERIOD_MAX CLOCK_SECOND
+#else
+#define UIP_DS6_PERIOD_MAX UIP_DS6_CONF_PERIOD_MAX
+#endif
+
+/** Rate of the periodic task during the last second before a deadline
+ *  kept in a (one second resolution) stimer */
+#ifndef UIP_DS6_CONF_PERIOD_FINE
+#define UIP_DS6_PERIOD_FINE (CLOCK_SECOND / 10)
+#else
+#define UIP_DS6_PERIOD_FINE UIP_DS6_CONF_PERIOD_FINE
+#endif
+
+/** Spread 6Lo-ND re-registrations over the registration lifetime and back
+ *  off when a router reports a full neighbor cache, instead of refreshing
+ *  every UIP_ND6_NS_REG_TIMER seconds in lockstep with the other hosts */
+#ifndef UIP_DS6_CONF_REREG_SPREAD
+#define UIP_DS6_REREG_SPREAD 0
+#else
+#define UIP_DS6_REREG_SPREAD UIP_DS6_CONF_REREG_SPREAD
+#endif
+
+/** Number of times the re-registration delay doubles after a router
+ *  reported a full neighbor cache before the router is given up on */
+#ifndef UIP_DS6_CONF_REREG_BACKOFF_MAX
+#define UIP_DS6_REREG_BACKOFF_MAX 4
+#else
+#define UIP_DS6_REREG_BACKOFF_MAX UIP_DS6_CONF_REREG_BACKOFF_MAX
+#endif
+
 #define FOUND 0
 #define FREESPACE 1
 #define NOSPACE 2
 /*--------------------------------------------------*/
 
-#if NETSTACK_CONF_WITH_IPV6_QUEUE_PKT
+#if UIP_CONF_IPV6_QUEUE_PKT
 #include "net/ip/uip-packetqueue.h"
 #endif                          /*UIP_CONF_QUEUE_PKT */
 
@@ -243,6 +279,9 @@ extern uip_ds6_prefix_t uip_ds6_prefix_list[UIP_DS6_PREFIX_NB];
 //#else /* UIP_CONF_ROUTER */
 #if UIP_ND6_ENGINE != UIP_ND6_ENGINE_RPL
 extern struct etimer uip_ds6_timer_rs;
+#if UIP_DS6_SOLICIT_TRICKLE && !UIP_CONF_ROUTER
+extern struct uip_ds6_solicit uip_ds6_rs_solicit;
+#endif
 #endif
 //#endif /* UIP_CONF_ROUTER */
 
@@ -254,6 +293,10 @@ void uip_ds6_init(void);
 /** \brief Periodic processing of data structures */
 void uip_ds6_periodic(void);
 
+/** \brief Run the periodic processing within UIP_DS6_PERIOD, e.g. after a
+ *  neighbor timer was set */
+void uip_ds6_periodic_wakeup(void);
+
 /** \brief Generic loop routine on an abstract data structure, which generalizes
  * all data structures used in DS6 */
 uint8_t uip_ds6_list_loop(uip_ds6_element_t *list, uint8_t size,
@@ -353,6 +396,24 @@ void uip_ds6_send_ra_periodic(void);
 void uip_ds6_send_rs(void);
 #endif
 
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD
+/** \name 6Lo-ND re-registration scheduler */
+/** @{ */
+/** \brief Delay (seconds) before the first registration with a new router */
+uint16_t uip_ds6_rereg_first(void);
+/** \brief Delay (seconds) before refreshing a registration of the given
+ *  lifetime (seconds); resets the back-off */
+uint16_t uip_ds6_rereg_next(uint16_t lifetime);
+/** \brief Delay (seconds) before retrying after a full neighbor cache,
+ *  0 once UIP_DS6_REREG_BACKOFF_MAX is exceeded */
+uint16_t uip_ds6_rereg_backoff(void);
+/** \brief Number of registrations the scheduler is keeping up */
+uint8_t uip_ds6_rereg_queue_depth(void);
+/** \brief Current back-off exponent, 0 when no router reported being full */
+uint8_t uip_ds6_rereg_backoff_level(void);
+/** @} */
+#endif /* UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD */
+
 
 /** \brief Compute the reachable time based on base reachable time, see RFC 4861*/
 uint32_t uip_ds6_compute_reachable_time(void); /** \brief compute random reachable timer */
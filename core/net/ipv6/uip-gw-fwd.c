@@ -11,6 +11,7 @@
 #include "net/ipv6/uip-gw-fwd.h"
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/uip-nd6.h"
+#include "sys/clock.h"
 
 
 #if NETSTACK_CONF_WITH_IPV6
@@ -74,8 +75,6 @@ uint8_t if_send_to_slip;
  */
 /** \brief Bridge table */
 static gw_nbr_table_t brigde_table;
-/** \brief Bridge table entry*/
-static gw_nbr_entry_t *lookup_result;
 				
 uip_ipaddr_t routeripaddr;				
 
@@ -83,7 +82,7 @@ uip_ipaddr_t routeripaddr;
 void
 uip_gw_fwd_init() 
 {
-	memset(&brigde_table, 0, sizeof(brigde_table));	
+	gw_nbr_table_init();
 	rtobtained = 0;
 	if_send_to_slip = 0;
 //	uip_ip6addr(&routeripaddr, 0x2001, 0x1, 0x0, 0x0, 0xc801, 0x17ff, 0xfea4, 0x54);
@@ -319,24 +318,177 @@ uip_gw_append_icmp_opt(uint8_t type, void* data, uint8_t status, uint16_t lifeti
 
 
 
-gw_nbr_entry_t* gw_nbr_lookup(uip_ipaddr_t *addr) 
+/*------------------------------------------------------------------*/
+/* Hash on the interface identifier, the prefix is the same for all the
+ * nodes behind the gateway */
+static uint16_t
+gw_nbr_hash(const uip_ipaddr_t *addr)
 {
+	uint32_t h = 2166136261UL;
 	int i;
-	
-	for (i = 0; i < brigde_table.elems; i++) {
-		PRINTF("GW look up nbr: ");
-		PRINT6ADDR(addr);
- 		PRINTF("\n");
-		PRINTF("compare it with nbr_table entry: ");
-		PRINT6ADDR(&(brigde_table.table[i].addr));
- 		PRINTF("\n");
-		if (uip_ip6addr_cmp(addr,&(brigde_table.table[i].addr))) {
-			PRINTF("GW has found this nbr! \n");
-			return &(brigde_table.table[i]);
+
+	for(i = 8; i < 16; i++) {
+		h = (h ^ addr->u8[i]) * 16777619UL;
+	}
+	return (uint16_t)(h % GW_NBR_HASH_SIZE);
+}
+
+/* Returns the hash slot holding addr, or GW_NBR_INDEX_NONE */
+static gw_nbr_index_t
+gw_nbr_slot_find(const uip_ipaddr_t *addr)
+{
+	gw_nbr_index_t pos;
+	gw_nbr_index_t idx;
+
+	pos = gw_nbr_hash(addr);
+	while((idx = brigde_table.slots[pos]) != GW_NBR_INDEX_NONE) {
+		if(uip_ip6addr_cmp(addr, &brigde_table.table[idx].addr)) {
+			return pos;
+		}
+		pos = (pos + 1) % GW_NBR_HASH_SIZE;
+	}
+	return GW_NBR_INDEX_NONE;
+}
+
+/* Frees a hash slot, moving back the entries of the probe chain that
+ * follows it (no tombstones are needed) */
+static void
+gw_nbr_slot_remove(gw_nbr_index_t pos)
+{
+	gw_nbr_index_t next;
+	gw_nbr_index_t home;
+
+	brigde_table.slots[pos] = GW_NBR_INDEX_NONE;
+	next = pos;
+	for(;;) {
+		next = (next + 1) % GW_NBR_HASH_SIZE;
+		if(brigde_table.slots[next] == GW_NBR_INDEX_NONE) {
+			return;
+		}
+		home = gw_nbr_hash(&brigde_table.table[brigde_table.slots[next]].addr);
+		/* The entry stays if its home slot lies cyclically in (pos, next] */
+		if(pos <= next ? (pos < home && home <= next) : (pos < home || home <= next)) {
+			continue;
+		}
+		brigde_table.slots[pos] = brigde_table.slots[next];
+		brigde_table.slots[next] = GW_NBR_INDEX_NONE;
+		pos = next;
+	}
+}
+
+static void
+gw_nbr_slot_insert(gw_nbr_index_t idx)
+{
+	gw_nbr_index_t pos;
+
+	pos = gw_nbr_hash(&brigde_table.table[idx].addr);
+	while(brigde_table.slots[pos] != GW_NBR_INDEX_NONE) {
+		pos = (pos + 1) % GW_NBR_HASH_SIZE;
+	}
+	brigde_table.slots[pos] = idx;
+}
+
+static void
+gw_nbr_lru_unlink(gw_nbr_index_t idx)
+{
+	gw_nbr_entry_t *e = &brigde_table.table[idx];
+
+	if(e->prev != GW_NBR_INDEX_NONE) {
+		brigde_table.table[e->prev].next = e->next;
+	} else {
+		brigde_table.lru_head = e->next;
+	}
+	if(e->next != GW_NBR_INDEX_NONE) {
+		brigde_table.table[e->next].prev = e->prev;
+	} else {
+		brigde_table.lru_tail = e->prev;
+	}
+	e->prev = e->next = GW_NBR_INDEX_NONE;
+}
+
+static void
+gw_nbr_lru_push_front(gw_nbr_index_t idx)
+{
+	gw_nbr_entry_t *e = &brigde_table.table[idx];
+
+	e->prev = GW_NBR_INDEX_NONE;
+	e->next = brigde_table.lru_head;
+	if(brigde_table.lru_head != GW_NBR_INDEX_NONE) {
+		brigde_table.table[brigde_table.lru_head].prev = idx;
+	} else {
+		brigde_table.lru_tail = idx;
+	}
+	brigde_table.lru_head = idx;
+}
+
+static void
+gw_nbr_lru_push_back(gw_nbr_index_t idx)
+{
+	gw_nbr_entry_t *e = &brigde_table.table[idx];
+
+	e->next = GW_NBR_INDEX_NONE;
+	e->prev = brigde_table.lru_tail;
+	if(brigde_table.lru_tail != GW_NBR_INDEX_NONE) {
+		brigde_table.table[brigde_table.lru_tail].next = idx;
+	} else {
+		brigde_table.lru_head = idx;
+	}
+	brigde_table.lru_tail = idx;
+}
+
+/* Garbage collectable entries are kept at the tail of the LRU list so
+ * that they are evicted first */
+static void
+gw_nbr_make_collectable(gw_nbr_index_t idx)
+{
+	brigde_table.table[idx].state = GW_NBR_GARBAGE_COLLECTABLE;
+	gw_nbr_lru_unlink(idx);
+	gw_nbr_lru_push_back(idx);
+}
+/*------------------------------------------------------------------*/
+void
+gw_nbr_table_init(void)
+{
+	gw_nbr_index_t i;
+
+	memset(&brigde_table, 0, sizeof(brigde_table));
+	for(i = 0; i < GW_NBR_HASH_SIZE; i++) {
+		brigde_table.slots[i] = GW_NBR_INDEX_NONE;
+	}
+	brigde_table.lru_head = GW_NBR_INDEX_NONE;
+	brigde_table.lru_tail = GW_NBR_INDEX_NONE;
+}
+/*------------------------------------------------------------------*/
+gw_nbr_entry_t* gw_nbr_lookup(uip_ipaddr_t *addr) 
+{
+	gw_nbr_index_t pos;
+	gw_nbr_index_t idx;
+	gw_nbr_entry_t *e;
+
+	PRINTF("GW look up nbr: ");
+	PRINT6ADDR(addr);
+	PRINTF("\n");
+
+	pos = gw_nbr_slot_find(addr);
+	if(pos == GW_NBR_INDEX_NONE) {
+		PRINTF("GW fails to find this nbr!\n");
+		return NULL;
+	}
+	idx = brigde_table.slots[pos];
+	e = &brigde_table.table[idx];
+	if(e->state == GW_NBR_REACHABLE) {
+#if GW_NBR_LIFETIME
+		if(clock_seconds() - e->last_seen > GW_NBR_LIFETIME) {
+			PRINTF("GW nbr entry has expired\n");
+			gw_nbr_make_collectable(idx);
+			return e;
 		}
+#endif /* GW_NBR_LIFETIME */
+		gw_nbr_lru_unlink(idx);
+		gw_nbr_lru_push_front(idx);
 	}
-	PRINTF("GW fails to find this nbr!\n");
-	return NULL;
+	PRINTF("GW has found this nbr! \n");
+	return e;
 }
 
 
@@ -344,58 +496,60 @@ gw_nbr_entry_t* gw_nbr_lookup(uip_ipaddr_t *addr)
 void 
 gw_nbr_add(uip_ipaddr_t *addr) 
 {
-	int i;
-	int index;
-	uint8_t flags;
-	gw_nbr_entry_t* nbr_entry;
+	gw_nbr_index_t pos;
+	gw_nbr_index_t idx;
+	gw_nbr_entry_t *e;
 
-
-	nbr_entry = gw_nbr_lookup(addr);
-	if (nbr_entry != NULL) {
+	pos = gw_nbr_slot_find(addr);
+	if(pos != GW_NBR_INDEX_NONE) {
 		PRINTF("GW add new nbr: check that this one already exist: ");
 		PRINT6ADDR(addr);
  		PRINTF("\n");
 		PRINTF("change the state as REACHABLE.\n");
-		nbr_entry->state = GW_NBR_REACHABLE;
+		idx = brigde_table.slots[pos];
+		e = &brigde_table.table[idx];
+		e->state = GW_NBR_REACHABLE;
+		e->last_seen = clock_seconds();
+		gw_nbr_lru_unlink(idx);
+		gw_nbr_lru_push_front(idx);
 		return;
-			
 	}
 
-	if (brigde_table.elems != MAX_GW_NBR_ENTRIES) {
-		index = brigde_table.elems;
-		brigde_table.elems++;
+	if(brigde_table.elems < MAX_GW_NBR_ENTRIES) {
+		idx = brigde_table.elems++;
 	} else {
-		/* pick victim which is unreachable */
-		for (i = 0; i < brigde_table.elems; i++) {
-		if (brigde_table.table[i].state = GW_NBR_GARBAGE_COLLECTABLE) {
-			index = i;
-			break;
-		}
+		/* pick the least recently used victim, unreachable ones first */
+		idx = brigde_table.lru_tail;
+		PRINTF("GW evict nbr: ");
+		PRINT6ADDR(&brigde_table.table[idx].addr);
+		PRINTF("\n");
+		gw_nbr_slot_remove(gw_nbr_slot_find(&brigde_table.table[idx].addr));
+		gw_nbr_lru_unlink(idx);
 	}
-	}
-	brigde_table.table[index].state = GW_NBR_REACHABLE;
-	memcpy(&(brigde_table.table[index].addr), addr, 16);
+	e = &brigde_table.table[idx];
+	e->state = GW_NBR_REACHABLE;
+	e->last_seen = clock_seconds();
+	uip_ipaddr_copy(&e->addr, addr);
+	gw_nbr_slot_insert(idx);
+	gw_nbr_lru_push_front(idx);
 	PRINTF("GW add new nbr: ");
-	PRINT6ADDR(&(brigde_table.table[index].addr));
+	PRINT6ADDR(&e->addr);
  	PRINTF("\n");
-	
-  return;
-	
 }
 
 
 
 void gw_nbr_delete(uip_ipaddr_t *addr)
 {
-	int i;
-	for (i = 0; i < brigde_table.elems; i++) {
-		if (uip_ip6addr_cmp(addr,&(brigde_table.table[i].addr))) {
-			brigde_table.table[i].state = GW_NBR_GARBAGE_COLLECTABLE;
-			PRINTF("GW delete a nbr: ");
-			PRINT6ADDR(addr);
- 			PRINTF("\n");
-		}
-	}	
+	gw_nbr_index_t pos;
+
+	pos = gw_nbr_slot_find(addr);
+	if(pos != GW_NBR_INDEX_NONE) {
+		gw_nbr_make_collectable(brigde_table.slots[pos]);
+		PRINTF("GW delete a nbr: ");
+		PRINT6ADDR(addr);
+		PRINTF("\n");
+	}
 }
 
 
@@ -17,7 +17,30 @@
 
 
 /* Number of entries in the bridge */
+#ifdef GW_NBR_CONF_MAX_ENTRIES
+#define MAX_GW_NBR_ENTRIES	GW_NBR_CONF_MAX_ENTRIES
+#else
 #define MAX_GW_NBR_ENTRIES	30
+#endif
+
+/* Number of hash slots in the bridge, kept at least twice the number of
+ * entries so that linear probing chains stay short */
+#ifdef GW_NBR_CONF_HASH_SIZE
+#define GW_NBR_HASH_SIZE	GW_NBR_CONF_HASH_SIZE
+#else
+#define GW_NBR_HASH_SIZE	(2 * MAX_GW_NBR_ENTRIES + 1)
+#endif
+#if GW_NBR_HASH_SIZE <= MAX_GW_NBR_ENTRIES
+#error "GW_NBR_HASH_SIZE must be larger than MAX_GW_NBR_ENTRIES, or a probe for a free slot never ends"
+#endif
+
+/* Seconds after which an entry not refreshed by a DAO becomes garbage
+ * collectable, 0 disables expiry */
+#ifdef GW_NBR_CONF_LIFETIME
+#define GW_NBR_LIFETIME	GW_NBR_CONF_LIFETIME
+#else
+#define GW_NBR_LIFETIME	0
+#endif
 
 #define GW_ND6_NA_FLAG_SOLICITED       0x40
 #define GW_ND6_NA_FLAG_OVERRIDE        0x20
@@ -39,15 +62,30 @@ typedef enum {
 /* 
  * An entry in the bridge cache 
  */
+typedef uint16_t gw_nbr_index_t;
+
+#define GW_NBR_INDEX_NONE	0xffff
+
 typedef struct {
 	uip_ipaddr_t addr;
 	uint8_t state;
+	unsigned long last_seen;
+	/* LRU list, most recently used first */
+	gw_nbr_index_t prev;
+	gw_nbr_index_t next;
 } gw_nbr_entry_t;
 
-
+/* 
+ * The bridge cache: entries live in a fixed pool, an open-addressed
+ * (linear probing) hash table keyed on the interface identifier maps
+ * addresses to pool slots.
+ */
 typedef struct {
 	gw_nbr_entry_t table[MAX_GW_NBR_ENTRIES];
-	uint8_t elems;
+	gw_nbr_index_t slots[GW_NBR_HASH_SIZE];
+	gw_nbr_index_t lru_head;
+	gw_nbr_index_t lru_tail;
+	gw_nbr_index_t elems;
 } gw_nbr_table_t;
 
 #define  GW_NBR_GARBAGE_COLLECTABLE 0
@@ -93,6 +131,7 @@ extern uip_ipaddr_t routeripaddr;
 //memcpy(ds2411_id, ieee, sizeof(uip_lladdr.addr));
 //ds2411_id[7] = node_id & 0xff;
 
+void gw_nbr_table_init(void);
 gw_nbr_entry_t* gw_nbr_lookup(uip_ipaddr_t *addr);
 void gw_nbr_add(uip_ipaddr_t *addr); 
 void gw_nbr_delete(uip_ipaddr_t *addr);
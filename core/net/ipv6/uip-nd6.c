@@ -78,6 +78,8 @@
 #include "lib/random.h"
 #include "net/ipv6/uip-ds6-nbr.h"
 #include "net/ipv6/uip-ds6-route.h"
+#include "net/ip/tcpip.h"
+#include "sys/ctimer.h"
 
 /*------------------------------------------------------------------*/
 #define DEBUG 0
@@ -128,6 +130,16 @@ static uint8_t nd6_opt_offset;                     /** Offset from the end of th
 static uint8_t *nd6_opt_llao;   /**  Pointer to llao option in uip_buf */
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo
 static uip_nd6_opt_aro *nd6_opt_aro;   /**  Pointer to aro option in uip_buf */
+#if UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH
+/** Registrations waiting to be acknowledged in a batched NA */
+static struct aro_ack {
+  uip_ipaddr_t ipaddr;         /**< Registered address */
+  uip_lladdr_t eui64;
+  uint16_t lifetime;           /**< Network byte order, as received */
+} aro_acks[UIP_ND6_ARO_BATCH_MAX];
+static uint8_t aro_ack_count;
+static struct ctimer aro_ack_timer;
+#endif /* UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH */
 #endif
 
 //#if !UIP_CONF_ROUTER            // TBD see if we move it to ra_input
@@ -167,6 +179,68 @@ create_aro(uint8_t* aro, uint16_t lifetime) {
 
 /*------------------------------------------------------------------*/
 
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH
+/*------------------------------------------------------------------*/
+/* Sends one NA acknowledging all pending registrations: unicast to the
+ * host if there is only one, to all-nodes otherwise */
+static void
+aro_ack_flush(void *ptr)
+{
+  uip_ds6_addr_t *lladdr;
+  uip_ipaddr_t dest;
+  uint8_t i;
+
+  lladdr = uip_ds6_get_link_local(-1);
+  if(aro_ack_count == 0 || lladdr == NULL) {
+    aro_ack_count = 0;
+    return;
+  }
+  if(aro_ack_count == 1) {
+    uip_ipaddr_copy(&dest, &aro_acks[0].ipaddr);
+  } else {
+    uip_create_linklocal_allnodes_mcast(&dest);
+  }
+  uip_nd6_create_na(&lladdr->ipaddr, &dest,
+                    aro_ack_count == 1 ? &aro_acks[0].ipaddr : &lladdr->ipaddr,
+                    UIP_ND6_NA_FLAG_ROUTER);
+  for(i = 0; i < aro_ack_count; i++) {
+    uip_nd6_append_icmp_opt(UIP_ND6_OPT_ARO, &aro_acks[i].eui64,
+                            ARO_STATUS_SUCCESS, aro_acks[i].lifetime);
+  }
+  PRINTF("Sending NA acknowledging %u registrations\n", aro_ack_count);
+  aro_ack_count = 0;
+  uip_nd6_update_icmp_checksum();
+  UIP_STAT(++uip_stat.nd6.sent);
+  tcpip_ipv6_output();
+}
+/*------------------------------------------------------------------*/
+/* Queues the acknowledgement of the registration in the NS in uip_buf.
+ * Returns 0 if the batch is full and the NS must be answered directly. */
+static int
+aro_ack_add(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < aro_ack_count; i++) {
+    if(memcmp(&aro_acks[i].eui64, &nd6_opt_aro->eui64, UIP_LLADDR_LEN) == 0) {
+      break;
+    }
+  }
+  if(i == UIP_ND6_ARO_BATCH_MAX) {
+    return 0;
+  }
+  uip_ipaddr_copy(&aro_acks[i].ipaddr, &UIP_IP_BUF->srcipaddr);
+  memcpy(&aro_acks[i].eui64, &nd6_opt_aro->eui64, UIP_LLADDR_LEN);
+  aro_acks[i].lifetime = nd6_opt_aro->lifetime;
+  if(i == aro_ack_count) {
+    if(aro_ack_count++ == 0) {
+      ctimer_set(&aro_ack_timer, UIP_ND6_ARO_BATCH_WINDOW, aro_ack_flush, NULL);
+    }
+  }
+  return 1;
+}
+#endif /* UIP_ND6_ENGINE_6Lo && UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH */
+/*------------------------------------------------------------------*/
 #if UIP_ND6_SEND_NA
 
 static void
@@ -342,6 +416,15 @@ ns_input(void)
 
 	/* Check if the NCE exists */
 	nbr = uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr);
+#if UIP_ND6_ARO_BATCH
+	if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) &&
+	   (!UIP_CONF_ROUTER || nbr == NULL ||
+	    nbr->is_registered_with_state != REG_REGISTERED)) {
+		/* An NS to all-routers only refreshes existing registrations.
+		 * Hosts accept any multicast, leave it to the routers. */
+		goto discard;
+	}
+#endif /* UIP_ND6_ARO_BATCH */
     if(nbr == NULL) {
     	/* The NCE does not exist. Try to create it in TENTATIVE state. */
 		reg_neighbor = uip_ds6_nbr_add(&UIP_IP_BUF->srcipaddr, (uip_lladdr_t *)&(nd6_opt_aro->eui64), 1, NBR_REACHABLE);
@@ -356,6 +439,7 @@ ns_input(void)
 		reg_neighbor->state = NBR_REACHABLE;
 		stimer_set(&reg_neighbor->sendns, UIP_ND6_NS_REG_TIMER);
 		reg_neighbor->is_registered_with_state = REG_REGISTERED;	
+		uip_ds6_nbr_schedule(reg_neighbor);
 		goto create_na;
 		}
     } else { /* nbr != NULL */
@@ -386,10 +470,12 @@ ns_input(void)
        		 * We set the timer now just in order to save the lifetime. However, we'll have 
 	 	 * to restart it just before responding the NA in response 
 	 	 */
+				reg_neighbor = nbr;
 				stimer_set(&(reg_neighbor->reachable), uip_ntohs(nd6_opt_aro->lifetime)/1000);        
 				reg_neighbor->state = NBR_REACHABLE;
 		                stimer_set(&reg_neighbor->sendns, UIP_ND6_NS_REG_TIMER);
 				reg_neighbor->is_registered_with_state = REG_REGISTERED;	
+				uip_ds6_nbr_schedule(reg_neighbor);
 				//nbr->aro_pending = 0;
 				goto create_na;
 			} else {
@@ -421,7 +507,19 @@ create_na:
   uip_nd6_append_icmp_opt(UIP_ND6_OPT_TLLAO, uip_lladdr.addr, 0, 0);
 #endif
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo
-	uip_nd6_create_na(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr, NULL, UIP_ND6_NA_FLAG_ROUTER);
+#if UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH
+	if(aro_ack_add()) {
+		uip_len = 0;
+		return;
+	}
+#endif /* UIP_CONF_ROUTER && UIP_ND6_ARO_BATCH */
+#if UIP_ND6_ARO_BATCH
+	if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+		/* Answer a refresh sent to all-routers from our link-local address */
+		uip_ds6_select_src(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
+	}
+#endif /* UIP_ND6_ARO_BATCH */
+	uip_nd6_create_na(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr, UIP_ND6_NA_FLAG_ROUTER);
 	/* include ARO option */
 	uip_nd6_append_icmp_opt(UIP_ND6_OPT_ARO, &nd6_opt_aro->eui64, ARO_STATUS_SUCCESS, nd6_opt_aro->lifetime);
 	/* Compute checksum */
@@ -555,6 +653,9 @@ na_input(void)
   uint8_t is_router;
   uint8_t is_solicited;
   uint8_t is_override;
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo && !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD
+  uint16_t backoff;
+#endif
 
   PRINTF("Received NA from");
   PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
@@ -589,6 +690,9 @@ na_input(void)
   /* Options processing: we handle TLLAO, and must ignore others */
   nd6_opt_offset = UIP_ND6_NA_LEN;
   nd6_opt_llao = NULL;
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo
+  nd6_opt_aro = NULL;
+#endif /* UIP_ND6_ENGINE_6Lo */
   while(uip_l3_icmp_hdr_len + nd6_opt_offset < uip_len) {
 #if UIP_CONF_IPV6_CHECKS
     if(UIP_ND6_OPT_HDR_BUF->len == 0) {
@@ -602,17 +706,15 @@ na_input(void)
       break;
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo
     case UIP_ND6_OPT_ARO:
-      nd6_opt_aro = (uip_nd6_opt_aro *)UIP_ND6_OPT_HDR_BUF;
 	PRINTF(" NA input with ARO address");
-  	PRINT6UIPLLADDR(nd6_opt_aro->eui64);
+  	PRINT6UIPLLADDR(((uip_nd6_opt_aro *)UIP_ND6_OPT_HDR_BUF)->eui64);
  	PRINTF("\n");
-#if UIP_CONF_IPV6_CHECKS
-      if((nd6_opt_aro->len != 2) ||
-          (memcmp(nd6_opt_aro->eui64.addr, uip_lladdr.addr, UIP_LLADDR_LEN) != 0)) {
-        /* ignore this option */
-        nd6_opt_aro = NULL;
+      /* A batched NA carries the AROs of several hosts, keep ours */
+      if((UIP_ND6_OPT_HDR_BUF->len == 2) &&
+          (memcmp(((uip_nd6_opt_aro *)UIP_ND6_OPT_HDR_BUF)->eui64.addr,
+                  uip_lladdr.addr, UIP_LLADDR_LEN) == 0)) {
+        nd6_opt_aro = (uip_nd6_opt_aro *)UIP_ND6_OPT_HDR_BUF;
       }
-#endif /* UIP_CONF_IPV6_CHECKS */
       break;
 #endif /* UIP_ND6_ENGINE_6Lo */
     default:
@@ -624,7 +726,7 @@ na_input(void)
   addr = uip_ds6_addr_lookup(&UIP_ND6_NA_BUF->tgtipaddr);
   #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_6Lo 
    nbr = uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr);
-	if(nd6_opt_aro != NULL && nbr->state != NBR_GARBAGE_COLLECTABLE) {
+	if(nd6_opt_aro != NULL && nbr != NULL && nbr->state != NBR_GARBAGE_COLLECTABLE) {
           if ((nd6_opt_aro->lifetime == 0) && (nbr->is_register_to_state == REG_TO_BE_UNREGISTERED)) {
             /* If the lifetime is 0, this means that the unregistration was successful;
              * we can delete the registration entry safely */
@@ -642,7 +744,13 @@ na_input(void)
 		PRINTF("Set nbr's state as REG_REGISTERED\n");
                 nbr->nscount = 0;
                 stimer_set(&nbr->reachable, uip_ntohs(nd6_opt_aro->lifetime) /1000);
+#if !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD
+		stimer_set(&nbr->sendns,
+		           uip_ds6_rereg_next(uip_ntohs(nd6_opt_aro->lifetime) / 1000));
+#else
 		stimer_set(&nbr->sendns, UIP_ND6_NS_REG_TIMER);
+#endif
+		uip_ds6_nbr_schedule(nbr);
 		defrt = uip_ds6_defrt_lookup(&UIP_IP_BUF->srcipaddr);
     		if(defrt != NULL)
     			  stimer_reset(&(defrt->lifetime));          
@@ -653,6 +761,17 @@ na_input(void)
               /* Clear registration_in_progress so that other registrations can occur */
               break;
             case ARO_STATUS_RTR_NC_FULL:
+#if !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD
+              /* Retry later, the router may have room by then */
+              backoff = uip_ds6_rereg_backoff();
+              if(backoff > 0) {
+                nbr->is_register_to_state = REG_TENTATIVE;
+                nbr->nscount = 0;
+                stimer_set(&nbr->sendns, backoff);
+                uip_ds6_nbr_schedule(nbr);
+                break;
+              }
+#endif /* !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD */
                /* Remove entry. uip_periodic will try with other def. router
                 * if possible */
 			uip_ds6_nbr_rm(nbr); 
@@ -706,6 +825,7 @@ na_input(void)
 
         /* reachable time is stored in ms */
         stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
+        uip_ds6_nbr_schedule(nbr);
 
       } else {
 	PRINTF("This is not a solicitated NA!\n");
@@ -732,6 +852,7 @@ na_input(void)
             nbr->state = NBR_REACHABLE;
             /* reachable time is stored in ms */
             stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
+            uip_ds6_nbr_schedule(nbr);
           } else {
             if(nd6_opt_llao != 0 && is_llchange) {
               nbr->state = NBR_STALE;
@@ -750,20 +871,11 @@ na_input(void)
   }
 #endif
 #if UIP_CONF_IPV6_QUEUE_PKT
-  /* The nbr is now reachable, check if we had buffered a pkt for it */
-  /*if(nbr->queue_buf_len != 0) {
-    uip_len = nbr->queue_buf_len;
-    memcpy(UIP_IP_BUF, nbr->queue_buf, uip_len);
-    nbr->queue_buf_len = 0;
-    return;
-    }*/
-  if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-    uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-    memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
-    return;
+  /* The nbr is now reachable, send the pkts we buffered for it */
+  if(nbr != NULL && uip_packetqueue_len(&nbr->packethandle) != 0) {
+    uip_ds6_nbr_send_queued(nbr);
   }
-  
+
 #endif /*UIP_CONF_IPV6_QUEUE_PKT */
 
 discard:
@@ -1091,6 +1203,7 @@ ra_input(void)
         if(nbr->state == NBR_INCOMPLETE) {
           nbr->state = NBR_REACHABLE;
           stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
+          uip_ds6_nbr_schedule(nbr);
         }
         if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
 		  lladdr, UIP_LLADDR_LEN) != 0) {
@@ -1105,7 +1218,11 @@ ra_input(void)
 	if(nbr == NULL) {
         nbr = uip_ds6_nbr_add(&UIP_IP_BUF->srcipaddr,(uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET], 1, NBR_REACHABLE);
 		stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time/1000); 
+#if !UIP_CONF_ROUTER && UIP_DS6_REREG_SPREAD
+		stimer_set(&nbr->sendns, uip_ds6_rereg_first());
+#else
 		stimer_set(&nbr->sendns, UIP_ND6_NS_REG_TIMER);
+#endif
 		PRINTF("Set nbr's state as REG_TO_BE_REGISTERED\n");
 		nbr->is_register_to_state = REG_TO_BE_REGISTERED;
 		nbr->nscount = 0;
@@ -1114,12 +1231,14 @@ ra_input(void)
         if(nbr->state == NBR_STALE) {
           nbr->state = NBR_REACHABLE;
            stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
+           uip_ds6_nbr_schedule(nbr);
         }
         if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
 		  lladdr, UIP_LLADDR_LEN) != 0) {
           memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET], UIP_LLADDR_LEN);
           nbr->state = NBR_REACHABLE;
            stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
+           uip_ds6_nbr_schedule(nbr);
         }
         nbr->isrouter = 1;
       }
@@ -1272,18 +1391,9 @@ ra_input(void)
 
 #if UIP_CONF_IPV6_QUEUE_PKT
   /* If the nbr just became reachable (e.g. it was in NBR_INCOMPLETE state
-   * and we got a SLLAO), check if we had buffered a pkt for it */
-  /*  if((nbr != NULL) && (nbr->queue_buf_len != 0)) {
-    uip_len = nbr->queue_buf_len;
-    memcpy(UIP_IP_BUF, nbr->queue_buf, uip_len);
-    nbr->queue_buf_len = 0;
-    return;
-    }*/
-  if(nbr != NULL && uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-    uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-    memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
-    return;
+   * and we got a SLLAO), send the pkts we buffered for it */
+  if(nbr != NULL && uip_packetqueue_len(&nbr->packethandle) != 0) {
+    uip_ds6_nbr_send_queued(nbr);
   }
 
 #endif /*UIP_CONF_IPV6_QUEUE_PKT */
@@ -1376,7 +1486,7 @@ uip_nd6_update_icmp_checksum(){
 void
 uip_nd6_registration_error(uint8_t status) {
 	PRINTF("This is an error na with status number %u!\n",status);
-	uip_nd6_create_na(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr, NULL, UIP_ND6_NA_FLAG_ROUTER);
+	uip_nd6_create_na(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr, UIP_ND6_NA_FLAG_ROUTER);
 	
 	/* include TLLAO option */
 	uip_nd6_append_icmp_opt(UIP_ND6_OPT_TLLAO, (uip_lladdr_t *)&(nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET]), 0, 0);
@@ -1406,6 +1516,18 @@ UIP_ICMP6_HANDLER(rs_input_handler, ICMP6_RS, UIP_ICMP6_HANDLER_CODE_ANY,
 #endif
 
 
+#if UIP_ND6_ENGINE != UIP_ND6_ENGINE_RPL && !UIP_CONF_ROUTER && UIP_DS6_SOLICIT_TRICKLE
+/* Hosts receive the RS of their neighbors, which hold back their own */
+static void
+rs_overheard(void)
+{
+  uip_ds6_solicit_heard(&uip_ds6_rs_solicit);
+  uip_len = 0;
+}
+UIP_ICMP6_HANDLER(rs_overheard_handler, ICMP6_RS, UIP_ICMP6_HANDLER_CODE_ANY,
+                  rs_overheard);
+#endif
+
 UIP_ICMP6_HANDLER(ra_input_handler, ICMP6_RA, UIP_ICMP6_HANDLER_CODE_ANY,
                   ra_input);
 
@@ -1431,6 +1553,9 @@ uip_nd6_init()
   /* Only accept RS if we are a router and happy to send out RAs */
   uip_icmp6_register_input_handler(&rs_input_handler);
 #endif
+#if UIP_ND6_ENGINE != UIP_ND6_ENGINE_RPL && !UIP_CONF_ROUTER && UIP_DS6_SOLICIT_TRICKLE
+  uip_icmp6_register_input_handler(&rs_overheard_handler);
+#endif
 
   uip_icmp6_register_input_handler(&ra_input_handler);
 }
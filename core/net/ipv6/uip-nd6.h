@@ -145,6 +145,42 @@
 #define ARO_STATUS_SUCCESS				0
 #define ARO_STATUS_DUPLICATE			1
 #define ARO_STATUS_RTR_NC_FULL			2
+
+/**
+ * \brief Batch address registrations. A router collects the successful
+ * registrations it receives within UIP_ND6_ARO_BATCH_WINDOW and answers
+ * them with one NA carrying one ARO per host (to all-nodes when there is
+ * more than one). A host refreshes its registrations with all routers
+ * falling due within UIP_ND6_ARO_BATCH_REFRESH seconds with a single NS to
+ * all-routers. Hosts find their ARO in a batched NA by EUI-64.
+ */
+#ifdef UIP_ND6_CONF_ARO_BATCH
+#define UIP_ND6_ARO_BATCH UIP_ND6_CONF_ARO_BATCH
+#else
+#define UIP_ND6_ARO_BATCH 0
+#endif
+
+/** \brief Maximum number of AROs in a batched NA */
+#ifdef UIP_ND6_CONF_ARO_BATCH_MAX
+#define UIP_ND6_ARO_BATCH_MAX UIP_ND6_CONF_ARO_BATCH_MAX
+#else
+#define UIP_ND6_ARO_BATCH_MAX 4
+#endif
+
+/** \brief How long a router holds a registration NA for batching */
+#ifdef UIP_ND6_CONF_ARO_BATCH_WINDOW
+#define UIP_ND6_ARO_BATCH_WINDOW UIP_ND6_CONF_ARO_BATCH_WINDOW
+#else
+#define UIP_ND6_ARO_BATCH_WINDOW (CLOCK_SECOND / 8)
+#endif
+
+/** \brief How early (seconds) a host refreshes a registration to share
+ *  an NS with another router's refresh */
+#ifdef UIP_ND6_CONF_ARO_BATCH_REFRESH
+#define UIP_ND6_ARO_BATCH_REFRESH UIP_ND6_CONF_ARO_BATCH_REFRESH
+#else
+#define UIP_ND6_ARO_BATCH_REFRESH 2
+#endif
 #endif /* UIP_ND6_ENGINE_6Lo */
 /** @} */
 
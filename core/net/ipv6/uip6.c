@@ -173,6 +173,8 @@ uint8_t uip_ext_opt_offset = 0;
 #ifndef UIP_CONF_EXTERNAL_BUFFER
 uip_buf_t uip_aligned_buf;
 #endif /* UIP_CONF_EXTERNAL_BUFFER */
+/** The buffer uip_buf currently is, see uip-bufpool */
+uip_buf_t *uip_bufp = &uip_aligned_buf;
 
 /* The uip_appdata pointer points to application data. */
 void *uip_appdata;
@@ -1365,6 +1367,23 @@ if((incoming_if == IEEE_802_3)&& (UIP_ICMP_BUF->type == ICMP6_NS)){
 
         PRINTF("Processing Routing header\n");
         if(UIP_ROUTING_BUF->seg_left > 0) {
+#if UIP_CONF_IPV6_RPL && UIP_CONF_ROUTER
+          /* An RPL source route: forward to the next address */
+          if(rpl_process_srh_header()) {
+            if(UIP_IP_BUF->ttl <= 1) {
+              uip_icmp6_error_output(ICMP6_TIME_EXCEEDED,
+                                     ICMP6_TIME_EXCEED_TRANSIT, 0);
+              UIP_STAT(++uip_stat.ip.drop);
+              goto send;
+            }
+            UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+            PRINTF("Forwarding source routed packet to ");
+            PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+            PRINTF("\n");
+            UIP_STAT(++uip_stat.ip.forwarded);
+            goto send;
+          }
+#endif /* UIP_CONF_IPV6_RPL && UIP_CONF_ROUTER */
           uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
           UIP_STAT(++uip_stat.ip.drop);
           UIP_LOG("ip6: unrecognized routing type");
@@ -1558,6 +1577,9 @@ if(uip_len > 0) {
   if(uip_slen == 0) {
     goto drop;
   }
+  /* The UDP header sits right after the IPv6 header; extension headers
+     left over from the previous packet must not shift it */
+  uip_ext_len = 0;
   uip_len = uip_slen + UIP_IPUDPH_LEN;
 
   /* For IPv6, the IP length field does not include the IPv6 IP header
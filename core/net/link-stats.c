@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Link quality estimation. Until enough transmissions to a
+ *         neighbor have been made, its ETX is guessed from the signal of
+ *         the frames received from it; the transmissions then take over
+ *         through a moving average. The statistics of a neighbor go stale
+ *         when it is not transmitted to.
+ */
+
+#include "contiki.h"
+#include "net/link-stats.h"
+#include "net/mac/mac.h"
+#include "net/nbr-table.h"
+#include "net/packetbuf.h"
+#include "sys/ctimer.h"
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else /* DEBUG */
+#define PRINTF(...)
+#endif /* DEBUG */
+
+/* The weight, in percent, of a new sample in the moving averages. The
+   first transmissions to a neighbor weigh more, to move away from the
+   guess quickly. */
+#define EWMA_SCALE            100
+#define EWMA_ALPHA            10
+#define EWMA_BOOTSTRAP_ALPHA  30
+
+/* The ETX of a transmission that got no ACK */
+#define ETX_NOACK_PENALTY     10
+
+/* The RSSI above which no frame is expected to be lost, and below
+   which none is expected to get through */
+#ifdef LINK_STATS_CONF_RSSI_HIGH
+#define RSSI_HIGH LINK_STATS_CONF_RSSI_HIGH
+#else /* LINK_STATS_CONF_RSSI_HIGH */
+#define RSSI_HIGH -60
+#endif /* LINK_STATS_CONF_RSSI_HIGH */
+#ifdef LINK_STATS_CONF_RSSI_LOW
+#define RSSI_LOW LINK_STATS_CONF_RSSI_LOW
+#else /* LINK_STATS_CONF_RSSI_LOW */
+#define RSSI_LOW -90
+#endif /* LINK_STATS_CONF_RSSI_LOW */
+
+/* The same for the LQI, which is only used when the radio reports no
+   RSSI. Its scale depends on the radio: it is not used unless both
+   thresholds are configured. */
+#if defined(LINK_STATS_CONF_LQI_HIGH) && defined(LINK_STATS_CONF_LQI_LOW)
+#define LQI_HIGH LINK_STATS_CONF_LQI_HIGH
+#define LQI_LOW  LINK_STATS_CONF_LQI_LOW
+#endif
+
+/* The statistics are fresh if they are based on this many recent
+   transmissions, the last of them not older than the expiration time */
+#define FRESHNESS_TARGET           4
+#define FRESHNESS_MAX              16
+#define FRESHNESS_EXPIRATION_TIME  (10 * 60 * (clock_time_t)CLOCK_SECOND)
+/* The freshness is halved this often */
+#define FRESHNESS_HALF_LIFE        (20 * 60 * (clock_time_t)CLOCK_SECOND)
+
+NBR_TABLE(struct link_stats, link_stats);
+
+static struct ctimer periodic_timer;
+/*---------------------------------------------------------------------------*/
+const struct link_stats *
+link_stats_from_lladdr(const linkaddr_t *lladdr)
+{
+  return nbr_table_get_from_lladdr(link_stats, lladdr);
+}
+/*---------------------------------------------------------------------------*/
+int
+link_stats_is_fresh(const struct link_stats *stats)
+{
+  return stats != NULL &&
+    clock_time() - stats->last_tx_time < FRESHNESS_EXPIRATION_TIME &&
+    stats->freshness >= FRESHNESS_TARGET;
+}
+/*---------------------------------------------------------------------------*/
+int
+link_stats_is_lost(const struct link_stats *stats)
+{
+  return stats != NULL && stats->noacks >= LINK_STATS_MAX_NOACKS;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+etx_from_prr(uint32_t prr)
+{
+  /* The reception ratio prr is scaled by LINK_STATS_ETX_DIVISOR */
+  if(prr * ETX_NOACK_PENALTY <= LINK_STATS_ETX_DIVISOR) {
+    return ETX_NOACK_PENALTY * LINK_STATS_ETX_DIVISOR;
+  }
+  return (uint32_t)LINK_STATS_ETX_DIVISOR * LINK_STATS_ETX_DIVISOR / prr;
+}
+/*---------------------------------------------------------------------------*/
+/* Guesses the ETX from the signal of the frames received: the
+   reception ratio is taken to grow linearly between the thresholds */
+static uint16_t
+guess_etx(const struct link_stats *stats)
+{
+  if(stats->rssi != 0) {
+    if(stats->rssi >= RSSI_HIGH) {
+      return LINK_STATS_ETX_DIVISOR;
+    }
+    if(stats->rssi <= RSSI_LOW) {
+      return ETX_NOACK_PENALTY * LINK_STATS_ETX_DIVISOR;
+    }
+    return etx_from_prr((uint32_t)(stats->rssi - RSSI_LOW) *
+                        LINK_STATS_ETX_DIVISOR / (RSSI_HIGH - RSSI_LOW));
+  }
+#ifdef LQI_HIGH
+  if(stats->lqi != 0) {
+    if(stats->lqi >= LQI_HIGH) {
+      return LINK_STATS_ETX_DIVISOR;
+    }
+    if(stats->lqi <= LQI_LOW) {
+      return ETX_NOACK_PENALTY * LINK_STATS_ETX_DIVISOR;
+    }
+    return etx_from_prr((uint32_t)(stats->lqi - LQI_LOW) *
+                        LINK_STATS_ETX_DIVISOR / (LQI_HIGH - LQI_LOW));
+  }
+#endif /* LQI_HIGH */
+  return LINK_STATS_INIT_ETX * LINK_STATS_ETX_DIVISOR;
+}
+/*---------------------------------------------------------------------------*/
+void
+link_stats_packet_sent(const linkaddr_t *lladdr, int status, int numtx)
+{
+  struct link_stats *stats;
+  uint16_t packet_etx;
+  uint8_t alpha;
+
+  /* Collisions and transmission errors tell nothing about the link */
+  if(status != MAC_TX_OK && status != MAC_TX_NOACK) {
+    return;
+  }
+  if(linkaddr_cmp(lladdr, &linkaddr_null)) {
+    return;
+  }
+
+  stats = nbr_table_get_from_lladdr(link_stats, lladdr);
+  if(stats == NULL) {
+    stats = nbr_table_add_lladdr(link_stats, lladdr);
+    if(stats == NULL) {
+      return;
+    }
+    stats->etx = guess_etx(stats);
+  }
+
+  if(status == MAC_TX_NOACK) {
+    packet_etx = ETX_NOACK_PENALTY * LINK_STATS_ETX_DIVISOR;
+    if(stats->noacks < 0xff) {
+      stats->noacks++;
+    }
+  } else {
+    packet_etx = numtx * LINK_STATS_ETX_DIVISOR;
+    stats->noacks = 0;
+  }
+
+  alpha = link_stats_is_fresh(stats) ? EWMA_ALPHA : EWMA_BOOTSTRAP_ALPHA;
+  stats->etx = ((uint32_t)stats->etx * (EWMA_SCALE - alpha) +
+                (uint32_t)packet_etx * alpha) / EWMA_SCALE;
+
+  stats->last_tx_time = clock_time();
+  stats->freshness += numtx;
+  if(stats->freshness > FRESHNESS_MAX) {
+    stats->freshness = FRESHNESS_MAX;
+  }
+
+  PRINTF("link-stats: status %d numtx %d etx %u noacks %u\n", status, numtx,
+         (unsigned)stats->etx, (unsigned)stats->noacks);
+}
+/*---------------------------------------------------------------------------*/
+void
+link_stats_input_callback(const linkaddr_t *lladdr)
+{
+  struct link_stats *stats;
+  int16_t rssi;
+  uint8_t lqi;
+
+  rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  lqi = packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY);
+
+  stats = nbr_table_get_from_lladdr(link_stats, lladdr);
+  if(stats == NULL) {
+    /* Only the neighbors another table has an entry for get one here:
+       frames overheard from strangers must not push them out */
+    if(!nbr_table_has_lladdr(lladdr)) {
+      return;
+    }
+    stats = nbr_table_add_lladdr(link_stats, lladdr);
+    if(stats == NULL) {
+      return;
+    }
+    stats->rssi = rssi;
+    stats->lqi = lqi;
+    stats->etx = guess_etx(stats);
+    return;
+  }
+
+  if(rssi != 0) {
+    stats->rssi = stats->rssi == 0 ? rssi :
+      ((int32_t)stats->rssi * (EWMA_SCALE - EWMA_BOOTSTRAP_ALPHA) +
+       (int32_t)rssi * EWMA_BOOTSTRAP_ALPHA) / EWMA_SCALE;
+  }
+  if(lqi != 0) {
+    stats->lqi = stats->lqi == 0 ? lqi :
+      ((uint16_t)stats->lqi * (EWMA_SCALE - EWMA_BOOTSTRAP_ALPHA) +
+       (uint16_t)lqi * EWMA_BOOTSTRAP_ALPHA) / EWMA_SCALE;
+  }
+  if(stats->freshness == 0) {
+    /* Nothing was sent to the neighbor lately: the signal is all
+       there is to go by */
+    stats->etx = guess_etx(stats);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic(void *ptr)
+{
+  struct link_stats *stats;
+
+  for(stats = nbr_table_head(link_stats); stats != NULL;
+      stats = nbr_table_next(link_stats, stats)) {
+    stats->freshness >>= 1;
+  }
+  ctimer_reset(&periodic_timer);
+}
+/*---------------------------------------------------------------------------*/
+void
+link_stats_init(void)
+{
+  nbr_table_register(link_stats, NULL);
+  ctimer_set(&periodic_timer, FRESHNESS_HALF_LIFE, periodic, NULL);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         The quality of the links to the neighbors, estimated from the
+ *         outcome of the transmissions (ETX) and from the signal of the
+ *         frames received (RSSI, LQI). Shared by RPL and neighbor
+ *         discovery.
+ */
+
+#ifndef LINK_STATS_H_
+#define LINK_STATS_H_
+
+#include "net/linkaddr.h"
+#include "sys/clock.h"
+
+/* The ETX is a fixed-point number with this divisor */
+#define LINK_STATS_ETX_DIVISOR 128
+
+/* The ETX of a neighbor nothing is known about yet */
+#ifdef LINK_STATS_CONF_INIT_ETX
+#define LINK_STATS_INIT_ETX LINK_STATS_CONF_INIT_ETX
+#else /* LINK_STATS_CONF_INIT_ETX */
+#define LINK_STATS_INIT_ETX 2
+#endif /* LINK_STATS_CONF_INIT_ETX */
+
+/* The number of transmissions in a row without an ACK after which the
+   neighbor is considered lost. Each of them already includes the MAC
+   retransmissions. */
+#ifdef LINK_STATS_CONF_MAX_NOACKS
+#define LINK_STATS_MAX_NOACKS LINK_STATS_CONF_MAX_NOACKS
+#else /* LINK_STATS_CONF_MAX_NOACKS */
+#define LINK_STATS_MAX_NOACKS 3
+#endif /* LINK_STATS_CONF_MAX_NOACKS */
+
+struct link_stats {
+  /* The time of the last transmission to the neighbor */
+  clock_time_t last_tx_time;
+  /* The expected number of transmissions, see LINK_STATS_ETX_DIVISOR */
+  uint16_t etx;
+  /* The average RSSI of the frames received, 0 if none was */
+  int16_t rssi;
+  /* The average LQI of the frames received, 0 if none was */
+  uint8_t lqi;
+  /* The number of recent transmissions the ETX is based on */
+  uint8_t freshness;
+  /* The number of transmissions in a row that were not acknowledged */
+  uint8_t noacks;
+};
+
+void link_stats_init(void);
+const struct link_stats *link_stats_from_lladdr(const linkaddr_t *lladdr);
+int link_stats_is_fresh(const struct link_stats *stats);
+int link_stats_is_lost(const struct link_stats *stats);
+void link_stats_packet_sent(const linkaddr_t *lladdr, int status, int numtx);
+void link_stats_input_callback(const linkaddr_t *lladdr);
+
+#endif /* LINK_STATS_H_ */
@@ -47,6 +47,10 @@
 #include "lib/random.h"
 
 #include "net/netstack.h"
+#if NETSTACK_CONF_WITH_IPV6
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-icmp6.h"
+#endif
 
 #include "lib/list.h"
 #include "lib/memb.h"
@@ -88,7 +92,10 @@
 struct qbuf_metadata {
   mac_callback_t sent;
   void *cptr;
+  /* The fragment group set by sicslowpan, 0 if the packet is whole */
+  uint16_t frag_group;
   uint8_t max_transmissions;
+  uint8_t class;
 };
 
 /* Every neighbor has its own packet queue */
@@ -98,6 +105,11 @@ struct neighbor_queue {
   struct ctimer transmit_timer;
   uint8_t transmissions;
   uint8_t collisions, deferrals;
+  /* Set when the neighbor is not backing off and may be served */
+  uint8_t ready;
+  /* The packet handed to the RDC, with its fragments */
+  LIST_STRUCT(tx_packet_list);
+  /* The packets waiting their turn, control packets first */
   LIST_STRUCT(queued_packet_list);
 };
 
@@ -108,21 +120,35 @@ struct neighbor_queue {
 #define CSMA_MAX_NEIGHBOR_QUEUES 2
 #endif /* CSMA_CONF_MAX_NEIGHBOR_QUEUES */
 
-/* The maximum number of pending packet per neighbor */
+/* The maximum number of pending data packet per neighbor */
 #ifdef CSMA_CONF_MAX_PACKET_PER_NEIGHBOR
 #define CSMA_MAX_PACKET_PER_NEIGHBOR CSMA_CONF_MAX_PACKET_PER_NEIGHBOR
 #else
 #define CSMA_MAX_PACKET_PER_NEIGHBOR MAX_QUEUED_PACKETS
 #endif /* CSMA_CONF_MAX_PACKET_PER_NEIGHBOR */
 
+/* The number of queued packets only control packets can use, so that
+   data does not hold back ND and routing */
+#ifdef CSMA_CONF_CONTROL_RESERVE
+#define CSMA_CONTROL_RESERVE CSMA_CONF_CONTROL_RESERVE
+#else
+#define CSMA_CONTROL_RESERVE 1
+#endif /* CSMA_CONF_CONTROL_RESERVE */
+
 #define MAX_QUEUED_PACKETS QUEUEBUF_NUM
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
 LIST(neighbor_list);
 
+struct csma_class_stats csma_stats[CSMA_NUM_CLASSES];
+
+/* The neighbor served last: the round-robin goes on with the next one */
+static struct neighbor_queue *last_served;
+static struct ctimer schedule_timer;
+
 static void packet_sent(void *ptr, int status, int num_transmissions);
-static void transmit_packet_list(void *ptr);
+static void transmit_next(void *ptr);
 
 /*---------------------------------------------------------------------------*/
 static struct neighbor_queue *
@@ -155,48 +181,205 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+static uint8_t
+packet_class(void)
+{
+#if NETSTACK_CONF_WITH_IPV6
+  uint8_t type;
+#endif
+
+#if PACKETBUF_WITH_PACKET_TYPE
+  if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
+     PACKETBUF_ATTR_PACKET_TYPE_ACK) {
+    return CSMA_CLASS_CONTROL;
+  }
+#endif
+#if NETSTACK_CONF_WITH_IPV6
+  /* sicslowpan sets the network id to the next header of the IPv6
+     packet, and the ICMPv6 type. Neighbor discovery (RS to redirect)
+     and RPL are control, other ICMPv6 such as echo requests are data. */
+  if(packetbuf_attr(PACKETBUF_ATTR_NETWORK_ID) == UIP_PROTO_ICMP6) {
+    type = packetbuf_attr(PACKETBUF_ATTR_ICMP6_TYPE);
+    if((type >= ICMP6_RS && type <= ICMP6_REDIRECT) || type == ICMP6_RPL) {
+      return CSMA_CLASS_CONTROL;
+    }
+  }
+#endif
+  return CSMA_CLASS_DATA;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+queue_class(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q;
+
+  q = list_head(n->tx_packet_list);
+  if(q == NULL) {
+    q = list_head(n->queued_packet_list);
+    if(q == NULL) {
+      return CSMA_NUM_CLASSES;
+    }
+  }
+  return ((struct qbuf_metadata *)q->ptr)->class;
+}
+/*---------------------------------------------------------------------------*/
+/* Packets queued with the same non-zero fragment group are the
+   fragments of one upper-layer packet. The callback pointer says nothing
+   about that: Rime, for one, passes the same channel for every packet. */
+static int
+same_packet(struct rdc_buf_list *p, struct rdc_buf_list *q)
+{
+  struct qbuf_metadata *mp = (struct qbuf_metadata *)p->ptr;
+  struct qbuf_metadata *mq = (struct qbuf_metadata *)q->ptr;
+
+  return mp->frag_group != 0 && mp->frag_group == mq->frag_group;
+}
+/*---------------------------------------------------------------------------*/
 static void
-transmit_packet_list(void *ptr)
+release_packet(struct rdc_buf_list *p)
 {
-  struct neighbor_queue *n = ptr;
-  if(n) {
-    struct rdc_buf_list *q = list_head(n->queued_packet_list);
-    if(q != NULL) {
-      PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
-          list_length(n->queued_packet_list));
-      /* Send packets in the neighbor's list */
-      NETSTACK_RDC.send_list(packet_sent, n, q);
+  struct qbuf_metadata *metadata = (struct qbuf_metadata *)p->ptr;
+
+  csma_stats[metadata->class].queued--;
+  queuebuf_free(p->buf);
+  memb_free(&metadata_memb, metadata);
+  memb_free(&packet_memb, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_neighbor(struct neighbor_queue *n)
+{
+  ctimer_stop(&n->transmit_timer);
+  if(last_served == n) {
+    last_served = NULL;
+  }
+  list_remove(neighbor_list, n);
+  memb_free(&neighbor_memb, n);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the next neighbor, in round-robin order, that may send a
+   packet of the given class */
+static struct neighbor_queue *
+next_neighbor(uint8_t class)
+{
+  struct neighbor_queue *n;
+  int i;
+
+  n = last_served;
+  for(i = list_length(neighbor_list); i > 0; i--) {
+    n = n != NULL ? list_item_next(n) : NULL;
+    if(n == NULL) {
+      n = list_head(neighbor_list);
     }
+    if(n->ready && queue_class(n) == class) {
+      return n;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+transmit_next(void *ptr)
+{
+  struct neighbor_queue *n;
+  struct rdc_buf_list *q;
+
+  n = next_neighbor(CSMA_CLASS_CONTROL);
+  if(n == NULL) {
+    n = next_neighbor(CSMA_CLASS_DATA);
+    if(n == NULL) {
+      return;
+    }
+  }
+  n->ready = 0;
+  last_served = n;
+
+  q = list_head(n->tx_packet_list);
+  if(q == NULL) {
+    /* Take the next packet, and its fragments, off the queue */
+    q = list_pop(n->queued_packet_list);
+    list_add(n->tx_packet_list, q);
+    while(list_head(n->queued_packet_list) != NULL &&
+          same_packet(list_head(n->queued_packet_list), q)) {
+      list_add(n->tx_packet_list, list_pop(n->queued_packet_list));
+    }
+    q = list_head(n->tx_packet_list);
+  }
+
+  PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
+         list_length(n->tx_packet_list) + list_length(n->queued_packet_list));
+  /* Send the packet and its fragments */
+  NETSTACK_RDC.send_list(packet_sent, n, q);
+
+  /* Let the other neighbors have their turn, one packet per event */
+  if(next_neighbor(CSMA_CLASS_CONTROL) != NULL ||
+     next_neighbor(CSMA_CLASS_DATA) != NULL) {
+    ctimer_set(&schedule_timer, 0, transmit_next, NULL);
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
+neighbor_ready(void *ptr)
+{
+  struct neighbor_queue *n = ptr;
+
+  n->ready = 1;
+  transmit_next(NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
 free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
 {
   if(p != NULL) {
     /* Remove packet from list and deallocate */
-    list_remove(n->queued_packet_list, p);
-
-    queuebuf_free(p->buf);
-    memb_free(&metadata_memb, p->ptr);
-    memb_free(&packet_memb, p);
+    list_remove(n->tx_packet_list, p);
+    release_packet(p);
     PRINTF("csma: free_queued_packet, queue length %d, free packets %d\n",
-           list_length(n->queued_packet_list), memb_numfree(&packet_memb));
-    if(list_head(n->queued_packet_list) != NULL) {
-      /* There is a next packet. We reset current tx information */
+           list_length(n->tx_packet_list) + list_length(n->queued_packet_list),
+           memb_numfree(&packet_memb));
+    if(list_head(n->tx_packet_list) != NULL) {
+      /* There is a next fragment. We reset current tx information */
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
-      /* Set a timer for next transmissions */
+      /* Set a timer in case the RDC does not send it right away */
       ctimer_set(&n->transmit_timer, default_timebase(),
-                 transmit_packet_list, n);
+                 neighbor_ready, n);
+    } else if(list_head(n->queued_packet_list) != NULL) {
+      /* There is a next packet. It waits for the turn of the neighbor */
+      n->transmissions = 0;
+      n->collisions = 0;
+      n->deferrals = 0;
+      ctimer_stop(&n->transmit_timer);
+      n->ready = 1;
+      ctimer_set(&schedule_timer, 0, transmit_next, NULL);
     } else {
       /* This was the last packet in the queue, we free the neighbor */
-      ctimer_stop(&n->transmit_timer);
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
+      free_neighbor(n);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Once one fragment of a packet is dropped the others are useless:
+   remove them from the list and return their number. */
+static int
+drop_fragments(list_t list, struct rdc_buf_list *q)
+{
+  struct rdc_buf_list *p;
+  struct rdc_buf_list *next;
+  int dropped = 0;
+
+  for(p = list_head(list); p != NULL; p = next) {
+    next = list_item_next(p);
+    if(p != q && same_packet(p, q)) {
+      list_remove(list, p);
+      csma_stats[((struct qbuf_metadata *)p->ptr)->class].drops++;
+      release_packet(p);
+      dropped++;
     }
   }
+  PRINTF("csma: dropped %d fragments of the same packet\n", dropped);
+  return dropped;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -211,6 +394,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
   int num_tx;
   int backoff_exponent;
   int backoff_transmissions;
+  int dropped = 0;
 
   n = ptr;
   if(n == NULL) {
@@ -230,7 +414,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
   }
 
   /* Find out what packet this callback refers to */
-  for(q = list_head(n->queued_packet_list);
+  for(q = list_head(n->tx_packet_list);
       q != NULL; q = list_item_next(q)) {
     if(queuebuf_attr(q->buf, PACKETBUF_ATTR_MAC_SEQNO) ==
        packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO)) {
@@ -286,13 +470,14 @@ packet_sent(void *ptr, int status, int num_transmissions)
         if(n->transmissions < metadata->max_transmissions) {
           PRINTF("csma: retransmitting with time %lu %p\n", time, q);
           ctimer_set(&n->transmit_timer, time,
-                     transmit_packet_list, n);
+                     neighbor_ready, n);
           /* This is needed to correctly attribute energy that we spent
              transmitting this packet. */
           queuebuf_update_attr_from_packetbuf(q->buf);
         } else {
           PRINTF("csma: drop with status %d after %d transmissions, %d collisions\n",
                  status, n->transmissions, n->collisions);
+          dropped = drop_fragments(n->tx_packet_list, q);
           free_packet(n, q);
           mac_call_sent_callback(sent, cptr, status, num_tx);
         }
@@ -301,10 +486,17 @@ packet_sent(void *ptr, int status, int num_transmissions)
           PRINTF("csma: rexmit ok %d\n", n->transmissions);
         } else {
           PRINTF("csma: rexmit failed %d: %d\n", n->transmissions, status);
+          if(status == MAC_TX_ERR || status == MAC_TX_ERR_FATAL) {
+            dropped = drop_fragments(n->tx_packet_list, q);
+          }
         }
         free_packet(n, q);
         mac_call_sent_callback(sent, cptr, status, num_tx);
       }
+      /* The fragments dropped along with this packet were never sent */
+      while(dropped-- > 0) {
+        mac_call_sent_callback(sent, cptr, MAC_TX_ERR, 0);
+      }
     } else {
       PRINTF("csma: no metadata\n");
     }
@@ -314,6 +506,46 @@ packet_sent(void *ptr, int status, int num_transmissions)
 }
 /*---------------------------------------------------------------------------*/
 static void
+queue_packet(struct neighbor_queue *n, struct rdc_buf_list *q)
+{
+  struct qbuf_metadata *metadata = (struct qbuf_metadata *)q->ptr;
+  struct rdc_buf_list *p;
+  struct rdc_buf_list *last_control;
+
+#if PACKETBUF_WITH_PACKET_TYPE
+  if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
+     PACKETBUF_ATTR_PACKET_TYPE_ACK) {
+    list_push(n->queued_packet_list, q);
+    return;
+  }
+#endif
+  if(metadata->class == CSMA_CLASS_DATA) {
+    list_add(n->queued_packet_list, q);
+    return;
+  }
+  /* Control packets go after the other control packets, ahead of data */
+  last_control = NULL;
+  for(p = list_head(n->queued_packet_list); p != NULL; p = list_item_next(p)) {
+    if(((struct qbuf_metadata *)p->ptr)->class != CSMA_CLASS_CONTROL) {
+      break;
+    }
+    last_control = p;
+  }
+  list_insert(n->queued_packet_list, last_control, q);
+}
+/*---------------------------------------------------------------------------*/
+static int
+queue_has_room(struct neighbor_queue *n, uint8_t class)
+{
+  if(class == CSMA_CLASS_CONTROL) {
+    return 1;
+  }
+  return memb_numfree(&packet_memb) > CSMA_CONTROL_RESERVE &&
+    list_length(n->tx_packet_list) + list_length(n->queued_packet_list) <
+    CSMA_MAX_PACKET_PER_NEIGHBOR;
+}
+/*---------------------------------------------------------------------------*/
+static void
 send_packet(mac_callback_t sent, void *ptr)
 {
   struct rdc_buf_list *q;
@@ -321,6 +553,9 @@ send_packet(mac_callback_t sent, void *ptr)
   static uint8_t initialized = 0;
   static uint16_t seqno;
   const linkaddr_t *addr = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  uint8_t class;
+  uint16_t frag_group;
+  int dropped;
 
   if(!initialized) {
     initialized = 1;
@@ -335,6 +570,8 @@ send_packet(mac_callback_t sent, void *ptr)
   }
   packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, seqno++);
 
+  class = packet_class();
+
   /* Look for the neighbor entry */
   n = neighbor_queue_from_addr(addr);
   if(n == NULL) {
@@ -346,7 +583,9 @@ send_packet(mac_callback_t sent, void *ptr)
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
-      /* Init packet list for this neighbor */
+      n->ready = 1;
+      /* Init packet lists for this neighbor */
+      LIST_STRUCT_INIT(n, tx_packet_list);
       LIST_STRUCT_INIT(n, queued_packet_list);
       /* Add neighbor to the list */
       list_add(neighbor_list, n);
@@ -355,7 +594,7 @@ send_packet(mac_callback_t sent, void *ptr)
 
   if(n != NULL) {
     /* Add packet to the neighbor's queue */
-    if(list_length(n->queued_packet_list) < CSMA_MAX_PACKET_PER_NEIGHBOR) {
+    if(queue_has_room(n, class)) {
       q = memb_alloc(&packet_memb);
       if(q != NULL) {
         q->ptr = memb_alloc(&metadata_memb);
@@ -373,21 +612,21 @@ send_packet(mac_callback_t sent, void *ptr)
             }
             metadata->sent = sent;
             metadata->cptr = ptr;
-#if PACKETBUF_WITH_PACKET_TYPE
-            if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
-               PACKETBUF_ATTR_PACKET_TYPE_ACK) {
-              list_push(n->queued_packet_list, q);
-            } else
-#endif
-            {
-              list_add(n->queued_packet_list, q);
+            metadata->frag_group =
+              packetbuf_attr(PACKETBUF_ATTR_FRAGMENT_GROUP);
+            metadata->class = class;
+            queue_packet(n, q);
+            if(++csma_stats[class].queued > csma_stats[class].max_queued) {
+              csma_stats[class].max_queued = csma_stats[class].queued;
             }
 
-            PRINTF("csma: send_packet, queue length %d, free packets %d\n",
-                   list_length(n->queued_packet_list), memb_numfree(&packet_memb));
-            /* If q is the first packet in the neighbor's queue, send asap */
-            if(list_head(n->queued_packet_list) == q) {
-              ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
+            PRINTF("csma: send_packet, class %d, queue length %d, free packets %d\n",
+                   class,
+                   list_length(n->tx_packet_list) + list_length(n->queued_packet_list),
+                   memb_numfree(&packet_memb));
+            /* Send asap if the neighbor is not backing off */
+            if(n->ready) {
+              ctimer_set(&schedule_timer, 0, transmit_next, NULL);
             }
             return;
           }
@@ -397,21 +636,55 @@ send_packet(mac_callback_t sent, void *ptr)
         memb_free(&packet_memb, q);
         PRINTF("csma: could not allocate queuebuf, dropping packet\n");
       }
-      /* The packet allocation failed. Remove and free neighbor entry if empty. */
-      if(list_length(n->queued_packet_list) == 0) {
-        list_remove(neighbor_list, n);
-        memb_free(&neighbor_memb, n);
-      }
     } else {
       PRINTF("csma: Neighbor queue full\n");
     }
+    /* The fragments of this packet that are queued cannot be
+       reassembled without it */
+    dropped = 0;
+    frag_group = packetbuf_attr(PACKETBUF_ATTR_FRAGMENT_GROUP);
+    if(frag_group != 0) {
+      q = list_head(n->queued_packet_list);
+      for(; q != NULL; q = list_item_next(q)) {
+        if(((struct qbuf_metadata *)q->ptr)->frag_group == frag_group) {
+          break;
+        }
+      }
+      if(q != NULL) {
+        dropped = drop_fragments(n->queued_packet_list, q) + 1;
+        list_remove(n->queued_packet_list, q);
+        csma_stats[class].drops++;
+        release_packet(q);
+      }
+    }
+    /* Remove and free neighbor entry if empty. */
+    if(list_head(n->tx_packet_list) == NULL &&
+       list_head(n->queued_packet_list) == NULL) {
+      free_neighbor(n);
+    }
+    while(dropped-- > 0) {
+      mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 0);
+    }
     PRINTF("csma: could not allocate packet, dropping packet\n");
   } else {
     PRINTF("csma: could not allocate neighbor, dropping packet\n");
   }
+  csma_stats[class].drops++;
   mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
 }
 /*---------------------------------------------------------------------------*/
+int
+csma_neighbor_queue_length(const linkaddr_t *addr)
+{
+  struct neighbor_queue *n;
+
+  n = neighbor_queue_from_addr(addr);
+  if(n == NULL) {
+    return 0;
+  }
+  return list_length(n->tx_packet_list) + list_length(n->queued_packet_list);
+}
+/*---------------------------------------------------------------------------*/
 static void
 input_packet(void)
 {
@@ -445,6 +718,7 @@ init(void)
   memb_init(&packet_memb);
   memb_init(&metadata_memb);
   memb_init(&neighbor_memb);
+  memset(csma_stats, 0, sizeof(csma_stats));
 }
 /*---------------------------------------------------------------------------*/
 const struct mac_driver csma_driver = {
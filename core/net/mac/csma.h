@@ -41,11 +41,32 @@
 #ifndef CSMA_H_
 #define CSMA_H_
 
+#include "net/linkaddr.h"
 #include "net/mac/mac.h"
 #include "dev/radio.h"
 
+/* The classes of the neighbor queues: control packets (neighbor
+   discovery, routing) are sent before data */
+#define CSMA_CLASS_CONTROL 0
+#define CSMA_CLASS_DATA    1
+#define CSMA_NUM_CLASSES   2
+
+struct csma_class_stats {
+  /* The number of packets of the class in the neighbor queues */
+  uint16_t queued;
+  /* The largest number of packets of the class queued at once */
+  uint16_t max_queued;
+  /* The number of packets dropped without being transmitted */
+  uint32_t drops;
+};
+
+extern struct csma_class_stats csma_stats[CSMA_NUM_CLASSES];
+
 extern const struct mac_driver csma_driver;
 
+/* Returns the number of packets queued for a neighbor */
+int csma_neighbor_queue_length(const linkaddr_t *addr);
+
 const struct mac_driver *csma_init(const struct mac_driver *r);
 
 #endif /* CSMA_H_ */
@@ -318,6 +318,13 @@ nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
   return nbr_get_bit(used_map, table, item) ? item : NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Tells whether any table has an item for a link-layer address */
+int
+nbr_table_has_lladdr(const linkaddr_t *lladdr)
+{
+  return lladdr != NULL && index_from_lladdr(lladdr) != -1;
+}
+/*---------------------------------------------------------------------------*/
 /* Removes a neighbor from the current table (unset "used" bit) */
 int
 nbr_table_remove(nbr_table_t *table, void *item)
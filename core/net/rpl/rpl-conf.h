@@ -134,6 +134,17 @@
   #define RPL_DAO_SPECIFY_DAG RPL_CONF_DAO_SPECIFY_DAG
 #endif /* RPL_CONF_DAO_SPECIFY_DAG */
 
+/*
+ * The number of nodes the root of a non-storing DODAG keeps a parent
+ * for, i.e. the number of nodes it can source-route to. Only the root
+ * needs them: routers of a non-storing DODAG can set it to 0.
+ */
+#ifdef RPL_NS_CONF_LINK_NUM
+#define RPL_NS_LINK_NUM RPL_NS_CONF_LINK_NUM
+#else
+#define RPL_NS_LINK_NUM UIP_DS6_ROUTE_NB
+#endif /* RPL_NS_CONF_LINK_NUM */
+
 /*
  * The DIO interval (n) represents 2^n ms.
  *
@@ -284,4 +295,53 @@
     + random_rand() % (RPL_PROBING_INTERVAL))
 #endif
 
+/*
+ * RPL-ND: encoding of the node IDs acknowledged in the source info option
+ * of DIOs. LIST carries every ID (2 bytes each), RANGES carries runs of
+ * consecutive IDs (4 bytes per run) and BLOOM a Bloom filter of
+ * RPL_SOURCEINFO_BLOOM_BITS bits whatever the number of IDs, at the cost
+ * of false positives. Receivers understand all three; DIOs carrying a
+ * single ID, such as local repair DIOs, always use LIST.
+ */
+#define RPL_SOURCEINFO_ENCODING_LIST     0
+#define RPL_SOURCEINFO_ENCODING_RANGES   1
+#define RPL_SOURCEINFO_ENCODING_BLOOM    2
+
+#ifdef RPL_CONF_SOURCEINFO_ENCODING
+#define RPL_SOURCEINFO_ENCODING RPL_CONF_SOURCEINFO_ENCODING
+#else
+#define RPL_SOURCEINFO_ENCODING RPL_SOURCEINFO_ENCODING_LIST
+#endif /* RPL_CONF_SOURCEINFO_ENCODING */
+
+/* RPL-ND: number of node IDs waiting to be acknowledged in a DIO. */
+#ifdef RPL_CONF_SOURCEINFO_NUM
+#define RPL_SOURCEINFO_NUM RPL_CONF_SOURCEINFO_NUM
+#else
+#define RPL_SOURCEINFO_NUM 16
+#endif /* RPL_CONF_SOURCEINFO_NUM */
+
+/*
+ * RPL-ND: maximum length of the source info option data. The IDs that do
+ * not fit wait for the next DIO.
+ */
+#ifdef RPL_CONF_SOURCEINFO_MAX_LEN
+#define RPL_SOURCEINFO_MAX_LEN RPL_CONF_SOURCEINFO_MAX_LEN
+#else
+#define RPL_SOURCEINFO_MAX_LEN 64
+#endif /* RPL_CONF_SOURCEINFO_MAX_LEN */
+
+/* RPL-ND: size in bits (a multiple of 8) and number of hash functions of
+ * the Bloom filter encoding. */
+#ifdef RPL_CONF_SOURCEINFO_BLOOM_BITS
+#define RPL_SOURCEINFO_BLOOM_BITS RPL_CONF_SOURCEINFO_BLOOM_BITS
+#else
+#define RPL_SOURCEINFO_BLOOM_BITS 256
+#endif /* RPL_CONF_SOURCEINFO_BLOOM_BITS */
+
+#ifdef RPL_CONF_SOURCEINFO_BLOOM_HASHES
+#define RPL_SOURCEINFO_BLOOM_HASHES RPL_CONF_SOURCEINFO_BLOOM_HASHES
+#else
+#define RPL_SOURCEINFO_BLOOM_HASHES 3
+#endif /* RPL_CONF_SOURCEINFO_BLOOM_HASHES */
+
 #endif /* RPL_CONF_H */
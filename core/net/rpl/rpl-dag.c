@@ -49,6 +49,7 @@
 #include "net/ipv6/uip-nd6.h"
 #include "net/ipv6/uip-ds6-nbr.h"
 #include "net/nbr-table.h"
+#include "net/link-stats.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
 #include "lib/list.h"
 #include "lib/memb.h"
@@ -644,7 +645,15 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
       
       /* Check whether we have a neighbor that has not gotten a link metric yet */
       if(nbr != NULL && nbr->link_metric == 0) {
-	nbr->link_metric = RPL_INIT_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+        const struct link_stats *stats;
+        /* Start from what the link statistics know, if anything */
+        stats = link_stats_from_lladdr((linkaddr_t *)lladdr);
+        if(stats != NULL) {
+          nbr->link_metric = (uint32_t)stats->etx * RPL_DAG_MC_ETX_DIVISOR /
+            LINK_STATS_ETX_DIVISOR;
+        } else {
+          nbr->link_metric = RPL_INIT_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+        }
       }
 #if RPL_DAG_MC != RPL_DAG_MC_NONE
       memcpy(&p->mc, &dio->mc, sizeof(p->mc));
@@ -771,7 +780,9 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
   	(unsigned)old_rank, best_dag->rank);
     RPL_STAT(rpl_stats.parent_switch++);
     if(instance->mop != RPL_MOP_NO_DOWNWARD_ROUTES) {
-      if(last_parent != NULL) {
+      /* In non-storing mode the next DAO replaces the link at the root,
+         there is no route at the old parent to remove. */
+      if(last_parent != NULL && !RPL_IS_NON_STORING(instance)) {
         /* Send a No-Path DAO to the removed preferred parent. */
         dao_output(last_parent, RPL_ZERO_LIFETIME);
       }
@@ -1180,8 +1191,9 @@ rpl_recalculate_ranks(void)
 
   /*
    * We recalculate ranks when we receive feedback from the system rather
-   * than RPL protocol messages. This periodical recalculation is called
-   * from a timer in order to keep the stack depth reasonably low.
+   * than RPL protocol messages. The recalculation is scheduled by
+   * rpl_parent_updated() and called from a timer in order to keep the
+   * stack depth reasonably low. Only the updated parents are processed.
    */
   p = nbr_table_head(rpl_parents);
   while(p != NULL) {
@@ -1196,6 +1208,13 @@ rpl_recalculate_ranks(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+rpl_parent_updated(rpl_parent_t *p)
+{
+  p->flags |= RPL_PARENT_FLAG_UPDATED;
+  rpl_schedule_rank_recalculation();
+}
+/*---------------------------------------------------------------------------*/
 int
 rpl_process_parent_event(rpl_instance_t *instance, rpl_parent_t *p)
 {
@@ -1382,7 +1401,7 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
   }
 
   /* Parent info has been updated, trigger rank recalculation */
-  p->flags |= RPL_PARENT_FLAG_UPDATED;
+  rpl_parent_updated(p);
 
   PRINTF("RPL: preferred DAG ");
   PRINT6ADDR(&instance->current_dag->dag_id);
@@ -64,6 +64,7 @@
 #define UIP_EXT_HDR_OPT_BUF       ((struct uip_ext_hdr_opt *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_PADN_BUF  ((struct uip_ext_hdr_opt_padn *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_RPL_BUF   ((struct uip_ext_hdr_opt_rpl *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
+#define UIP_RH_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 /*---------------------------------------------------------------------------*/
 int
 rpl_verify_header(int uip_ext_opt_offset)
@@ -383,5 +384,214 @@ rpl_insert_header(void)
 #endif
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* Offset of a source routing header from the IPv6 header, 0 if there
+ * is none. Only a hop-by-hop header may come before it. */
+static int
+srh_offset(void)
+{
+  int offset;
+  uint8_t proto;
+
+  offset = UIP_IPH_LEN;
+  proto = UIP_IP_BUF->proto;
+  if(proto == UIP_PROTO_HBHO) {
+    proto = uip_buf[UIP_LLH_LEN + offset];
+    offset += (uip_buf[UIP_LLH_LEN + offset + 1] + 1) << 3;
+  }
+  if(proto == UIP_PROTO_ROUTING && offset + 8 <= uip_len &&
+     uip_buf[UIP_LLH_LEN + offset + 2] == RPL_RH_TYPE_SRH) {
+    return offset;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* The DODAG node of the destination, if we are the root of a
+ * non-storing instance. */
+static rpl_ns_node_t *
+srh_dest_node(void)
+{
+  rpl_dag_t *dag;
+
+  if(!RPL_IS_NON_STORING(default_instance)) {
+    return NULL;
+  }
+  dag = default_instance->current_dag;
+  if(dag == NULL || !dag->joined || dag->rank != ROOT_RANK(default_instance)) {
+    return NULL;
+  }
+  return rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+int
+rpl_insert_srh_header(void)
+{
+#if RPL_WITH_NON_STORING
+  rpl_ns_node_t *dest_node;
+  rpl_ns_node_t *node;
+  uip_ipaddr_t addr;
+  uint8_t *hdr;
+  uint8_t *p;
+  int path_len;
+  int cmpr;
+  int size;
+  int pad;
+  int n;
+  int i;
+
+  dest_node = srh_dest_node();
+  if(dest_node == NULL || srh_offset() != 0) {
+    return 0;
+  }
+  path_len = rpl_ns_path_len(dest_node);
+  if(path_len < 1) {
+    PRINTF("RPL: No source route to ");
+    PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+    PRINTF("\n");
+    return 0;
+  }
+
+  /* The packet goes down: the RPL option is of no use to anyone */
+  rpl_remove_header();
+  if(path_len == 1) {
+    return 0;
+  }
+
+  /* All addresses of the path are elided by the bytes they share with
+     the destination, the same for the last one (CmprI == CmprE). */
+  cmpr = 15;
+  for(node = dest_node; !rpl_ns_is_root(node); node = node->parent) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    for(i = 0; i < cmpr && addr.u8[i] == UIP_IP_BUF->destipaddr.u8[i]; i++);
+    cmpr = i;
+  }
+
+  /* The first hop goes to the IPv6 header, the header lists the rest */
+  n = path_len - 1;
+  size = 8 + n * (16 - cmpr);
+  pad = (8 - (size & 7)) & 7;
+  size += pad;
+  if(uip_len + size > UIP_LINK_MTU || uip_len + size > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("RPL: Packet too long for a source routing header\n");
+    return -1;
+  }
+
+  hdr = &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN];
+  memmove(hdr + size, hdr, uip_len - UIP_IPH_LEN);
+  memset(hdr, 0, size);
+  hdr[0] = UIP_IP_BUF->proto;
+  hdr[1] = (size >> 3) - 1;
+  hdr[2] = RPL_RH_TYPE_SRH;
+  hdr[3] = n;
+  hdr[4] = (cmpr << 4) | cmpr;
+  hdr[5] = pad << 4;
+
+  /* Fill in from the destination upwards */
+  p = hdr + 8 + n * (16 - cmpr);
+  node = dest_node;
+  for(i = 0; i < n; i++) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    p -= 16 - cmpr;
+    memcpy(p, &addr.u8[cmpr], 16 - cmpr);
+    node = node->parent;
+  }
+  rpl_ns_get_node_global_addr(&UIP_IP_BUF->destipaddr, node);
+
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+  uip_len += size;
+  UIP_IP_BUF->len[0] = (uip_len - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (uip_len - UIP_IPH_LEN) & 0xff;
+
+  PRINTF("RPL: Source routing header with %d hops to ", path_len);
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("\n");
+#endif /* RPL_WITH_NON_STORING */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_process_srh_header(void)
+{
+#if RPL_WITH_NON_STORING
+  uint8_t *hdr;
+  uint8_t *p;
+  uip_ipaddr_t addr;
+  uint8_t cmpri;
+  uint8_t cmpre;
+  uint8_t pad;
+  int cmpr;
+  int len;
+  int n;
+  int i;
+
+  hdr = (uint8_t *)UIP_RH_BUF;
+  if(UIP_RH_BUF->routing_type != RPL_RH_TYPE_SRH || UIP_RH_BUF->seg_left == 0) {
+    return 0;
+  }
+
+  cmpri = hdr[4] >> 4;
+  cmpre = hdr[4] & 0x0f;
+  pad = hdr[5] >> 4;
+  len = UIP_RH_BUF->len << 3;
+  if(UIP_IPH_LEN + uip_ext_len + 8 + len > uip_len ||
+     len < pad + (16 - cmpre)) {
+    PRINTF("RPL: Malformed source routing header\n");
+    return 0;
+  }
+  n = (len - pad - (16 - cmpre)) / (16 - cmpri) + 1;
+  if(UIP_RH_BUF->seg_left > n) {
+    PRINTF("RPL: Source routing header with too many segments left\n");
+    return 0;
+  }
+
+  /* The next address takes the place of the destination, which is
+     recorded in the header instead (RFC 6554, 4.2) */
+  i = n - UIP_RH_BUF->seg_left;
+  p = hdr + 8 + i * (16 - cmpri);
+  cmpr = i == n - 1 ? cmpre : cmpri;
+  uip_ipaddr_copy(&addr, &UIP_IP_BUF->destipaddr);
+  memcpy(&addr.u8[cmpr], p, 16 - cmpr);
+  if(uip_is_addr_mcast(&addr) || uip_ds6_is_my_addr(&addr)) {
+    PRINTF("RPL: Source routing header loops or is multicast\n");
+    return 0;
+  }
+  memcpy(p, &UIP_IP_BUF->destipaddr.u8[cmpr], 16 - cmpr);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &addr);
+  UIP_RH_BUF->seg_left--;
+
+  PRINTF("RPL: Source routing to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(", %u segments left\n", UIP_RH_BUF->seg_left);
+  return 1;
+#else /* RPL_WITH_NON_STORING */
+  return 0;
+#endif /* RPL_WITH_NON_STORING */
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_get_srh_next_hop(uip_ipaddr_t *ipaddr)
+{
+#if RPL_WITH_NON_STORING
+  rpl_ns_node_t *dest_node;
+
+  if(srh_offset() == 0) {
+    /* A child of the root is reached without source route */
+    dest_node = srh_dest_node();
+    if(dest_node == NULL || dest_node->parent == NULL ||
+       !rpl_ns_is_root(dest_node->parent)) {
+      return 0;
+    }
+  }
+
+  /* Every hop of a source route is a neighbor */
+  uip_create_linklocal_prefix(ipaddr);
+  memcpy(&ipaddr->u8[8], &UIP_IP_BUF->destipaddr.u8[8], 8);
+  return 1;
+#else /* RPL_WITH_NON_STORING */
+  return 0;
+#endif /* RPL_WITH_NON_STORING */
+}
+/*---------------------------------------------------------------------------*/
 
 /** @}*/
@@ -50,6 +50,7 @@
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/uip-nd6-engines.h"
 #include "net/ipv6/uip-icmp6.h"
+#include "net/ipv6/uip-bufpool.h"
 #include "net/rpl/rpl-private.h"
 #include "net/packetbuf.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
@@ -102,6 +103,22 @@ extern rpl_of_t RPL_OF;
 #if RPL_CONF_MULTICAST
 static uip_mcast6_route_t *mcast_group;
 #endif
+
+/* A gateway does not forward DAOs, so it has nothing to aggregate */
+#define DAO_AGGREGATION (RPL_DAO_AGGREGATION_DELAY > 0 && UIP_CONF_GW != 1)
+
+#if DAO_AGGREGATION
+struct dao_aggregate_target {
+  uip_ipaddr_t prefix;
+  uint8_t prefixlen;
+  uint8_t lifetime;
+};
+
+static struct dao_aggregate_target dao_aggregate_targets[RPL_DAO_AGGREGATION_TARGETS];
+static uint8_t dao_aggregate_num;
+static rpl_instance_t *dao_aggregate_instance;
+static struct ctimer dao_aggregate_timer;
+#endif /* DAO_AGGREGATION */
 /*---------------------------------------------------------------------------*/
 /* Initialise RPL ICMPv6 message handlers */
 UIP_ICMP6_HANDLER(dis_handler, ICMP6_RPL, RPL_CODE_DIS, dis_input);
@@ -156,6 +173,178 @@ set16(uint8_t *buffer, int pos, uint16_t value)
   buffer[pos++] = value >> 8;
   buffer[pos++] = value & 0xff;
 }
+#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
+/*---------------------------------------------------------------------------*/
+/* Bit of the n-th hash function for a node ID (double hashing) */
+static uint16_t
+sourceinfo_bloom_bit(uint16_t nodeid, uint8_t n, uint16_t bits)
+{
+  uint16_t h1 = (uint16_t)(nodeid * 40503u);
+  uint16_t h2 = (uint16_t)(((nodeid >> 8) | (nodeid << 8)) * 25173u + 13849u) | 1;
+
+  return (uint16_t)(h1 + n * h2) % bits;
+}
+/*---------------------------------------------------------------------------*/
+/* Appends the source info option acknowledging the queued node IDs and
+ * removes them from the queue. Returns the new position in buffer. With
+ * relay set, the receivers pass the IDs on, so they are sent as a list. */
+static int
+sourceinfo_output(unsigned char *buffer, int pos, int relay)
+{
+  rpl_sourceinfo_t *s;
+  rpl_sourceinfo_t *next;
+  int len_index;
+  uint8_t encoding = RPL_SOURCEINFO_ENCODING;
+#if RPL_SOURCEINFO_ENCODING == RPL_SOURCEINFO_ENCODING_RANGES
+  uint16_t first;
+  uint16_t last;
+#elif RPL_SOURCEINFO_ENCODING == RPL_SOURCEINFO_ENCODING_BLOOM
+  uint16_t bit;
+  uint8_t n;
+#endif
+
+  s = rpl_sourceinfo_list_head();
+  if(s == NULL) {
+    return pos;
+  }
+  if(rpl_sourceinfo_list_next(s) == NULL) {
+    /* A single ID is shortest as is */
+    encoding = RPL_SOURCEINFO_ENCODING_LIST;
+#if RPL_SOURCEINFO_ENCODING == RPL_SOURCEINFO_ENCODING_BLOOM
+  } else if(relay) {
+    /* The IDs cannot be read back out of a Bloom filter */
+    encoding = RPL_SOURCEINFO_ENCODING_LIST;
+#endif
+  }
+  len_index = pos + 1;
+  buffer[len_index] = 0;
+
+  switch(encoding) {
+#if RPL_SOURCEINFO_ENCODING == RPL_SOURCEINFO_ENCODING_RANGES
+  case RPL_SOURCEINFO_ENCODING_RANGES:
+    /* The queue is sorted: send runs of consecutive IDs as (first, last) */
+    buffer[pos] = RPL_OPTION_SRC_INFO_RANGES;
+    pos += 2;
+    while(s != NULL && buffer[len_index] + 4 <= RPL_SOURCEINFO_MAX_LEN) {
+      first = last = s->nodeID;
+      do {
+        next = rpl_sourceinfo_list_next(s);
+        last = s->nodeID;
+        rpl_sourceinfo_list_remove(s);
+        s = next;
+      } while(s != NULL && s->nodeID == last + 1);
+      PRINTF("RPL-ND: create rpl_sourceinfo_option in DIO message, node ids %u-%u\n", first, last);
+      set16(buffer, pos, first);
+      set16(buffer, pos + 2, last);
+      pos += 4;
+      buffer[len_index] += 4;
+    }
+    break;
+#elif RPL_SOURCEINFO_ENCODING == RPL_SOURCEINFO_ENCODING_BLOOM
+  case RPL_SOURCEINFO_ENCODING_BLOOM:
+    /* Number of hash functions, then the filter */
+    buffer[pos] = RPL_OPTION_SRC_INFO_BLOOM;
+    buffer[pos + 2] = RPL_SOURCEINFO_BLOOM_HASHES;
+    pos += 3;
+    memset(&buffer[pos], 0, RPL_SOURCEINFO_BLOOM_BITS / 8);
+    for(; s != NULL; s = next) {
+      PRINTF("RPL-ND: create rpl_sourceinfo_option in DIO message, node id %u\n", s->nodeID);
+      for(n = 0; n < RPL_SOURCEINFO_BLOOM_HASHES; n++) {
+        bit = sourceinfo_bloom_bit(s->nodeID, n, RPL_SOURCEINFO_BLOOM_BITS);
+        buffer[pos + bit / 8] |= 1 << (bit % 8);
+      }
+      next = rpl_sourceinfo_list_next(s);
+      rpl_sourceinfo_list_remove(s);
+    }
+    pos += RPL_SOURCEINFO_BLOOM_BITS / 8;
+    buffer[len_index] = 1 + RPL_SOURCEINFO_BLOOM_BITS / 8;
+    break;
+#endif
+  default:
+    buffer[pos] = RPL_OPTION_SRC_INFO;
+    pos += 2;
+    while(s != NULL && buffer[len_index] + 2 <= RPL_SOURCEINFO_MAX_LEN) {
+      PRINTF("RPL-ND: create rpl_sourceinfo_option in DIO message, rpl_sourceinfo_list :element number %u\n", s->nodeID);
+      set16(buffer, pos, s->nodeID);
+      pos += 2;
+      buffer[len_index] += 2;
+      next = rpl_sourceinfo_list_next(s);
+      rpl_sourceinfo_list_remove(s);
+      s = next;
+    }
+    break;
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+/* Processes the data of a source info option: returns 1 if it
+ * acknowledges our node ID, 0 if not, -1 if malformed. With relay set, the
+ * IDs are instead queued to be sent in our own DIOs. */
+static int
+sourceinfo_input(uint8_t type, unsigned char *data, uint8_t len, int relay)
+{
+  uint16_t id;
+  uint16_t last;
+  uint16_t bit;
+  uint8_t n;
+  int i;
+
+  switch(type) {
+  case RPL_OPTION_SRC_INFO:
+    if(len == 0 || len % 2 != 0) {
+      return -1;
+    }
+    for(i = 0; i < len; i += 2) {
+      id = get16(data, i);
+      if(relay) {
+        rpl_sourceinfo_list_add(id);
+      } else if(id == node_id) {
+        return 1;
+      }
+    }
+    return 0;
+  case RPL_OPTION_SRC_INFO_RANGES:
+    if(len == 0 || len % 4 != 0) {
+      return -1;
+    }
+    for(i = 0; i < len; i += 4) {
+      id = get16(data, i);
+      last = get16(data, i + 2);
+      if(id > last) {
+        return -1;
+      }
+      if(relay) {
+        for(n = 0; n < RPL_SOURCEINFO_NUM; n++) {
+          rpl_sourceinfo_list_add(id);
+          if(id++ == last) {
+            break;
+          }
+        }
+      } else if(id <= node_id && node_id <= last) {
+        return 1;
+      }
+    }
+    return 0;
+  case RPL_OPTION_SRC_INFO_BLOOM:
+    if(len < 2 || data[0] == 0) {
+      return -1;
+    }
+    if(relay) {
+      /* IDs cannot be recovered from the filter */
+      PRINTF("RPL-ND: cannot relay a Bloom filter source info option\n");
+      return 0;
+    }
+    for(n = 0; n < data[0]; n++) {
+      bit = sourceinfo_bloom_bit(node_id, n, (len - 1) * 8);
+      if((data[1 + bit / 8] & (1 << (bit % 8))) == 0) {
+        return 0;
+      }
+    }
+    return 1;
+  }
+  return 0;
+}
+#endif /* UIP_ND6_ENGINE_RPL */
 /*---------------------------------------------------------------------------*/
 static void
 dis_input(void)
@@ -177,6 +366,12 @@ dis_input(void)
   PRINTF("\n");
   
   uip_ipaddr_copy(&from, &UIP_IP_BUF->srcipaddr);
+
+#if RPL_DIS_SEND && UIP_DS6_SOLICIT_TRICKLE && UIP_ND6_ENGINE != UIP_ND6_ENGINE_RPL
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) && rpl_get_any_dag() == NULL) {
+    rpl_dis_overheard();
+  }
+#endif
   
   /* Process the RPL sourceinfo option. */
   /*
@@ -332,8 +527,6 @@ dio_input(void)
   uip_ds6_nbr_t *nbr;
   #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
   uint8_t nodeidmatch = 0;
-  uint8_t srcopt_num;
-  uint16_t rplsourceinfo;
   #endif
 
   memset(&dio, 0, sizeof(dio));
@@ -535,29 +728,21 @@ dio_input(void)
       break;
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
      case RPL_OPTION_SRC_INFO:
-        if(len < 2 || len % 2 != 0) {
-           PRINTF("RPL: Invalid soure node id info, len < 2 or len % 2 != 0\n");
+     case RPL_OPTION_SRC_INFO_RANGES:
+     case RPL_OPTION_SRC_INFO_BLOOM:
+        /* With INFINITE_RANK, the IDs are added to our list for local repair */
+        switch(sourceinfo_input(subopt_type, &buffer[i + 2], len - 2,
+                                dio.rank == INFINITE_RANK)) {
+        case -1:
+           PRINTF("RPL: Invalid source node id info, len = %d\n", len);
 	       RPL_STAT(rpl_stats.malformed_msgs++);
 	       uip_len = 0;
            return;   
-        }
-	srcopt_num = len/ 2;
-	while(srcopt_num != 0){
-		PRINTF("RPL: rpl_sourceinfo_option in DIO message, element number %d %d, local nodeid %u\n", buffer[i + 2], buffer[i + 3], node_id);
-		
-		rplsourceinfo = get16(buffer, i + 2);
-		if (dio.rank == INFINITE_RANK){
-		rpl_sourceinfo_list_add(rplsourceinfo);
-		PRINTF("RPL-ND: add RPL source info to sourceinfoList, element number %u\n", rplsourceinfo);
-			PRINTF("RPL-ND: receive a rpl_sourceinfo_option in a multicast DIO with INFINITE_RANK, add it in the source node id list, start local repair!\n");
-		    }
-		else if(memcmp(&rplsourceinfo, &node_id, 2) == 0){
+        case 1:
 		  nodeidmatch = 1;
 		      PRINTF("RPL-ND: there exists one rpl_sourceinfo_option in DIO message match!\n");
-		}
-	i += 2; 
-	srcopt_num--;
-       }   
+          break;
+        }
         break; 
 #endif   
     default:
@@ -572,6 +757,7 @@ if(nodeidmatch != 1 && uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)){
     			PRINTF("RPL-ND: receive a multicast DIO from a already created parent, update its state!");
     			PRINTF("\n");
 			nbr->state = NBR_REACHABLE;
+			uip_ds6_nbr_schedule(nbr);
 		}
 	} else if (dio.rank == INFINITE_RANK){
 		PRINTF("RPL-ND: receive a multicast DIO with INFINITE_RANK from a unknown node, start local repair!\n");
@@ -609,6 +795,7 @@ else if(nodeidmatch == 1){
 	       nbr->state = NBR_REACHABLE;
            PRINTF("RPL-ND: Neighbor already in neighbor cache\n");
 	       stimer_reset(&nbr->reachable);
+	       uip_ds6_nbr_schedule(nbr);
      }  
 }
 
@@ -630,11 +817,6 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
   int pos;
   rpl_dag_t *dag = instance->current_dag;
 
-#if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL 
-  /* Check if we have rpl_sourceinfo_list information to send also. */
-  rpl_sourceinfo_t *s;
-  uint8_t len_index; 
-#endif
 
 #if !RPL_LEAF_ONLY
   uip_ipaddr_t addr;
@@ -764,19 +946,7 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
     rpl_sourceinfo_list_add(node_id);
     PRINTF("RPL-ND: DIO output for local repair, add node id of myself!\n");
  }
-  s = rpl_sourceinfo_list_head();
-  if (s != NULL){
-    buffer[pos++] = RPL_OPTION_SRC_INFO;
-    len_index = pos;
-    buffer[pos++] = 0;    
-}
-  for(s; s != NULL; s = rpl_sourceinfo_list_next(s)) {
-    PRINTF("RPL-ND: create rpl_sourceinfo_option in DIO message, rpl_sourceinfo_list :element number %u\n", s->nodeID);
-    set16(buffer, pos, s->nodeID);
-    pos += 2;
-    buffer[len_index] += 2;   
-  }  
-  rpl_sourceinfo_list_purge();
+  pos = sourceinfo_output(buffer, pos, dag->rank == INFINITE_RANK);
 #endif
 
 #if RPL_LEAF_ONLY
@@ -807,8 +977,320 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #endif /* RPL_LEAF_ONLY */
 }
 /*---------------------------------------------------------------------------*/
+/* Adds or refreshes the sender of a DAO in the neighbor cache, the
+ * lladdr is the one of the frame. Returns 0 if the cache is full. */
+static int
+dao_add_neighbor(uip_ipaddr_t *dao_sender_addr)
+{
+  uip_ds6_nbr_t *nbr;
+
+  if((nbr = uip_ds6_nbr_lookup(dao_sender_addr)) == NULL) {
+    if((nbr = uip_ds6_nbr_add(dao_sender_addr,
+                              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                              0, NBR_REACHABLE)) != NULL) {
+      /* set reachable timer */
+      stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      PRINTF("RPL-ND: Neighbor added to neighbor cache ");
+      PRINT6ADDR(dao_sender_addr);
+      PRINTF(", ");
+      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      PRINTF("\n");
+    } else {
+      PRINTF("RPL-ND: Out of Memory, dropping DAO from ");
+      PRINT6ADDR(dao_sender_addr);
+      PRINTF(", ");
+      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      PRINTF("\n");
+      return 0;
+    }
+  } else {
+    PRINTF("RPL-ND: Neighbor already in neighbor cache\n");
+    nbr->state = NBR_REACHABLE;
+    stimer_reset(&nbr->reachable);
+    uip_ds6_nbr_schedule(nbr);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_output_header(rpl_dag_t *dag, unsigned char *buffer)
+{
+  int pos;
+
+  RPL_LOLLIPOP_INCREMENT(dao_sequence);
+  pos = 0;
+
+  buffer[pos++] = dag->instance->instance_id;
+  buffer[pos] = 0;
+#if RPL_DAO_SPECIFY_DAG
+  buffer[pos] |= RPL_DAO_D_FLAG;
+#endif /* RPL_DAO_SPECIFY_DAG */
+#if RPL_CONF_DAO_ACK
+  buffer[pos] |= RPL_DAO_K_FLAG;
+#endif /* RPL_CONF_DAO_ACK */
+  ++pos;
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = dao_sequence;
+#if RPL_DAO_SPECIFY_DAG
+  memcpy(buffer + pos, &dag->dag_id, sizeof(dag->dag_id));
+  pos += sizeof(dag->dag_id);
+#endif /* RPL_DAO_SPECIFY_DAG */
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_output_target_option(unsigned char *buffer, int pos,
+                         const uip_ipaddr_t *prefix, uint8_t prefixlen)
+{
+  buffer[pos++] = RPL_OPTION_TARGET;
+  buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = prefixlen;
+  memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
+  pos += ((prefixlen + 7) / CHAR_BIT);
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+#if DAO_AGGREGATION
 static void
-dao_input(void)
+dao_aggregate_flush(void *ptr)
+{
+  struct dao_aggregate_target *t;
+  struct dao_aggregate_target tmp;
+  rpl_instance_t *instance;
+  rpl_parent_t *parent;
+  unsigned char *buffer;
+  int pos;
+  int i;
+  int j;
+
+  ctimer_stop(&dao_aggregate_timer);
+  instance = dao_aggregate_instance;
+  if(dao_aggregate_num == 0 || instance == NULL ||
+     instance->current_dag == NULL) {
+    dao_aggregate_num = 0;
+    return;
+  }
+  parent = instance->current_dag->preferred_parent;
+  if(parent == NULL || rpl_get_parent_ipaddr(parent) == NULL) {
+    PRINTF("RPL: No parent to send %u aggregated targets to\n",
+           dao_aggregate_num);
+    dao_aggregate_num = 0;
+    return;
+  }
+
+  /* A transit option applies to the targets before it: order the
+     targets by lifetime so that they share as few as possible. */
+  for(i = 1; i < dao_aggregate_num; i++) {
+    tmp = dao_aggregate_targets[i];
+    for(j = i; j > 0 && dao_aggregate_targets[j - 1].lifetime > tmp.lifetime; j--) {
+      dao_aggregate_targets[j] = dao_aggregate_targets[j - 1];
+    }
+    dao_aggregate_targets[j] = tmp;
+  }
+
+  buffer = UIP_ICMP_PAYLOAD;
+  pos = dao_output_header(instance->current_dag, buffer);
+
+  for(i = 0; i < dao_aggregate_num; i++) {
+    t = &dao_aggregate_targets[i];
+    pos = dao_output_target_option(buffer, pos, &t->prefix, t->prefixlen);
+    if(i + 1 == dao_aggregate_num ||
+       dao_aggregate_targets[i + 1].lifetime != t->lifetime) {
+      buffer[pos++] = RPL_OPTION_TRANSIT;
+      buffer[pos++] = 4;
+      buffer[pos++] = 0; /* flags - ignored */
+      buffer[pos++] = 0; /* path control - ignored */
+      buffer[pos++] = 0; /* path seq - ignored */
+      buffer[pos++] = t->lifetime;
+    }
+  }
+
+  PRINTF("RPL: Sending a DAO with %u targets to ", dao_aggregate_num);
+  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  PRINTF("\n");
+
+  dao_aggregate_num = 0;
+  uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_aggregate_room(rpl_instance_t *instance, int targets)
+{
+  if(dao_aggregate_num == 0) {
+    return targets <= RPL_DAO_AGGREGATION_TARGETS;
+  }
+  return instance == dao_aggregate_instance &&
+    dao_aggregate_num + targets <= RPL_DAO_AGGREGATION_TARGETS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_aggregate(rpl_instance_t *instance, const uip_ipaddr_t *prefix,
+              uint8_t prefixlen, uint8_t lifetime)
+{
+  struct dao_aggregate_target *t;
+  int i;
+
+  /* A newer DAO for a target replaces the one waiting */
+  for(i = 0; i < dao_aggregate_num; i++) {
+    t = &dao_aggregate_targets[i];
+    if(t->prefixlen == prefixlen && uip_ipaddr_cmp(&t->prefix, prefix)) {
+      t->lifetime = lifetime;
+      return;
+    }
+  }
+
+  if(dao_aggregate_num == 0) {
+    dao_aggregate_instance = instance;
+    ctimer_set(&dao_aggregate_timer, RPL_DAO_AGGREGATION_DELAY,
+               dao_aggregate_flush, NULL);
+  }
+  t = &dao_aggregate_targets[dao_aggregate_num++];
+  uip_ipaddr_copy(&t->prefix, prefix);
+  t->prefixlen = prefixlen;
+  t->lifetime = lifetime;
+}
+/*---------------------------------------------------------------------------*/
+/* A target forwarded in a newer DAO no longer waits in the older one */
+static void
+dao_aggregate_forget(const uip_ipaddr_t *prefix, uint8_t prefixlen)
+{
+  struct dao_aggregate_target *t;
+  int i;
+
+  for(i = 0; i < dao_aggregate_num; i++) {
+    t = &dao_aggregate_targets[i];
+    if(t->prefixlen == prefixlen && uip_ipaddr_cmp(&t->prefix, prefix)) {
+      *t = dao_aggregate_targets[--dao_aggregate_num];
+      return;
+    }
+  }
+}
+#endif /* DAO_AGGREGATION */
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_GW != 1
+static void
+dao_forward(rpl_dag_t *dag, int length)
+{
+  if(dag->preferred_parent != NULL &&
+     rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
+    PRINTF("RPL: Forwarding DAO to parent ");
+    PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
+    PRINTF("\n");
+    uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
+                   ICMP6_RPL, RPL_CODE_DAO, length);
+  }
+}
+#endif /* UIP_CONF_GW != 1 */
+/*---------------------------------------------------------------------------*/
+static uint8_t
+dao_target_lifetime(const unsigned char *buffer, int pos, int buffer_length,
+                    uint8_t lifetime)
+{
+  int len;
+
+  /* The first transit option after a target holds its lifetime */
+  for(; pos < buffer_length; pos += len) {
+    if(buffer[pos] == RPL_OPTION_PAD1) {
+      len = 1;
+      continue;
+    }
+    if(buffer[pos] == RPL_OPTION_TRANSIT) {
+      /* The path sequence and control are ignored. */
+      return buffer[pos + 5];
+    }
+    len = 2 + buffer[pos + 1];
+  }
+  return lifetime;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Updates the route to one target of a DAO. Returns 1 if the target
+ * goes on to our parent, 0 if it is ignored and -1 if the route could
+ * not be added.
+ */
+static int
+dao_target_input(rpl_instance_t *instance, rpl_parent_t *parent,
+                 uip_ipaddr_t *prefix, uint8_t prefixlen, uint8_t lifetime,
+                 uip_ipaddr_t *dao_sender_addr, int learned_from)
+{
+  rpl_dag_t *dag;
+  uip_ds6_route_t *rep;
+
+  dag = instance->current_dag;
+
+  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+          (unsigned)lifetime, (unsigned)prefixlen);
+  PRINT6ADDR(prefix);
+  PRINTF("\n");
+
+#if RPL_CONF_MULTICAST
+  if(uip_is_addr_mcast_global(prefix)) {
+    mcast_group = uip_mcast6_route_add(prefix);
+    if(mcast_group) {
+      mcast_group->dag = dag;
+      mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+    }
+    return 1;
+  }
+#endif
+
+  rep = uip_ds6_route_lookup(prefix);
+
+  if(lifetime == RPL_ZERO_LIFETIME) {
+    PRINTF("RPL: No-Path DAO received\n");
+    /* No-Path DAO received; invoke the route purging routine. */
+    if(rep != NULL &&
+       rep->state.nopath_received == 0 &&
+       rep->length == prefixlen &&
+       uip_ds6_route_nexthop(rep) != NULL &&
+       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), dao_sender_addr)) {
+      PRINTF("RPL: Setting expiration timer for prefix ");
+      PRINT6ADDR(prefix);
+      PRINTF("\n");
+      rep->state.nopath_received = 1;
+      rpl_set_route_lifetime(rep, DAO_EXPIRATION_TIMEOUT);
+      /* We receive the no-path DAO and delete the corresponding nbr in gw-nbr-cache, if we are GW. */
+#if UIP_CONF_GW == 1
+      gw_nbr_delete(prefix);
+#endif
+      return 1;
+    }
+    return 0;
+  }
+
+  PRINTF("RPL: adding DAO route\n");
+
+  rpl_lock_parent(parent);
+
+  rep = rpl_add_route(dag, prefix, prefixlen, dao_sender_addr);
+  if(rep == NULL) {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+    return -1;
+  }
+
+  rpl_set_route_lifetime(rep, RPL_LIFETIME(instance, lifetime));
+  rep->state.learned_from = learned_from;
+
+  /* We receive an DAO and add the corresponding nbr in gw-nbr-cache, if we are GW. */
+#if UIP_CONF_GW == 1
+  gw_nbr_add(prefix);
+#endif
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* A parent sent us a DAO, so it routes through us: it is poisoned and
+   our rank recalculated without it */
+static void
+dao_loop_detected(rpl_parent_t *parent)
+{
+  parent->rank = INFINITE_RANK;
+  rpl_parent_updated(parent);
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_input_storing(void)
 {
   uip_ipaddr_t dao_sender_addr;
   rpl_dag_t *dag;
@@ -819,22 +1301,21 @@ dao_input(void)
   uint8_t lifetime;
   uint8_t prefixlen;
   uint8_t flags;
-  uint8_t subopt_type;
-  /*
-  uint8_t pathcontrol;
-  uint8_t pathsequence;
-  */
   uip_ipaddr_t prefix;
-  uip_ds6_route_t *rep;
   uint8_t buffer_length;
   int pos;
   int len;
   int i;
   int learned_from;
+  int nbr_added;
+  int forward;
+#if DAO_AGGREGATION
+  int aggregate;
+  int targets;
+  uip_buf_t *saved;
+#endif /* DAO_AGGREGATION */
   rpl_parent_t *parent;
-  uip_ds6_nbr_t *nbr;
 
-  prefixlen = 0;
   parent = NULL;
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
@@ -858,8 +1339,6 @@ dao_input(void)
     return;
   }
 
-  lifetime = instance->default_lifetime;
-
   flags = buffer[pos++];
   /* reserved */
   pos++;
@@ -890,16 +1369,189 @@ dao_input(void)
        DAG_RANK(parent->rank, instance) < DAG_RANK(dag->rank, instance)) {
       PRINTF("RPL: Loop detected when receiving a unicast DAO from a node with a lower rank! (%u < %u)\n",
           DAG_RANK(parent->rank, instance), DAG_RANK(dag->rank, instance));
-      parent->rank = INFINITE_RANK;
-      parent->flags |= RPL_PARENT_FLAG_UPDATED;
+      dao_loop_detected(parent);
       return;
     }
 
     /* If we get the DAO from our parent, we also have a loop. */
     if(parent != NULL && parent == dag->preferred_parent) {
       PRINTF("RPL: Loop detected when receiving a unicast DAO from our parent\n");
-      parent->rank = INFINITE_RANK;
-      parent->flags |= RPL_PARENT_FLAG_UPDATED;
+      dao_loop_detected(parent);
+      uip_len = 0;
+      return;
+    }
+  }
+
+#if DAO_AGGREGATION
+  /* The targets wait for the DAO we send to our parent if they all fit
+     in it; the DAO of a child is never split. */
+  targets = 0;
+  for(i = pos; i < buffer_length; i += len) {
+    if(buffer[i] == RPL_OPTION_PAD1) {
+      len = 1;
+      continue;
+    }
+    if(buffer[i] == RPL_OPTION_TARGET) {
+      targets++;
+    }
+    len = 2 + buffer[i + 1];
+  }
+  aggregate = learned_from == RPL_ROUTE_FROM_UNICAST_DAO &&
+    dag->preferred_parent != NULL && dao_aggregate_room(instance, targets);
+#endif /* DAO_AGGREGATION */
+
+  nbr_added = 0;
+  forward = 0;
+  /* Check if there are any RPL options present. */
+  for(i = pos; i < buffer_length; i += len) {
+    if(buffer[i] == RPL_OPTION_PAD1) {
+      len = 1;
+      continue;
+    }
+    /* The option consists of a two-byte header and a payload. */
+    len = 2 + buffer[i + 1];
+    if(buffer[i] != RPL_OPTION_TARGET) {
+      continue;
+    }
+
+    /* Handle the target option. */
+    prefixlen = buffer[i + 3];
+    memset(&prefix, 0, sizeof(prefix));
+    memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
+    lifetime = dao_target_lifetime(buffer, i + len, buffer_length,
+                                   instance->default_lifetime);
+
+    if(!nbr_added && !uip_is_addr_mcast_global(&prefix)) {
+      if(dao_add_neighbor(&dao_sender_addr) == 0) {
+        uip_len = 0;
+        return;
+      }
+      nbr_added = 1;
+    }
+
+    switch(dao_target_input(instance, parent, &prefix, prefixlen, lifetime,
+                            &dao_sender_addr, learned_from)) {
+    case -1:
+      uip_len = 0;
+      return;
+    case 1:
+      forward = 1;
+#if DAO_AGGREGATION
+      if(aggregate) {
+        dao_aggregate(instance, &prefix, prefixlen, lifetime);
+      } else {
+        dao_aggregate_forget(&prefix, prefixlen);
+      }
+#endif /* DAO_AGGREGATION */
+      break;
+    }
+  }
+
+  if(forward && learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+#if DAO_AGGREGATION
+    if(!aggregate) {
+      if(dao_aggregate_num > 0) {
+        /* The targets did not fit in the waiting DAO, which is older
+           and goes first. It is built in a spare buffer, this DAO stays
+           in its own. */
+        saved = uip_bufpool_take();
+        if(saved != NULL) {
+          dao_aggregate_flush(NULL);
+          uip_bufpool_give(saved);
+        } else {
+          /* No spare buffer: the waiting DAO follows this one. It no
+             longer holds any target of this DAO, the order does not
+             matter. */
+          ctimer_set(&dao_aggregate_timer, 0, dao_aggregate_flush, NULL);
+        }
+      }
+      dao_forward(dag, buffer_length);
+    }
+#elif UIP_CONF_GW != 1
+    dao_forward(dag, buffer_length);
+#endif
+    /* The child gets one acknowledgement for all its targets; an
+       aggregated DAO is acknowledged to us as a whole. */
+    if(flags & RPL_DAO_K_FLAG) {
+      dao_ack_output(instance, &dao_sender_addr, sequence);
+    }
+  }
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+static void
+dao_input_nonstoring(void)
+{
+  uip_ipaddr_t dao_sender_addr;
+  uip_ipaddr_t dao_parent_addr;
+  rpl_dag_t *dag;
+  rpl_instance_t *instance;
+  unsigned char *buffer;
+  uint16_t sequence;
+  uint8_t instance_id;
+  uint8_t lifetime;
+  uint8_t prefixlen;
+  uint8_t flags;
+  uint8_t subopt_type;
+  uip_ipaddr_t prefix;
+  uint8_t buffer_length;
+  int from_child;
+  int pos;
+  int len;
+  int i;
+  rpl_parent_t *parent;
+
+  prefixlen = 0;
+  memset(&prefix, 0, sizeof(prefix));
+  memset(&dao_parent_addr, 0, sizeof(dao_parent_addr));
+
+  uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
+
+  PRINTF("RPL: Received a non-storing DAO from ");
+  PRINT6ADDR(&dao_sender_addr);
+  PRINTF("\n");
+
+  buffer = UIP_ICMP_PAYLOAD;
+  buffer_length = uip_len - uip_l3_icmp_hdr_len;
+
+  pos = 0;
+  instance_id = buffer[pos++];
+  instance = rpl_get_instance(instance_id);
+  lifetime = instance->default_lifetime;
+
+  flags = buffer[pos++];
+  /* reserved */
+  pos++;
+  sequence = buffer[pos++];
+
+  dag = instance->current_dag;
+  /* Is the DAG ID present? */
+  if(flags & RPL_DAO_D_FLAG) {
+    if(memcmp(&dag->dag_id, &buffer[pos], sizeof(dag->dag_id))) {
+      PRINTF("RPL: Ignoring a DAO for a DAG different from ours\n");
+      uip_len = 0;
+      return;
+    }
+    pos += 16;
+  }
+
+  /* A child sends its DAO to our link-local address, the DAOs we
+     relay towards the root come from global addresses. */
+  from_child = uip_is_addr_link_local(&dao_sender_addr);
+  if(from_child) {
+    /* If we get the DAO from our parent, we have a loop. */
+    parent = rpl_find_parent(dag, &dao_sender_addr);
+    if(parent != NULL && parent == dag->preferred_parent) {
+      PRINTF("RPL: Loop detected when receiving a unicast DAO from our parent\n");
+      dao_loop_detected(parent);
+      uip_len = 0;
+      return;
+    }
+
+    /* The child is reached through its link-local address, we keep
+       no route to it. */
+    if(dao_add_neighbor(&dao_sender_addr) == 0) {
       uip_len = 0;
       return;
     }
@@ -923,11 +1575,10 @@ dao_input(void)
       memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
       break;
     case RPL_OPTION_TRANSIT:
-      /* The path sequence and control are ignored. */
-      /*      pathcontrol = buffer[i + 3];
-              pathsequence = buffer[i + 4];*/
       lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
+      if(buffer[i + 1] >= 4 + sizeof(dao_parent_addr)) {
+        memcpy(&dao_parent_addr, buffer + i + 6, sizeof(dao_parent_addr));
+      }
       break;
     }
   }
@@ -935,127 +1586,66 @@ dao_input(void)
   PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
           (unsigned)lifetime, (unsigned)prefixlen);
   PRINT6ADDR(&prefix);
+  PRINTF(" parent: ");
+  PRINT6ADDR(&dao_parent_addr);
   PRINTF("\n");
 
-#if RPL_CONF_MULTICAST
-  if(uip_is_addr_mcast_global(&prefix)) {
-    mcast_group = uip_mcast6_route_add(&prefix);
-    if(mcast_group) {
-      mcast_group->dag = dag;
-      mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+  if(dag->rank == ROOT_RANK(instance)) {
+    if(uip_is_addr_unspecified(&dao_parent_addr)) {
+      PRINTF("RPL: Non-storing DAO without parent address\n");
+      uip_len = 0;
+      return;
     }
-    goto fwd_dao;
-  }
-#endif
-
-  if((nbr = uip_ds6_nbr_lookup(&dao_sender_addr)) == NULL) {
-    if((nbr = uip_ds6_nbr_add(&dao_sender_addr,
-                              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
-                              0, NBR_REACHABLE)) != NULL) {
-      /* set reachable timer */
-      stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
-      PRINTF("RPL-ND: Neighbor added to neighbor cache ");
-      PRINT6ADDR(&dao_sender_addr);
-      PRINTF(", ");
-      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-      PRINTF("\n");
-    } else {
-      PRINTF("RPL-ND: Out of Memory, dropping DAO from ");
-      PRINT6ADDR(&dao_sender_addr);
-      PRINTF(", ");
-      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-      PRINTF("\n");
+    if(rpl_ns_update_node(dag, &prefix, &dao_parent_addr,
+                          RPL_LIFETIME(instance, lifetime)) == NULL &&
+       lifetime != RPL_ZERO_LIFETIME) {
+      RPL_STAT(rpl_stats.mem_overflows++);
       uip_len = 0;
       return;
     }
-  } else {
-    PRINTF("RPL-ND: Neighbor already in neighbor cache\n");
-	nbr->state = NBR_REACHABLE;
-	stimer_reset(&nbr->reachable);
-  }
-
-  rep = uip_ds6_route_lookup(&prefix);
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n");
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL &&
-       rep->state.nopath_received == 0 &&
-       rep->length == prefixlen &&
-       uip_ds6_route_nexthop(rep) != NULL &&
-       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &dao_sender_addr)) {
-      PRINTF("RPL: Setting expiration timer for prefix ");
-      PRINT6ADDR(&prefix);
-      PRINTF("\n");
-      rep->state.nopath_received = 1;
-      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
-	  
-
-     /* We forward the incoming no-path DAO to our parent, if we have
-         one. */
-	#if UIP_CONF_GW != 1
-      if(dag->preferred_parent != NULL &&
-         rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-        PRINTF("RPL: Forwarding no-path DAO to parent ");
-        PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-        PRINTF("\n");
-        uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                       ICMP6_RPL, RPL_CODE_DAO, buffer_length);
-      }
-	 #endif 
-      if(flags & RPL_DAO_K_FLAG) {
-        dao_ack_output(instance, &dao_sender_addr, sequence);
-      }
-	  	 /* We receive the no-path DAO and delete the corresponding nbr in gw-nbr-cache, if we are GW. */ 
-	#if UIP_CONF_GW == 1
-		gw_nbr_delete(&prefix);
-	#endif	  
+    if(from_child && (flags & RPL_DAO_K_FLAG)) {
+      dao_ack_output(instance, &dao_sender_addr, sequence);
     }
+    uip_len = 0;
     return;
   }
 
-  PRINTF("RPL: adding DAO route\n");
-
-
-  rpl_lock_parent(parent);
+  /* Relay the DAO to the root. We acknowledge it to the child
+     ourselves, the root would have to route the acknowledgement. */
+  if(from_child) {
+    buffer[1] &= ~RPL_DAO_K_FLAG;
+  }
+  PRINTF("RPL: Relaying DAO to the root ");
+  PRINT6ADDR(&dag->dag_id);
+  PRINTF("\n");
+  uip_icmp6_send(&dag->dag_id, ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+  if(from_child && (flags & RPL_DAO_K_FLAG)) {
+    dao_ack_output(instance, &dao_sender_addr, sequence);
+  }
+  uip_len = 0;
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+static void
+dao_input(void)
+{
+  rpl_instance_t *instance;
 
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+  instance = rpl_get_instance(UIP_ICMP_PAYLOAD[0]);
+  if(instance == NULL) {
+    PRINTF("RPL: Ignoring a DAO for an unknown RPL instance(%u)\n",
+           UIP_ICMP_PAYLOAD[0]);
     uip_len = 0;
     return;
   }
 
-
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  rep->state.learned_from = learned_from;
-  
-    /* We receive an DAO and add the corresponding nbr in gw-nbr-cache, if we are GW. */ 
-	#if UIP_CONF_GW == 1
-	gw_nbr_add(&prefix);
-	#endif
-
-#if RPL_CONF_MULTICAST
-fwd_dao:
-#endif
-
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-#if UIP_CONF_GW != 1
-    if(dag->preferred_parent != NULL &&
-       rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-      PRINTF("RPL: Forwarding DAO to parent ");
-      PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-      PRINTF("\n");
-      uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                     ICMP6_RPL, RPL_CODE_DAO, buffer_length);
-    }
-#endif
-    if(flags & RPL_DAO_K_FLAG) {
-      dao_ack_output(instance, &dao_sender_addr, sequence);
-    }
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    dao_input_nonstoring();
+    return;
   }
-  uip_len = 0;
+#endif /* RPL_WITH_NON_STORING */
+  dao_input_storing();
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -1114,43 +1704,48 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
   RPL_DEBUG_DAO_OUTPUT(parent);
 #endif
 
-  buffer = UIP_ICMP_PAYLOAD;
-
-  RPL_LOLLIPOP_INCREMENT(dao_sequence);
-  pos = 0;
+#if DAO_AGGREGATION
+  /* Our own target joins the targets of our children that are
+     waiting to be sent to the same parent */
+  if(lifetime != RPL_ZERO_LIFETIME && dao_aggregate_num > 0 &&
+     parent == dag->preferred_parent && dag == instance->current_dag &&
+     dao_aggregate_room(instance, 1)) {
+    PRINTF("RPL: Adding own target to the aggregated DAO\n");
+    dao_aggregate(instance, prefix, sizeof(*prefix) * CHAR_BIT, lifetime);
+    return;
+  }
+#endif /* DAO_AGGREGATION */
 
-  buffer[pos++] = instance->instance_id;
-  buffer[pos] = 0;
-#if RPL_DAO_SPECIFY_DAG
-  buffer[pos] |= RPL_DAO_D_FLAG;
-#endif /* RPL_DAO_SPECIFY_DAG */
-#if RPL_CONF_DAO_ACK
-  buffer[pos] |= RPL_DAO_K_FLAG;
-#endif /* RPL_CONF_DAO_ACK */
-  ++pos;
-  buffer[pos++] = 0; /* reserved */
-  buffer[pos++] = dao_sequence;
-#if RPL_DAO_SPECIFY_DAG
-  memcpy(buffer + pos, &dag->dag_id, sizeof(dag->dag_id));
-  pos+=sizeof(dag->dag_id);
-#endif /* RPL_DAO_SPECIFY_DAG */
+  buffer = UIP_ICMP_PAYLOAD;
+  pos = dao_output_header(dag, buffer);
 
   /* create target subopt */
   prefixlen = sizeof(*prefix) * CHAR_BIT;
-  buffer[pos++] = RPL_OPTION_TARGET;
-  buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
-  buffer[pos++] = 0; /* reserved */
-  buffer[pos++] = prefixlen;
-  memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
-  pos += ((prefixlen + 7) / CHAR_BIT);
+  pos = dao_output_target_option(buffer, pos, prefix, prefixlen);
 
   /* Create a transit information sub-option. */
   buffer[pos++] = RPL_OPTION_TRANSIT;
+#if RPL_WITH_NON_STORING
+  buffer[pos++] = RPL_IS_NON_STORING(instance) ? 4 + 16 : 4;
+#else /* RPL_WITH_NON_STORING */
   buffer[pos++] = 4;
+#endif /* RPL_WITH_NON_STORING */
   buffer[pos++] = 0; /* flags - ignored */
   buffer[pos++] = 0; /* path control - ignored */
   buffer[pos++] = 0; /* path seq - ignored */
   buffer[pos++] = lifetime;
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    /* The root learns the DODAG from the global address of the parent,
+       the parent shares the prefix of the DODAG. */
+    if(rpl_get_parent_ipaddr(parent) == NULL) {
+      return;
+    }
+    memcpy(buffer + pos, &dag->prefix_info.prefix, 8);
+    memcpy(buffer + pos + 8, &rpl_get_parent_ipaddr(parent)->u8[8], 8);
+    pos += 16;
+  }
+#endif /* RPL_WITH_NON_STORING */
 
   PRINTF("RPL: Sending DAO with prefix ");
   PRINT6ADDR(prefix);
@@ -48,6 +48,8 @@
 
 #include "net/rpl/rpl-private.h"
 #include "net/nbr-table.h"
+#include "net/link-stats.h"
+#include "net/packetbuf.h"
 
 #define DEBUG 0
 #include "net/ip/uip-debug.h"
@@ -69,10 +71,6 @@ rpl_of_t rpl_mrhof = {
   1
 };
 
-/* Constants for the ETX moving average */
-#define ETX_SCALE   100
-#define ETX_ALPHA   90
-
 /* Reject parents that have a higher link metric than the following. */
 #define MAX_LINK_METRIC			10
 
@@ -120,8 +118,7 @@ reset(rpl_dag_t *dag)
 static void
 neighbor_link_callback(rpl_parent_t *p, int status, int numtx)
 {
-  uint16_t recorded_etx = 0;
-  uint16_t packet_etx = numtx * RPL_DAG_MC_ETX_DIVISOR;
+  const struct link_stats *stats;
   uint16_t new_etx;
   uip_ds6_nbr_t *nbr = NULL;
 
@@ -131,32 +128,20 @@ neighbor_link_callback(rpl_parent_t *p, int status, int numtx)
     return;
   }
 
-  recorded_etx = nbr->link_metric;
-
-  /* Do not penalize the ETX when collisions or transmission errors occur. */
-  if(status == MAC_TX_OK || status == MAC_TX_NOACK) {
-    if(status == MAC_TX_NOACK) {
-      packet_etx = MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
-    }
-
-    if(p->flags & RPL_PARENT_FLAG_LINK_METRIC_VALID) {
-      /* We already have a valid link metric, use weighted moving average to update it */
-      new_etx = ((uint32_t)recorded_etx * ETX_ALPHA +
-                 (uint32_t)packet_etx * (ETX_SCALE - ETX_ALPHA)) / ETX_SCALE;
-    } else {
-      /* We don't have a valid link metric, set it to the current packet's ETX */
-      new_etx = packet_etx;
-      /* Set link metric as valid */
-      p->flags |= RPL_PARENT_FLAG_LINK_METRIC_VALID;
-    }
-
-    PRINTF("RPL: ETX changed from %u to %u (packet ETX = %u)\n",
-        (unsigned)(recorded_etx / RPL_DAG_MC_ETX_DIVISOR),
-        (unsigned)(new_etx  / RPL_DAG_MC_ETX_DIVISOR),
-        (unsigned)(packet_etx / RPL_DAG_MC_ETX_DIVISOR));
-    /* update the link metric for this nbr */
-    nbr->link_metric = new_etx;
+  /* The link statistics already account for this transmission */
+  stats = link_stats_from_lladdr(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  if(stats == NULL) {
+    return;
   }
+
+  new_etx = (uint32_t)stats->etx * RPL_DAG_MC_ETX_DIVISOR /
+    LINK_STATS_ETX_DIVISOR;
+  PRINTF("RPL: ETX changed from %u to %u\n",
+      (unsigned)(nbr->link_metric / RPL_DAG_MC_ETX_DIVISOR),
+      (unsigned)(new_etx / RPL_DAG_MC_ETX_DIVISOR));
+  /* update the link metric for this nbr */
+  nbr->link_metric = new_etx;
+  p->flags |= RPL_PARENT_FLAG_LINK_METRIC_VALID;
 }
 
 static rpl_rank_t
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         The DODAG of a non-storing RPL root. Every node the root has
+ *         heard a DAO from has a link to its parent; a node that is only
+ *         known as a parent has no link of its own until its DAO comes.
+ *         A node is reachable if following the links ends at the root.
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/rpl/rpl-private.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#define DEBUG 0
+#include "net/ip/uip-debug.h"
+
+#include <string.h>
+
+#if RPL_WITH_NON_STORING
+
+LIST(nodelist);
+MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+
+static int num_nodes;
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_init(void)
+{
+  num_nodes = 0;
+  memb_init(&nodememb);
+  list_init(nodelist);
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_num_nodes(void)
+{
+  return num_nodes;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *l;
+
+  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+    if(l->dag == dag &&
+       uip_ipaddr_prefixcmp(&dag->prefix_info.prefix, addr, 64) &&
+       memcmp(l->link_identifier, &addr->u8[8], sizeof(l->link_identifier)) == 0) {
+      return l;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t *
+add_node(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *l;
+
+  l = memb_alloc(&nodememb);
+  if(l == NULL) {
+    return NULL;
+  }
+  l->dag = dag;
+  l->lifetime = 0;
+  l->parent = NULL;
+  memcpy(l->link_identifier, &addr->u8[8], sizeof(l->link_identifier));
+  list_add(nodelist, l);
+  num_nodes++;
+  return l;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                   const uip_ipaddr_t *parent, uint32_t lifetime)
+{
+  rpl_ns_node_t *child_node;
+  rpl_ns_node_t *parent_node;
+
+  child_node = rpl_ns_get_node(dag, child);
+  parent_node = rpl_ns_get_node(dag, parent);
+
+  if(lifetime == 0) {
+    /* No-Path DAO: drop the link if it still is the one advertised */
+    if(child_node != NULL && child_node->parent == parent_node) {
+      child_node->lifetime = 0;
+      child_node->parent = NULL;
+    }
+    return child_node;
+  }
+
+  if(child_node == NULL) {
+    child_node = add_node(dag, child);
+    if(child_node == NULL) {
+      PRINTF("RPL: no room for DODAG node ");
+      PRINT6ADDR(child);
+      PRINTF("\n");
+      return NULL;
+    }
+  }
+  if(parent_node == NULL) {
+    parent_node = add_node(dag, parent);
+    if(parent_node == NULL) {
+      PRINTF("RPL: no room for DODAG node ");
+      PRINT6ADDR(parent);
+      PRINTF("\n");
+      child_node->parent = NULL;
+      return NULL;
+    }
+  }
+
+  child_node->parent = parent_node;
+  child_node->lifetime = lifetime;
+
+  PRINTF("RPL: DODAG link ");
+  PRINT6ADDR(child);
+  PRINTF(" -> ");
+  PRINT6ADDR(parent);
+  PRINTF(" (%lu s)\n", (unsigned long)lifetime);
+  return child_node;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_is_root(const rpl_ns_node_t *node)
+{
+  return memcmp(node->link_identifier, &node->dag->dag_id.u8[8],
+                sizeof(node->link_identifier)) == 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_path_len(const rpl_ns_node_t *node)
+{
+  int hops;
+
+  /* Stale links may form a loop: no path is longer than the table */
+  for(hops = 0; node != NULL && hops <= RPL_NS_LINK_NUM; hops++) {
+    if(rpl_ns_is_root(node)) {
+      return hops;
+    }
+    node = node->parent;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node)
+{
+  memcpy(addr, &node->dag->prefix_info.prefix, 8);
+  memcpy(&addr->u8[8], node->link_identifier, sizeof(node->link_identifier));
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_node(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t *l;
+
+  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+    if(l->parent == node) {
+      l->parent = NULL;
+    }
+  }
+  list_remove(nodelist, node);
+  memb_free(&nodememb, node);
+  num_nodes--;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_remove_dag(const rpl_dag_t *dag)
+{
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
+
+  for(l = list_head(nodelist); l != NULL; l = next) {
+    next = list_item_next(l);
+    if(l->dag == dag) {
+      remove_node(l);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *l2;
+  rpl_ns_node_t *next;
+
+  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+    if(l->lifetime > 0 && --l->lifetime == 0) {
+      l->parent = NULL;
+    }
+  }
+
+  /* Nodes without a link of their own stay as long as they are
+     the parent of another node */
+  for(l = list_head(nodelist); l != NULL; l = next) {
+    next = list_item_next(l);
+    if(l->parent == NULL) {
+      for(l2 = list_head(nodelist); l2 != NULL; l2 = list_item_next(l2)) {
+        if(l2->parent == l) {
+          break;
+        }
+      }
+      if(l2 == NULL) {
+        remove_node(l);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RPL_WITH_NON_STORING */
+
+/** @}*/
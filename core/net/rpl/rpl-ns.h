@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         The DODAG of a non-storing RPL root: one child to parent link
+ *         per node, learned from the transit option of the DAOs.
+ */
+
+#ifndef RPL_NS_H
+#define RPL_NS_H
+
+#include "net/rpl/rpl-conf.h"
+
+typedef struct rpl_ns_node {
+  struct rpl_ns_node *next;
+  /* Remaining lifetime of the link to the parent, in seconds */
+  uint32_t lifetime;
+  rpl_dag_t *dag;
+  /* The interface identifier of the node: the addresses of the nodes
+     of a DODAG share the prefix of the DODAG */
+  unsigned char link_identifier[8];
+  struct rpl_ns_node *parent;
+} rpl_ns_node_t;
+
+void rpl_ns_init(void);
+int rpl_ns_num_nodes(void);
+rpl_ns_node_t *rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
+rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                                  const uip_ipaddr_t *parent, uint32_t lifetime);
+int rpl_ns_is_root(const rpl_ns_node_t *node);
+int rpl_ns_path_len(const rpl_ns_node_t *node);
+void rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node);
+void rpl_ns_remove_dag(const rpl_dag_t *dag);
+void rpl_ns_periodic(void);
+
+#endif /* RPL_NS_H */
@@ -89,6 +89,8 @@
 #define RPL_OPTION_TARGET_DESC           9
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
 #define RPL_OPTION_SRC_INFO             10
+#define RPL_OPTION_SRC_INFO_RANGES      11
+#define RPL_OPTION_SRC_INFO_BLOOM       12
 #endif
 
 #define RPL_DAO_K_FLAG                   0x80 /* DAO ACK requested */
@@ -113,6 +115,27 @@
 #define RPL_DAO_LATENCY                 (CLOCK_SECOND * 4)
 #endif /* RPL_DAO_LATENCY */
 
+/* How long a router holds the targets of the DAOs of its children
+   before it sends them to its parent in one DAO. 0 forwards every
+   DAO as soon as it is received. A DAO whose targets do not fit is
+   forwarded as is, after the waiting DAO: the parent must see the
+   older targets first. An aggregated DAO asks for an acknowledgement
+   like any other, but no one waits for it: a lost one is repaired
+   by the next DAOs of the children, not retransmitted. */
+#ifdef RPL_CONF_DAO_AGGREGATION_DELAY
+#define RPL_DAO_AGGREGATION_DELAY       RPL_CONF_DAO_AGGREGATION_DELAY
+#else /* RPL_CONF_DAO_AGGREGATION_DELAY */
+#define RPL_DAO_AGGREGATION_DELAY       0
+#endif /* RPL_CONF_DAO_AGGREGATION_DELAY */
+
+/* The number of targets in an aggregated DAO. Four targets and
+   their transit option fit in one 802.15.4 frame. */
+#ifdef RPL_CONF_DAO_AGGREGATION_TARGETS
+#define RPL_DAO_AGGREGATION_TARGETS     RPL_CONF_DAO_AGGREGATION_TARGETS
+#else /* RPL_CONF_DAO_AGGREGATION_TARGETS */
+#define RPL_DAO_AGGREGATION_TARGETS     4
+#endif /* RPL_CONF_DAO_AGGREGATION_TARGETS */
+
 /* Special value indicating immediate removal. */
 #define RPL_ZERO_LIFETIME               0
 
@@ -166,6 +189,16 @@
 #endif /* UIP_IPV6_MULTICAST_RPL */
 #endif /* RPL_CONF_MOP */
 
+/* Non-storing mode: the root keeps the DODAG and source-routes
+   downward packets, routers keep no downward routes */
+#define RPL_WITH_NON_STORING            (RPL_MOP_DEFAULT == RPL_MOP_NON_STORING)
+#define RPL_IS_NON_STORING(instance) \
+          (RPL_WITH_NON_STORING && (instance) != NULL && \
+           (instance)->mop == RPL_MOP_NON_STORING)
+
+/* Routing type of the RPL Source Routing Header (RFC 6554) */
+#define RPL_RH_TYPE_SRH                 3
+
 /* Emit a pre-processor error if the user configured multicast with bad MOP */
 #if RPL_CONF_MULTICAST && (RPL_MOP_DEFAULT != RPL_MOP_STORING_MULTICAST)
 #error "RPL Multicast requires RPL_MOP_DEFAULT==3. Check contiki-conf.h"
@@ -269,6 +302,10 @@ extern rpl_instance_t *default_instance;
 
 /* ICMPv6 functions for RPL. */
 void dis_output(uip_ipaddr_t *addr);
+#if RPL_DIS_SEND && UIP_DS6_SOLICIT_TRICKLE && UIP_ND6_ENGINE != UIP_ND6_ENGINE_RPL
+/* A DIS from a neighbor without a DAG either holds back our own */
+void rpl_dis_overheard(void);
+#endif
 void dio_output(rpl_instance_t *, uip_ipaddr_t *uc_addr);
 void dao_output(rpl_parent_t *, uint8_t lifetime);
 void dao_output_target(rpl_parent_t *, uip_ipaddr_t *, uint8_t lifetime);
@@ -298,12 +335,14 @@ void rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *paren
 rpl_parent_t *rpl_select_parent(rpl_dag_t *dag);
 rpl_dag_t *rpl_select_dag(rpl_instance_t *instance,rpl_parent_t *parent);
 void rpl_recalculate_ranks(void);
+void rpl_parent_updated(rpl_parent_t *p);
 
 /* RPL routing table functions. */
 void rpl_remove_routes(rpl_dag_t *dag);
 void rpl_remove_routes_by_nexthop(uip_ipaddr_t *nexthop, rpl_dag_t *dag);
 uip_ds6_route_t *rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix,
                                int prefix_len, uip_ipaddr_t *next_hop);
+void rpl_set_route_lifetime(uip_ds6_route_t *rep, unsigned long lifetime);
 void rpl_purge_routes(void);
 
 /* Lock a parent in the neighbor cache. */
@@ -317,6 +356,7 @@ void rpl_schedule_dao(rpl_instance_t *);
 void rpl_schedule_dao_immediately(rpl_instance_t *);
 void rpl_cancel_dao(rpl_instance_t *instance);
 void rpl_schedule_probing(rpl_instance_t *instance);
+void rpl_schedule_rank_recalculation(void);
 
 void rpl_reset_dio_timer(rpl_instance_t *);
 void rpl_reset_periodic_timer(void);
@@ -327,4 +367,8 @@ void rpl_poison_routes(rpl_dag_t *, rpl_parent_t *);
 
 rpl_instance_t *rpl_get_default_instance(void);
 
+#if RPL_WITH_NON_STORING
+#include "net/rpl/rpl-ns.h"
+#endif /* RPL_WITH_NON_STORING */
+
 #endif /* RPL_PRIVATE_H */
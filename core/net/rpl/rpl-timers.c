@@ -60,14 +60,12 @@
 
 /*---------------------------------------------------------------------------*/
 static struct ctimer periodic_timer;
+static struct ctimer rank_timer;
 
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
 #if RPL_DIS_SEND
-static uint8_t discount; 
 static uint8_t root_start_dio = 0;
 struct stimer root_start_dio_stimer;
-static uint8_t dis_count;
-static uint8_t dis_timeout;
 #endif
 #endif
 
@@ -76,10 +74,37 @@ static void new_dio_interval(rpl_instance_t *instance);
 static void handle_dio_timer(void *ptr);
 
 static uint16_t next_dis;
+#if UIP_DS6_SOLICIT_TRICKLE
+static struct uip_ds6_solicit dis_solicit;
+#endif
 
 /* dio_send_ok is true if the node is ready to send DIOs */
 static uint8_t dio_send_ok;
 
+/*---------------------------------------------------------------------------*/
+#if RPL_DIS_SEND && UIP_DS6_SOLICIT_TRICKLE
+static void
+dis_send(void)
+{
+  dis_output(NULL);
+}
+/*---------------------------------------------------------------------------*/
+static int
+dis_done(void)
+{
+  return rpl_get_any_dag() != NULL;
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_ND6_ENGINE != UIP_ND6_ENGINE_RPL
+/* RPL-ND DIOs list the node IDs of the DIS they answer: every node has to
+ * solicit for itself, so the RPL engine paces DIS but never suppresses them */
+void
+rpl_dis_overheard(void)
+{
+  uip_ds6_solicit_heard(&dis_solicit);
+}
+#endif /* !UIP_ND6_ENGINE_RPL */
+#endif /* RPL_DIS_SEND && UIP_DS6_SOLICIT_TRICKLE */
 /*---------------------------------------------------------------------------*/
 static void
 handle_periodic_timer(void *ptr)
@@ -89,20 +114,33 @@ handle_periodic_timer(void *ptr)
   #endif
 
   rpl_purge_routes();
-  rpl_recalculate_ranks();
+#if RPL_WITH_NON_STORING
+  rpl_ns_periodic();
+#endif /* RPL_WITH_NON_STORING */
 
   /* handle DIS */
 #if RPL_DIS_SEND
+#if UIP_DS6_SOLICIT_TRICKLE
+  if(rpl_get_any_dag() == NULL && !uip_ds6_solicit_running(&dis_solicit)) {
+    uip_ds6_solicit_start(&dis_solicit, dis_send, dis_done);
+  }
+#else /* UIP_DS6_SOLICIT_TRICKLE */
   next_dis++;
   if(rpl_get_any_dag() == NULL && next_dis >= RPL_DIS_INTERVAL) {
     next_dis = 0; 
     dis_output(NULL);
   }
+#endif /* UIP_DS6_SOLICIT_TRICKLE */
 #endif
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
-  instance = (rpl_instance_t *)ptr;
-
- if(root_start_dio == 0 && stimer_expired(&root_start_dio_stimer)){
+  /* The periodic timer carries no instance; only the root, which arms
+     root_start_dio_stimer in rpl_set_root(), starts its DIO timer here */
+  instance = default_instance;
+
+ if(root_start_dio == 0 && instance != NULL &&
+    instance->current_dag != NULL &&
+    instance->current_dag->rank == ROOT_RANK(instance) &&
+    stimer_expired(&root_start_dio_stimer)){
 	rpl_reset_dio_timer(instance);
 	root_start_dio = 1;
   }
@@ -214,6 +252,22 @@ rpl_reset_periodic_timer(void)
   ctimer_set(&periodic_timer, CLOCK_SECOND, handle_periodic_timer, NULL);
 }
 /*---------------------------------------------------------------------------*/
+static void
+handle_rank_timer(void *ptr)
+{
+  rpl_recalculate_ranks();
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_schedule_rank_recalculation(void)
+{
+  /* Ranks are recalculated from a timer, not from the caller that may be
+     deep down the stack (link-layer callback, DIO input) */
+  if(ctimer_expired(&rank_timer)) {
+    ctimer_set(&rank_timer, 0, handle_rank_timer, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
 /* Resets the DIO timer in the instance to its minimal interval. */
 void
 rpl_reset_dio_timer(rpl_instance_t *instance)
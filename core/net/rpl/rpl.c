@@ -76,11 +76,9 @@ static enum rpl_mode mode = RPL_MODE_MESH;
 /*---------------------------------------------------------------------------*/
 #if UIP_ND6_ENGINE == UIP_ND6_ENGINE_RPL
 
+/* Node IDs to acknowledge in the next DIO, in increasing order */
 LIST(rpl_sourceinfo_list);
-//MEMB(rpl_sourceinfo_mem, rpl_sourceinfo, 5);
-static char rpl_sourceinfo_mem_memb_count[5];
-static struct rpl_sourceinfo rpl_sourceinfo_mem_memb_mem[5];
-static struct memb rpl_sourceinfo_mem = {sizeof(rpl_sourceinfo_t), 5, rpl_sourceinfo_mem_memb_count, (void *)rpl_sourceinfo_mem_memb_mem};
+MEMB(rpl_sourceinfo_mem, rpl_sourceinfo_t, RPL_SOURCEINFO_NUM);
 
 
 void
@@ -111,25 +109,38 @@ rpl_sourceinfo_list_next(struct rpl_sourceinfo *rpl_sourceinfo_item){
 
 struct rpl_sourceinfo *
 rpl_sourceinfo_list_add(unsigned short nodeid){
-   struct rpl_sourceinfo *s, *sourceinfonew;
+   struct rpl_sourceinfo *s, *prev, *sourceinfonew;
+   prev = NULL;
    for(s = rpl_sourceinfo_list_head(); s != NULL; s = rpl_sourceinfo_list_next(s)){
     	if(s->nodeID == nodeid)
 		return NULL;
+	if(s->nodeID > nodeid)
+		break;
+	prev = s;
     }		  
     sourceinfonew = memb_alloc(&rpl_sourceinfo_mem);
+    if(sourceinfonew == NULL) {
+      RPL_STAT(rpl_stats.mem_overflows++);
+      return NULL;
+    }
     sourceinfonew->nodeID = nodeid;
-    list_add(rpl_sourceinfo_list, sourceinfonew);
-		  
+    list_insert(rpl_sourceinfo_list, prev, sourceinfonew);
+    return sourceinfonew;
 }
 
 
+void
+rpl_sourceinfo_list_remove(struct rpl_sourceinfo *rpl_sourceinfo_item){
+    list_remove(rpl_sourceinfo_list, rpl_sourceinfo_item);
+    memb_free(&rpl_sourceinfo_mem, rpl_sourceinfo_item);
+}
+
 
 void
 rpl_sourceinfo_list_purge(void){
     struct rpl_sourceinfo *s;
-    for(s = rpl_sourceinfo_list_head(); s != NULL; s = rpl_sourceinfo_list_next(s)){
-    list_remove(rpl_sourceinfo_list, s);
-    memb_free(&rpl_sourceinfo_mem, (struct rpl_sourceinfo *)s);
+    while((s = rpl_sourceinfo_list_head()) != NULL){
+    rpl_sourceinfo_list_remove(s);
     }		  
 }
 
@@ -185,45 +196,22 @@ rpl_purge_routes(void)
   uip_mcast6_route_t *mcast_route;
 #endif
 
-  /* First pass, decrement lifetime */
-  r = uip_ds6_route_head();
-
-  while(r != NULL) {
-    if(r->state.lifetime >= 1) {
-      /*
-       * If a route is at lifetime == 1, set it to 0, scheduling it for
-       * immediate removal below. This achieves the same as the original code,
-       * which would delete lifetime <= 1
-       */
-      r->state.lifetime--;
-    }
-    r = uip_ds6_route_next(r);
-  }
-
-  /* Second pass, remove dead routes */
-  r = uip_ds6_route_head();
-
-  while(r != NULL) {
-    if(r->state.lifetime < 1) {
-      /* Routes with lifetime == 1 have only just been decremented from 2 to 1,
-       * thus we want to keep them. Hence < and not <= */
-      uip_ipaddr_copy(&prefix, &r->ipaddr);
-      uip_ds6_route_rm(r);
-      r = uip_ds6_route_head();
-      PRINTF("No more routes to ");
-      PRINT6ADDR(&prefix);
-      dag = default_instance->current_dag;
-      /* Propagate this information with a No-Path DAO to preferred parent if we are not a RPL Root */
-      if(dag->rank != ROOT_RANK(default_instance)) {
-        PRINTF(" -> generate No-Path DAO\n");
-        dao_output_target(dag->preferred_parent, &prefix, RPL_ZERO_LIFETIME);
-        /* Don't schedule more than 1 No-Path DAO, let next iteration handle that */
-        return;
-      }
-      PRINTF("\n");
-    } else {
-      r = uip_ds6_route_next(r);
+  /* The routes are queued by expiry time, only the expired ones
+     at the head of the queue are looked at */
+  while((r = uip_ds6_route_expired()) != NULL) {
+    uip_ipaddr_copy(&prefix, &r->ipaddr);
+    uip_ds6_route_rm(r);
+    PRINTF("No more routes to ");
+    PRINT6ADDR(&prefix);
+    dag = default_instance->current_dag;
+    /* Propagate this information with a No-Path DAO to preferred parent if we are not a RPL Root */
+    if(dag->rank != ROOT_RANK(default_instance)) {
+      PRINTF(" -> generate No-Path DAO\n");
+      dao_output_target(dag->preferred_parent, &prefix, RPL_ZERO_LIFETIME);
+      /* Don't schedule more than 1 No-Path DAO, let next iteration handle that */
+      return;
     }
+    PRINTF("\n");
   }
 
 #if RPL_CONF_MULTICAST
@@ -272,6 +260,10 @@ rpl_remove_routes(rpl_dag_t *dag)
     }
   }
 #endif
+
+#if RPL_WITH_NON_STORING
+  rpl_ns_remove_dag(dag);
+#endif /* RPL_WITH_NON_STORING */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -293,6 +285,13 @@ rpl_remove_routes_by_nexthop(uip_ipaddr_t *nexthop, rpl_dag_t *dag)
   ANNOTATE("#L %u 0\n", nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
 }
 /*---------------------------------------------------------------------------*/
+void
+rpl_set_route_lifetime(uip_ds6_route_t *rep, unsigned long lifetime)
+{
+  rep->state.lifetime = lifetime;
+  uip_ds6_route_set_lifetime(rep, lifetime);
+}
+/*---------------------------------------------------------------------------*/
 uip_ds6_route_t *
 rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix, int prefix_len,
               uip_ipaddr_t *next_hop)
@@ -305,7 +304,7 @@ rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix, int prefix_len,
   }
 
   rep->state.dag = dag;
-  rep->state.lifetime = RPL_LIFETIME(dag->instance, dag->instance->default_lifetime);
+  rpl_set_route_lifetime(rep, RPL_LIFETIME(dag->instance, dag->instance->default_lifetime));
   rep->state.learned_from = RPL_ROUTE_FROM_INTERNAL;
 
   PRINTF("RPL: Added a route to ");
@@ -334,7 +333,7 @@ rpl_link_neighbor_callback(const linkaddr_t *addr, int status, int numtx)
       if(parent != NULL) {
         /* Trigger DAG rank recalculation. */
         PRINTF("RPL: rpl_link_neighbor_callback triggering update\n");
-        parent->flags |= RPL_PARENT_FLAG_UPDATED;
+        rpl_parent_updated(parent);
         if(instance->of->neighbor_link_callback != NULL) {
           instance->of->neighbor_link_callback(parent, status, numtx);
           parent->last_tx_time = clock_time();
@@ -366,7 +365,7 @@ rpl_ipv6_neighbor_callback(uip_ds6_nbr_t *nbr)
         p->rank = INFINITE_RANK;
         /* Trigger DAG rank recalculation. */
         PRINTF("RPL: rpl_ipv6_neighbor_callback infinite rank\n");
-        p->flags |= RPL_PARENT_FLAG_UPDATED;
+        rpl_parent_updated(p);
       }
 	  #if UIP_ND6_CONF_ENGINE == UIP_ND6_ENGINE_RPL
 	  index = index_from_item(ds6_neighbors, nbr);
@@ -409,6 +408,9 @@ rpl_init(void)
   #endif
 
   rpl_dag_init();
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
   rpl_reset_periodic_timer();
   rpl_icmp6_register_handlers();
 
@@ -60,6 +60,7 @@ void rpl_sourceinfo_init(void);
 rpl_sourceinfo_t *rpl_sourceinfo_list_add(unsigned short nodeid);
 rpl_sourceinfo_t *rpl_sourceinfo_list_next(rpl_sourceinfo_t *rpl_sourceinfo_item);
 rpl_sourceinfo_t *rpl_sourceinfo_list_head(void);
+void rpl_sourceinfo_list_remove(rpl_sourceinfo_t *rpl_sourceinfo_item);
 void rpl_sourceinfo_list_purge(void);
 
 extern uint8_t dis_timer_reset;
@@ -270,6 +271,9 @@ int rpl_verify_header(int);
 void rpl_insert_header(void);
 void rpl_remove_header(void);
 uint8_t rpl_invert_header(void);
+int rpl_insert_srh_header(void);
+int rpl_process_srh_header(void);
+int rpl_get_srh_next_hop(uip_ipaddr_t *ipaddr);
 uip_ipaddr_t *rpl_get_parent_ipaddr(rpl_parent_t *nbr);
 rpl_parent_t *rpl_get_parent(uip_lladdr_t *addr);
 rpl_rank_t rpl_get_parent_rank(uip_lladdr_t *addr);
@@ -45,7 +45,10 @@
 #include "sys/ctimer.h"
 #include "contiki.h"
 #include "lib/list.h"
+#include <stddef.h> /* For offsetof */
 
+/* The ctimers set before ctimer_process started. Afterwards the ctimer
+   of an expired etimer is found from the etimer itself. */
 LIST(ctimer_list);
 
 static char initialized;
@@ -68,20 +71,20 @@ PROCESS_THREAD(ctimer_process, ev, data)
   for(c = list_head(ctimer_list); c != NULL; c = c->next) {
     etimer_set(&c->etimer, c->etimer.timer.interval);
   }
+  list_init(ctimer_list);
   initialized = 1;
 
   while(1) {
     PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_TIMER);
-    for(c = list_head(ctimer_list); c != NULL; c = c->next) {
-      if(&c->etimer == data) {
-	list_remove(ctimer_list, c);
-	PROCESS_CONTEXT_BEGIN(c->p);
-	if(c->f != NULL) {
-	  c->f(c->ptr);
-	}
-	PROCESS_CONTEXT_END(c->p);
-	break;
+    c = (struct ctimer *)((char *)data - offsetof(struct ctimer, etimer));
+    /* Skip the ctimers stopped, or set again, since the etimer expired */
+    if(c->armed && etimer_expired(&c->etimer)) {
+      c->armed = 0;
+      PROCESS_CONTEXT_BEGIN(c->p);
+      if(c->f != NULL) {
+        c->f(c->ptr);
       }
+      PROCESS_CONTEXT_END(c->p);
     }
   }
   PROCESS_END();
@@ -92,6 +95,8 @@ ctimer_init(void)
 {
   initialized = 0;
   list_init(ctimer_list);
+  /* The callbacks mostly run protocol timers */
+  process_set_priority(&ctimer_process, PROCESS_PRIORITY_HIGH);
   process_start(&ctimer_process, NULL);
 }
 /*---------------------------------------------------------------------------*/
@@ -103,66 +108,63 @@ ctimer_set(struct ctimer *c, clock_time_t t,
   c->p = PROCESS_CURRENT();
   c->f = f;
   c->ptr = ptr;
+  c->armed = 1;
   if(initialized) {
     PROCESS_CONTEXT_BEGIN(&ctimer_process);
     etimer_set(&c->etimer, t);
     PROCESS_CONTEXT_END(&ctimer_process);
   } else {
     c->etimer.timer.interval = t;
+    list_add(ctimer_list, c);
   }
-
-  list_add(ctimer_list, c);
 }
 /*---------------------------------------------------------------------------*/
 void
 ctimer_reset(struct ctimer *c)
 {
+  c->armed = 1;
   if(initialized) {
     PROCESS_CONTEXT_BEGIN(&ctimer_process);
     etimer_reset(&c->etimer);
     PROCESS_CONTEXT_END(&ctimer_process);
+  } else {
+    list_add(ctimer_list, c);
   }
-
-  list_add(ctimer_list, c);
 }
 /*---------------------------------------------------------------------------*/
 void
 ctimer_restart(struct ctimer *c)
 {
+  c->armed = 1;
   if(initialized) {
     PROCESS_CONTEXT_BEGIN(&ctimer_process);
     etimer_restart(&c->etimer);
     PROCESS_CONTEXT_END(&ctimer_process);
+  } else {
+    list_add(ctimer_list, c);
   }
-
-  list_add(ctimer_list, c);
 }
 /*---------------------------------------------------------------------------*/
 void
 ctimer_stop(struct ctimer *c)
 {
+  c->armed = 0;
   if(initialized) {
     etimer_stop(&c->etimer);
   } else {
     c->etimer.next = NULL;
     c->etimer.p = PROCESS_NONE;
+    list_remove(ctimer_list, c);
   }
-  list_remove(ctimer_list, c);
 }
 /*---------------------------------------------------------------------------*/
 int
 ctimer_expired(struct ctimer *c)
 {
-  struct ctimer *t;
   if(initialized) {
     return etimer_expired(&c->etimer);
   }
-  for(t = list_head(ctimer_list); t != NULL; t = t->next) {
-    if(t == c) {
-      return 0;
-    }
-  }
-  return 1;
+  return !c->armed;
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
@@ -62,6 +62,9 @@ struct ctimer {
   struct process *p;
   void (*f)(void *);
   void *ptr;
+  /* Set while the callback is due: the event of an etimer that expired
+     may still be queued when the ctimer is stopped */
+  uint8_t armed;
 };
 
 /**
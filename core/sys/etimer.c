@@ -49,38 +49,162 @@
 #include "sys/etimer.h"
 #include "sys/process.h"
 
+/* The pending timers are kept in a pairing heap ordered by their
+   expiration time: adding a timer and finding the next one to expire
+   take constant time, and removing one takes amortized logarithmic
+   time. The expiration times are compared relative to the current
+   time, so the order stays valid as the clock runs and wraps. */
 static struct etimer *timerlist;
-static clock_time_t next_expiration;
 
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+/* Whether a expires before b. Expired timers come first, the one that
+   expired the longest ago first. */
+static int
+expires_before(struct etimer *a, struct etimer *b, clock_time_t now)
+{
+  clock_time_t passed_a, passed_b;
+  int expired_a, expired_b;
+
+  passed_a = now - a->timer.start;
+  passed_b = now - b->timer.start;
+  expired_a = passed_a >= a->timer.interval;
+  expired_b = passed_b >= b->timer.interval;
+  if(expired_a != expired_b) {
+    return expired_a;
+  }
+  if(expired_a) {
+    return passed_a - a->timer.interval > passed_b - b->timer.interval;
+  }
+  return a->timer.interval - passed_a < b->timer.interval - passed_b;
+}
+/*---------------------------------------------------------------------------*/
+/* Melds two heaps, whose roots have no siblings, into one */
+static struct etimer *
+meld(struct etimer *a, struct etimer *b, clock_time_t now)
+{
+  struct etimer *t;
+
+  if(a == NULL) {
+    return b;
+  }
+  if(b == NULL) {
+    return a;
+  }
+  if(expires_before(b, a, now)) {
+    t = a;
+    a = b;
+    b = t;
+  }
+  /* b becomes the first child of a */
+  b->prev = a;
+  b->next = a->child;
+  if(a->child != NULL) {
+    a->child->prev = b;
+  }
+  a->child = b;
+  return a;
+}
+/*---------------------------------------------------------------------------*/
+/* Melds a list of siblings into one heap, in two passes: pairwise from
+   the first one, then the pairs from the last one */
+static struct etimer *
+meld_siblings(struct etimer *first, clock_time_t now)
+{
+  struct etimer *a, *b, *pairs, *heap;
+
+  pairs = NULL;
+  while(first != NULL) {
+    a = first;
+    b = a->next;
+    first = b != NULL ? b->next : NULL;
+    a->next = a->prev = NULL;
+    if(b != NULL) {
+      b->next = b->prev = NULL;
+      a = meld(a, b, now);
+    }
+    a->next = pairs;
+    pairs = a;
+  }
+
+  heap = NULL;
+  while(pairs != NULL) {
+    a = pairs;
+    pairs = a->next;
+    a->next = NULL;
+    heap = meld(heap, a, now);
+  }
+  return heap;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_pending(struct etimer *t)
+{
+  return t->pending == t;
+}
+/*---------------------------------------------------------------------------*/
 static void
-update_time(void)
+remove_timer(struct etimer *t)
 {
-  clock_time_t tdist;
+  struct etimer *children;
   clock_time_t now;
-  struct etimer *t;
 
-  if (timerlist == NULL) {
-    next_expiration = 0;
+  now = clock_time();
+  children = meld_siblings(t->child, now);
+  if(t == timerlist) {
+    timerlist = children;
   } else {
-    now = clock_time();
-    t = timerlist;
-    /* Must calculate distance to next time into account due to wraps */
-    tdist = t->timer.start + t->timer.interval - now;
-    for(t = t->next; t != NULL; t = t->next) {
-      if(t->timer.start + t->timer.interval - now < tdist) {
-	tdist = t->timer.start + t->timer.interval - now;
-      }
+    if(t->prev->child == t) {
+      t->prev->child = t->next;
+    } else {
+      t->prev->next = t->next;
+    }
+    if(t->next != NULL) {
+      t->next->prev = t->prev;
+    }
+    timerlist = meld(timerlist, children, now);
+  }
+  t->child = t->next = t->prev = NULL;
+  t->pending = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Removes the timers of a process that exited. This walks the whole
+   heap, through a work list linked by the prev pointers, and melds the
+   timers of the other processes back. */
+static void
+remove_process_timers(struct process *p)
+{
+  struct etimer *work, *t;
+  clock_time_t now;
+
+  now = clock_time();
+  work = timerlist;
+  timerlist = NULL;
+  while(work != NULL) {
+    t = work;
+    work = t->prev;
+    if(t->child != NULL) {
+      t->child->prev = work;
+      work = t->child;
+    }
+    if(t->next != NULL) {
+      t->next->prev = work;
+      work = t->next;
+    }
+    t->child = t->next = t->prev = NULL;
+    if(t->p == p) {
+      t->p = PROCESS_NONE;
+      t->pending = NULL;
+    } else {
+      timerlist = meld(timerlist, t, now);
     }
-    next_expiration = now + tdist;
   }
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(etimer_process, ev, data)
 {
-  struct etimer *t, *u;
-	
+  struct etimer *t;
+
   PROCESS_BEGIN();
 
   timerlist = NULL;
@@ -89,53 +213,25 @@ PROCESS_THREAD(etimer_process, ev, data)
     PROCESS_YIELD();
 
     if(ev == PROCESS_EVENT_EXITED) {
-      struct process *p = data;
-
-      while(timerlist != NULL && timerlist->p == p) {
-	timerlist = timerlist->next;
-      }
-
-      if(timerlist != NULL) {
-	t = timerlist;
-	while(t->next != NULL) {
-	  if(t->next->p == p) {
-	    t->next = t->next->next;
-	  } else
-	    t = t->next;
-	}
-      }
+      remove_process_timers(data);
       continue;
     } else if(ev != PROCESS_EVENT_POLL) {
       continue;
     }
 
-  again:
-    
-    u = NULL;
-    
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(timer_expired(&t->timer)) {
-	if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
-	  
-	  /* Reset the process ID of the event timer, to signal that the
-	     etimer has expired. This is later checked in the
-	     etimer_expired() function. */
-	  t->p = PROCESS_NONE;
-	  if(u != NULL) {
-	    u->next = t->next;
-	  } else {
-	    timerlist = t->next;
-	  }
-	  t->next = NULL;
-	  update_time();
-	  goto again;
-	} else {
-	  etimer_request_poll();
-	}
+    while(timerlist != NULL && timer_expired(&timerlist->timer)) {
+      t = timerlist;
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) != PROCESS_ERR_OK) {
+        /* The event queue is full: try again later */
+        etimer_request_poll();
+        break;
       }
-      u = t;
+      remove_timer(t);
+      /* Reset the process ID of the event timer, to signal that the
+         etimer has expired. This is later checked in the
+         etimer_expired() function. */
+      t->p = PROCESS_NONE;
     }
-    
   }
   
   PROCESS_END();
@@ -150,27 +246,18 @@ etimer_request_poll(void)
 static void
 add_timer(struct etimer *timer)
 {
-  struct etimer *t;
-
   etimer_request_poll();
 
-  if(timer->p != PROCESS_NONE) {
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(t == timer) {
-	/* Timer already on list, bail out. */
-        timer->p = PROCESS_CURRENT();
-	update_time();
-	return;
-      }
-    }
+  if(is_pending(timer)) {
+    /* The timer is already in the heap, but its expiration time may
+       have changed */
+    remove_timer(timer);
   }
 
-  /* Timer not on list. */
   timer->p = PROCESS_CURRENT();
-  timer->next = timerlist;
-  timerlist = timer;
-
-  update_time();
+  timer->child = timer->next = timer->prev = NULL;
+  timer->pending = timer;
+  timerlist = meld(timerlist, timer, clock_time());
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -197,8 +284,13 @@ etimer_restart(struct etimer *et)
 void
 etimer_adjust(struct etimer *et, int timediff)
 {
-  et->timer.start += timediff;
-  update_time();
+  if(is_pending(et)) {
+    remove_timer(et);
+    et->timer.start += timediff;
+    timerlist = meld(timerlist, et, clock_time());
+  } else {
+    et->timer.start += timediff;
+  }
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -228,31 +320,14 @@ etimer_pending(void)
 clock_time_t
 etimer_next_expiration_time(void)
 {
-  return etimer_pending() ? next_expiration : 0;
+  return etimer_pending() ? etimer_expiration_time(timerlist) : 0;
 }
 /*---------------------------------------------------------------------------*/
 void
 etimer_stop(struct etimer *et)
 {
-  struct etimer *t;
-
-  /* First check if et is the first event timer on the list. */
-  if(et == timerlist) {
-    timerlist = timerlist->next;
-    update_time();
-  } else {
-    /* Else walk through the list and try to find the item before the
-       et timer. */
-    for(t = timerlist; t != NULL && t->next != et; t = t->next);
-
-    if(t != NULL) {
-      /* We've found the item before the event timer that we are about
-	 to remove. We point the items next pointer to the event after
-	 the removed item. */
-      t->next = et->next;
-
-      update_time();
-    }
+  if(is_pending(et)) {
+    remove_timer(et);
   }
 
   /* Remove the next pointer from the item to be removed. */
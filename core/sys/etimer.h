@@ -71,12 +71,29 @@
  * This structure is used for declaring a timer. The timer must be set
  * with etimer_set() before it can be used.
  *
+ * A timer must also start zeroed, as static and global timers do. A
+ * timer on the stack or in reused memory must be cleared first, and
+ * stopped before its memory is reused. A timer whose pending field
+ * happens to point to itself is taken for a running one.
+ *
+ * The heap links take three pointers per timer beyond the plain list
+ * the timers used to be kept in.
+ *
  * \hideinitializer
  */
 struct etimer {
   struct timer timer;
   struct etimer *next;
   struct process *p;
+  /* The pending timers form a pairing heap: child is the first child
+     of the timer, next its next sibling, and prev the timer it is the
+     child or the next sibling of */
+  struct etimer *child;
+  struct etimer *prev;
+  /* Points to the timer itself while it is in the heap. Unlike a
+     flag, this cannot be set by chance in a timer that was never
+     initialized. */
+  struct etimer *pending;
 };
 
 /**
@@ -44,6 +44,10 @@
  */
 
 #include <stdio.h>
+#if PROCESS_CONF_MAXEVENTS > PROCESS_CONF_NUMEVENTS
+#include <stdlib.h>
+#include <string.h>
+#endif
 
 #include "sys/process.h"
 #include "sys/arg.h"
@@ -57,16 +61,52 @@ struct process *process_current = NULL;
 static process_event_t lastevent;
 
 /*
- * Structure used for keeping the queue of active events.
+ * Structure used for keeping the queue of active events. The events
+ * are linked, by index, into one queue per priority and a free list.
  */
 struct event_data {
   process_event_t ev;
   process_data_t data;
   struct process *p;
+  process_num_events_t next;
 };
 
-static process_num_events_t nevents, fevent;
+#define NO_EVENT ((process_num_events_t)~0)
+
+/* The number of events kept for the processes of high priority: the
+   events to the other processes fail when only these are left */
+#ifdef PROCESS_CONF_RESERVED_EVENTS
+#define RESERVED_EVENTS PROCESS_CONF_RESERVED_EVENTS
+#else
+#define RESERVED_EVENTS (PROCESS_CONF_NUMEVENTS / 8)
+#endif
+
+/* The number of events of high priority delivered in a row when
+   events of normal priority are waiting */
+#ifdef PROCESS_CONF_HIGH_BURST
+#define HIGH_BURST PROCESS_CONF_HIGH_BURST
+#else
+#define HIGH_BURST 8
+#endif
+
+#define NUM_PRIORITIES (PROCESS_PRIORITY_HIGH + 1)
+
+static process_num_events_t nevents, free_events;
+static struct {
+  process_num_events_t head, tail;
+} queues[NUM_PRIORITIES];
+static unsigned char high_in_row;
+
+#if PROCESS_CONF_MAXEVENTS > PROCESS_CONF_NUMEVENTS
+static struct event_data initial_events[PROCESS_CONF_NUMEVENTS];
+static struct event_data *events = initial_events;
+static process_num_events_t num_events;
+#else
 static struct event_data events[PROCESS_CONF_NUMEVENTS];
+#define num_events PROCESS_CONF_NUMEVENTS
+#endif
+
+unsigned long process_overflows;
 
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
@@ -207,9 +247,28 @@ process_exit(struct process *p)
 void
 process_init(void)
 {
+  process_num_events_t i;
+
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+#if PROCESS_CONF_MAXEVENTS > PROCESS_CONF_NUMEVENTS
+  if(events != initial_events) {
+    free(events);
+    events = initial_events;
+  }
+  num_events = PROCESS_CONF_NUMEVENTS;
+#endif
+  for(i = 0; i < num_events; i++) {
+    events[i].next = i + 1;
+  }
+  events[num_events - 1].next = NO_EVENT;
+  free_events = 0;
+  for(i = 0; i < NUM_PRIORITIES; i++) {
+    queues[i].head = queues[i].tail = NO_EVENT;
+  }
+  nevents = 0;
+  high_in_row = 0;
+  process_overflows = 0;
 #if PROCESS_CONF_STATS
   process_maxevents = 0;
 #endif /* PROCESS_CONF_STATS */
@@ -249,6 +308,8 @@ do_event(void)
   static process_data_t data;
   static struct process *receiver;
   static struct process *p;
+  static process_num_events_t fevent;
+  static unsigned char prio;
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -259,6 +320,19 @@ do_event(void)
    */
 
   if(nevents > 0) {
+
+    /* The events of high priority go first, but not so many in a row
+       that the others starve */
+    if(queues[PROCESS_PRIORITY_HIGH].head != NO_EVENT &&
+       (high_in_row < HIGH_BURST ||
+        queues[PROCESS_PRIORITY_NORMAL].head == NO_EVENT)) {
+      prio = PROCESS_PRIORITY_HIGH;
+      high_in_row++;
+    } else {
+      prio = PROCESS_PRIORITY_NORMAL;
+      high_in_row = 0;
+    }
+    fevent = queues[prio].head;
     
     /* There are events that we should deliver. */
     ev = events[fevent].ev;
@@ -266,9 +340,14 @@ do_event(void)
     data = events[fevent].data;
     receiver = events[fevent].p;
 
-    /* Since we have seen the new event, we move pointer upwards
+    /* Since we have seen the new event, we move it to the free list
        and decrease the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    queues[prio].head = events[fevent].next;
+    if(queues[prio].head == NO_EVENT) {
+      queues[prio].tail = NO_EVENT;
+    }
+    events[fevent].next = free_events;
+    free_events = fevent;
     --nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
@@ -318,10 +397,54 @@ process_nevents(void)
   return nevents + poll_requested;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_MAXEVENTS > PROCESS_CONF_NUMEVENTS
+/* Doubles the number of events, up to PROCESS_CONF_MAXEVENTS */
+static int
+grow_events(void)
+{
+  struct event_data *e;
+  process_num_events_t n, i;
+
+  if(num_events >= PROCESS_CONF_MAXEVENTS) {
+    return 0;
+  }
+  n = num_events > PROCESS_CONF_MAXEVENTS / 2 ?
+    PROCESS_CONF_MAXEVENTS : 2 * num_events;
+  if(events == initial_events) {
+    e = malloc(n * sizeof(struct event_data));
+    if(e != NULL) {
+      memcpy(e, initial_events, sizeof(initial_events));
+    }
+  } else {
+    e = realloc(events, n * sizeof(struct event_data));
+  }
+  if(e == NULL) {
+    return 0;
+  }
+  PRINTF("process: %u events\n", (unsigned)n);
+
+  events = e;
+  for(i = num_events; i < n - 1; i++) {
+    events[i].next = i + 1;
+  }
+  events[n - 1].next = free_events;
+  free_events = num_events;
+  num_events = n;
+  return 1;
+}
+#endif /* PROCESS_CONF_MAXEVENTS > PROCESS_CONF_NUMEVENTS */
+/*---------------------------------------------------------------------------*/
+void
+process_set_priority(struct process *p, unsigned char priority)
+{
+  p->priority = priority;
+}
+/*---------------------------------------------------------------------------*/
 int
 process_post(struct process *p, process_event_t ev, process_data_t data)
 {
   static process_num_events_t snum;
+  static unsigned char prio;
 
   if(PROCESS_CURRENT() == NULL) {
     PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
@@ -332,7 +455,20 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
   }
   
-  if(nevents == PROCESS_CONF_NUMEVENTS) {
+  if(p != PROCESS_BROADCAST && p->priority == PROCESS_PRIORITY_HIGH) {
+    prio = PROCESS_PRIORITY_HIGH;
+  } else {
+    prio = PROCESS_PRIORITY_NORMAL;
+  }
+
+  if((free_events == NO_EVENT ||
+      (prio == PROCESS_PRIORITY_NORMAL &&
+       nevents >= num_events - RESERVED_EVENTS))
+#if PROCESS_CONF_MAXEVENTS > PROCESS_CONF_NUMEVENTS
+     && !grow_events()
+#endif
+     ) {
+    process_overflows++;
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
       printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
@@ -343,10 +479,18 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
     return PROCESS_ERR_FULL;
   }
   
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
+  snum = free_events;
+  free_events = events[snum].next;
   events[snum].ev = ev;
   events[snum].data = data;
   events[snum].p = p;
+  events[snum].next = NO_EVENT;
+  if(queues[prio].tail == NO_EVENT) {
+    queues[prio].head = snum;
+  } else {
+    events[queues[prio].tail].next = snum;
+  }
+  queues[prio].tail = snum;
   ++nevents;
 
 #if PROCESS_CONF_STATS
@@ -58,9 +58,23 @@
 
 #define CCIF
 
+#ifndef PROCESS_CONF_NUMEVENTS
+#define PROCESS_CONF_NUMEVENTS 32
+#endif /* PROCESS_CONF_NUMEVENTS */
+
+/* The number of events the queue may grow to, from the heap, when the
+   PROCESS_CONF_NUMEVENTS events are not enough. No growth by default. */
+#ifndef PROCESS_CONF_MAXEVENTS
+#define PROCESS_CONF_MAXEVENTS PROCESS_CONF_NUMEVENTS
+#endif /* PROCESS_CONF_MAXEVENTS */
+
 typedef unsigned char process_event_t;
 typedef void *        process_data_t;
+#if PROCESS_CONF_MAXEVENTS > 254
+typedef unsigned short process_num_events_t;
+#else
 typedef unsigned char process_num_events_t;
+#endif
 
 /**
  * \name Return values
@@ -86,10 +100,6 @@ typedef unsigned char process_num_events_t;
 
 #define PROCESS_NONE          NULL
 
-#ifndef PROCESS_CONF_NUMEVENTS
-#define PROCESS_CONF_NUMEVENTS 32
-#endif /* PROCESS_CONF_NUMEVENTS */
-
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -324,9 +334,22 @@ struct process {
 #endif
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
-  unsigned char state, needspoll;
+  unsigned char state, needspoll, priority;
 };
 
+/**
+ * \name Process priorities
+ *
+ * The events posted to a process of high priority are delivered
+ * before those posted to the other processes, such as the events of
+ * the network stack and the ctimers before those of the applications.
+ * Broadcast events have normal priority.
+ * @{
+ */
+#define PROCESS_PRIORITY_NORMAL 0
+#define PROCESS_PRIORITY_HIGH   1
+/* @} */
+
 /**
  * \name Functions called from application programs
  * @{
@@ -454,6 +477,16 @@ process_current = p
  */
 CCIF process_event_t process_alloc_event(void);
 
+/**
+ * \brief      Set the priority of the events posted to a process.
+ * \param p    The process.
+ * \param priority PROCESS_PRIORITY_NORMAL or PROCESS_PRIORITY_HIGH.
+ *
+ *             A process has normal priority until this function is
+ *             called.
+ */
+void process_set_priority(struct process *p, unsigned char priority);
+
 /** @} */
 
 /**
@@ -521,6 +554,12 @@ CCIF int process_is_running(struct process *p);
  */
 int process_nevents(void);
 
+/**
+ * The number of events that could not be posted because the event
+ * queue was full.
+ */
+extern unsigned long process_overflows;
+
 /** @} */
 
 CCIF extern struct process *process_list;
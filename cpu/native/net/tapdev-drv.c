@@ -33,6 +33,7 @@
 #include "contiki-net.h"
 #include "net/ip/uip.h"
 #include "net/ip/uipopt.h"
+#include "net/ipv4/uip_arp.h"
 
 #if NETSTACK_CONF_WITH_IPV6
 #include "tapdev6.h"
@@ -35,6 +35,7 @@
 
 #include "net/ip/uip.h"
 #include "net/ip/uipopt.h"
+#include "net/ipv4/uip_arp.h"
 
 #if NETSTACK_CONF_WITH_IPV6
 
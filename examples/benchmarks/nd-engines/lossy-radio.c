@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Lossy loopback radio for multi-process native simulations
+ */
+
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/ip/uip.h"
+#include "sys/node-id.h"
+#include "lossy-radio.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_PORT  20000
+#define DEFAULT_NODES 8
+
+struct lossy_radio_stats lossy_radio_stats;
+
+static int sock = -1;
+static unsigned short port = DEFAULT_PORT;
+static unsigned short nodes = DEFAULT_NODES;
+static unsigned short range;
+static unsigned short loss;
+/*---------------------------------------------------------------------------*/
+static unsigned long
+env_value(const char *name, unsigned long def)
+{
+  char *value = getenv(name);
+  return value != NULL ? strtoul(value, NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static int
+in_range(unsigned short id)
+{
+  if(id == 0 || id > nodes || id == node_id) {
+    return 0;
+  }
+  return range == 0 || abs((int)id - (int)node_id) <= range;
+}
+/*---------------------------------------------------------------------------*/
+static int
+deliver(unsigned short id, const void *payload, unsigned short payload_len)
+{
+  struct sockaddr_in sin;
+
+  if(loss > 0 && (unsigned)(rand() % 100) < loss) {
+    lossy_radio_stats.lost++;
+    return 0;
+  }
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = htons(port + id);
+  return sendto(sock, payload, payload_len, 0,
+                (struct sockaddr *)&sin, sizeof(sin)) == payload_len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(sock, rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  int len;
+
+  if(!FD_ISSET(sock, rset)) {
+    return;
+  }
+  for(;;) {
+    packetbuf_clear();
+    len = recv(sock, packetbuf_dataptr(), PACKETBUF_SIZE, MSG_DONTWAIT);
+    if(len <= 0) {
+      break;
+    }
+    lossy_radio_stats.rx_frames++;
+    packetbuf_set_datalen(len);
+    NETSTACK_RDC.input();
+  }
+}
+static const struct select_callback radio_fd = { set_fd, handle_fd };
+/*---------------------------------------------------------------------------*/
+static int
+init(void)
+{
+  struct sockaddr_in sin;
+
+  port = env_value("ND_BENCH_PORT", DEFAULT_PORT);
+  nodes = env_value("ND_BENCH_NODES", DEFAULT_NODES);
+  range = env_value("ND_BENCH_RANGE", 0);
+  loss = env_value("ND_BENCH_LOSS", 0);
+  srand(node_id);
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if(sock < 0) {
+    perror("lossy-radio: socket");
+    exit(1);
+  }
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = htons(port + node_id);
+  if(bind(sock, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+    perror("lossy-radio: bind");
+    exit(1);
+  }
+  select_set_callback(sock, &radio_fd);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+prepare(const void *payload, unsigned short payload_len)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+transmit(unsigned short transmit_len)
+{
+  return RADIO_TX_OK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_send(const void *payload, unsigned short payload_len)
+{
+  const linkaddr_t *dest = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  unsigned short id;
+
+  lossy_radio_stats.tx_frames++;
+  lossy_radio_stats.tx_bytes += payload_len;
+  /* sicslowpan tags every frame with the next header of its IPv6
+     packet, which a queueing MAC keeps along with the frame */
+  if(packetbuf_attr(PACKETBUF_ATTR_NETWORK_ID) == UIP_PROTO_ICMP6) {
+    lossy_radio_stats.ctrl_frames++;
+    lossy_radio_stats.ctrl_bytes += payload_len;
+  }
+
+  if(linkaddr_cmp(dest, &linkaddr_null)) {
+    for(id = 1; id <= nodes; id++) {
+      if(in_range(id)) {
+        deliver(id, payload, payload_len);
+      }
+    }
+    return RADIO_TX_OK;
+  }
+
+  id = (dest->u8[LINKADDR_SIZE - 2] << 8) | dest->u8[LINKADDR_SIZE - 1];
+  if(in_range(id) && deliver(id, payload, payload_len)) {
+    return RADIO_TX_OK;
+  }
+  return RADIO_TX_NOACK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_read(void *buf, unsigned short buf_len)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+channel_clear(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+receiving_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+pending_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_value(radio_param_t param, radio_value_t *value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_value(radio_param_t param, radio_value_t value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_object(radio_param_t param, void *dest, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_object(radio_param_t param, const void *src, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver lossy_radio_driver = {
+  init,
+  prepare,
+  transmit,
+  radio_send,
+  radio_read,
+  channel_clear,
+  receiving_packet,
+  pending_packet,
+  on,
+  off,
+  get_value,
+  set_value,
+  get_object,
+  set_object
+};
+/*---------------------------------------------------------------------------*/
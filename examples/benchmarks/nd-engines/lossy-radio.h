@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         A radio driver for the native platform that connects node
+ *         processes on the same host through UDP sockets on the loopback
+ *         interface. Node n listens on port ND_BENCH_PORT + n; a frame
+ *         reaches every node within ND_BENCH_RANGE ids of the sender
+ *         (all ND_BENCH_NODES nodes when 0) unless it is dropped with
+ *         probability ND_BENCH_LOSS percent, rolled per receiver.
+ *         All parameters are read from the environment.
+ */
+
+#ifndef LOSSY_RADIO_H_
+#define LOSSY_RADIO_H_
+
+#include "dev/radio.h"
+
+struct lossy_radio_stats {
+  unsigned long tx_frames;
+  unsigned long tx_bytes;
+  unsigned long ctrl_frames;   /**< Frames that carried ICMPv6 */
+  unsigned long ctrl_bytes;
+  unsigned long rx_frames;
+  unsigned long lost;          /**< Per-receiver copies dropped */
+};
+
+extern struct lossy_radio_stats lossy_radio_stats;
+extern const struct radio_driver lossy_radio_driver;
+
+#endif /* LOSSY_RADIO_H_ */
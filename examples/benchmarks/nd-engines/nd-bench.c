@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Headless benchmark of the ND engines on the native platform.
+ *         Node 1 is the RPL root and 6LBR/router, every other node joins
+ *         it over the lossy loopback radio. A node has a route once it
+ *         has a default router, and has joined once a UDP probe to the
+ *         root has been echoed. Once it has heard a node, the root also
+ *         sends it downward probes carrying the root's clock, in turn
+ *         with the other nodes. The nodes of a native run share the host
+ *         clock, so a node takes the one-way downward latency from them.
+ *         After ND_BENCH_DURATION seconds each node prints one "nd-bench"
+ *         line of key=value pairs and exits.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/uip-udp-packet.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/rpl/rpl.h"
+#if ND_BENCH_NON_STORING
+#include "net/rpl/rpl-ns.h"
+#endif
+#include "sys/node-id.h"
+#include "lossy-radio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+#define BENCH_PORT      5678
+#define PROBE_INTERVAL  (CLOCK_SECOND / 4)
+#define DEFAULT_DURATION 60
+#define DEFAULT_NODES    8
+/* Node ids the root sends downward probes to */
+#define MAX_NODES        256
+
+#define ROOT_ID 1
+
+/* A downward probe: the root's clock when it was sent */
+struct down_probe {
+  uint32_t sent;
+};
+
+static uint8_t PREFIX[8] = {0x20, 0x01, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00};
+
+static struct uip_udp_conn *conn;
+static uip_ipaddr_t root_ipaddr;
+static clock_time_t start;
+static clock_time_t t_route;
+static clock_time_t t_join;
+static uint16_t probes;
+/* The root: the nodes heard from, and the downward probes sent */
+static uint8_t heard[MAX_NODES / 8];
+static unsigned long down_tx;
+/* A node: the downward probes received and their latency */
+static unsigned long down_rx;
+static unsigned long down_sum_ms;
+static unsigned long down_max_ms;
+
+PROCESS(nd_bench_process, "ND engine benchmark");
+AUTOSTART_PROCESSES(&nd_bench_process);
+/*---------------------------------------------------------------------------*/
+static long
+elapsed_ms(clock_time_t t)
+{
+  return t == 0 ? -1 : (long)(t - start) * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(void)
+{
+  printf("nd-bench engine=%s node=%u role=%s t_route_ms=%ld t_join_ms=%ld"
+         " probes=%u ctrl_frames=%lu ctrl_bytes=%lu tx_frames=%lu"
+         " tx_bytes=%lu rx_frames=%lu lost=%lu nbr_lookups=%lu"
+         " nbr_hits=%lu routes=%d dodag_nodes=%d down_tx=%lu down_rx=%lu"
+         " down_avg_ms=%ld down_max_ms=%ld\n",
+         ND_BENCH_ENGINE_NAME, node_id,
+         node_id == ROOT_ID ? "root" : "node",
+         elapsed_ms(t_route), elapsed_ms(t_join), probes,
+         lossy_radio_stats.ctrl_frames, lossy_radio_stats.ctrl_bytes,
+         lossy_radio_stats.tx_frames, lossy_radio_stats.tx_bytes,
+         lossy_radio_stats.rx_frames, lossy_radio_stats.lost,
+         (unsigned long)uip_ds6_nbr_stats.lookups,
+         (unsigned long)uip_ds6_nbr_stats.hits,
+         uip_ds6_route_num_routes(),
+#if ND_BENCH_NON_STORING
+         rpl_ns_num_nodes(),
+#else
+         0,
+#endif
+         down_tx, down_rx,
+         down_rx == 0 ? -1 : (long)(down_sum_ms / down_rx),
+         down_rx == 0 ? -1 : (long)down_max_ms);
+}
+/*---------------------------------------------------------------------------*/
+static void
+root_init(void)
+{
+  rpl_dag_t *dag;
+  uip_ipaddr_t prefix;
+
+  memset(&prefix, 0, sizeof(prefix));
+  memcpy(&prefix, PREFIX, sizeof(PREFIX));
+  uip_ipaddr_copy(&root_ipaddr, &prefix);
+  uip_ds6_set_addr_iid(&root_ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&root_ipaddr, 0, ADDR_AUTOCONF);
+  dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &root_ipaddr);
+  if(dag != NULL) {
+    rpl_set_prefix(dag, &prefix, 64);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The address of a node, whose link-layer address differs from ours
+   only in the id */
+static void
+node_ipaddr(uip_ipaddr_t *ipaddr, uint16_t id)
+{
+  uip_lladdr_t lladdr;
+
+  memcpy(&lladdr, &uip_lladdr, sizeof(lladdr));
+  lladdr.addr[UIP_LLADDR_LEN - 2] = id >> 8;
+  lladdr.addr[UIP_LLADDR_LEN - 1] = id & 0xff;
+  memset(ipaddr, 0, sizeof(*ipaddr));
+  memcpy(ipaddr, PREFIX, sizeof(PREFIX));
+  uip_ds6_set_addr_iid(ipaddr, &lladdr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_init(void)
+{
+  node_ipaddr(&root_ipaddr, ROOT_ID);
+}
+/*---------------------------------------------------------------------------*/
+static void
+tcpip_handler(void)
+{
+  uip_ipaddr_t from;
+  uint16_t port;
+  uint16_t seq;
+  uint16_t id;
+  struct down_probe down;
+  unsigned long latency;
+
+  if(!uip_newdata() || uip_datalen() < sizeof(seq)) {
+    return;
+  }
+  if(node_id != ROOT_ID && uip_datalen() == sizeof(down)) {
+    memcpy(&down, uip_appdata, sizeof(down));
+    latency = (uint32_t)((uint32_t)clock_time() - down.sent) * 1000UL /
+      CLOCK_SECOND;
+    down_rx++;
+    down_sum_ms += latency;
+    if(latency > down_max_ms) {
+      down_max_ms = latency;
+    }
+    return;
+  }
+  memcpy(&seq, uip_appdata, sizeof(seq));
+  if(node_id == ROOT_ID) {
+    /* Echo the probe */
+    uip_ipaddr_copy(&from, &UIP_IP_BUF->srcipaddr);
+    port = UIP_UDP_BUF->srcport;
+    uip_udp_packet_sendto(conn, &seq, sizeof(seq), &from, port);
+    /* The id is in the last bytes of the address, as in node_ipaddr() */
+    id = (from.u8[14] << 8) | from.u8[15];
+    if(id < MAX_NODES) {
+      heard[id / 8] |= 1 << (id % 8);
+    }
+  } else if(t_join == 0) {
+    t_join = clock_time();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+probe(void)
+{
+  if(t_route == 0 && uip_ds6_defrt_choose() != NULL) {
+    t_route = clock_time();
+  }
+  if(t_route != 0 && t_join == 0 &&
+     uip_ds6_get_global(ADDR_PREFERRED) != NULL) {
+    probes++;
+    uip_udp_packet_sendto(conn, &probes, sizeof(probes),
+                          &root_ipaddr, UIP_HTONS(BENCH_PORT));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sends a downward probe to the next node heard from */
+static void
+down_probe(uint16_t nodes)
+{
+  static uint16_t id = ROOT_ID;
+  struct down_probe down;
+  uip_ipaddr_t ipaddr;
+  uint16_t i;
+
+  for(i = 0; i < nodes; i++) {
+    if(++id >= nodes + 1 || id >= MAX_NODES) {
+      id = ROOT_ID + 1;
+    }
+    if(heard[id / 8] & (1 << (id % 8))) {
+      node_ipaddr(&ipaddr, id);
+      down.sent = clock_time();
+      uip_udp_packet_sendto(conn, &down, sizeof(down),
+                            &ipaddr, UIP_HTONS(BENCH_PORT));
+      down_tx++;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nd_bench_process, ev, data)
+{
+  static struct etimer periodic;
+  static struct etimer done;
+  static uint16_t nodes;
+  char *duration;
+  char *value;
+
+  PROCESS_BEGIN();
+
+  start = clock_time();
+  if(node_id == ROOT_ID) {
+    root_init();
+  } else {
+    node_init();
+  }
+
+  conn = udp_new(NULL, 0, NULL);
+  udp_bind(conn, UIP_HTONS(BENCH_PORT));
+
+  value = getenv("ND_BENCH_NODES");
+  nodes = value != NULL ? atoi(value) : DEFAULT_NODES;
+  duration = getenv("ND_BENCH_DURATION");
+  etimer_set(&done, (duration != NULL ? atoi(duration) : DEFAULT_DURATION)
+             * CLOCK_SECOND);
+  etimer_set(&periodic, PROBE_INTERVAL);
+
+  while(!etimer_expired(&done)) {
+    PROCESS_YIELD();
+    if(ev == tcpip_event) {
+      tcpip_handler();
+    } else if(etimer_expired(&periodic)) {
+      etimer_reset(&periodic);
+      if(node_id != ROOT_ID) {
+        probe();
+      } else {
+        down_probe(nodes);
+      }
+    }
+  }
+
+  report();
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
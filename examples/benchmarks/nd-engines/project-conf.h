@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Configuration of the ND engine benchmark. ND_BENCH_ENGINE_{RPL,
+ *         6Lo,IPv6} selects the engine and ND_BENCH_ROOT the role, both
+ *         set from the Makefile; the settings mirror the *-ND-DOWN-rt and
+ *         *-ND-DOWN-root-tr20 examples.
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#if defined(ND_BENCH_ENGINE_6Lo)
+#define ND_BENCH_ENGINE_NAME            "6Lo"
+#define UIP_ND6_CONF_ENGINE	UIP_ND6_ENGINE_6Lo
+#define UIP_CONF_ND6_SEND_NA		1
+#define UIP_CONF_DS6_LL_NUD             0
+#if ND_BENCH_ROOT
+#undef UIP_CONF_ROUTER
+#define UIP_CONF_ROUTER                 1
+#undef UIP_CONF_ND6_SEND_RA
+#define UIP_CONF_ND6_SEND_RA		1
+#else
+#undef UIP_CONF_ROUTER
+#define UIP_CONF_ROUTER                 0
+#define RPL_CONF_LEAF_ONLY              1
+#undef UIP_CONF_ND6_SEND_RA
+#define UIP_CONF_ND6_SEND_RA		0
+#endif
+#elif defined(ND_BENCH_ENGINE_IPv6)
+#define ND_BENCH_ENGINE_NAME            "IPv6"
+#define UIP_ND6_CONF_ENGINE	UIP_ND6_ENGINE_IPv6
+#undef UIP_CONF_ROUTER
+#define UIP_CONF_ROUTER                 1
+#undef UIP_CONF_ND6_SEND_RA
+#define UIP_CONF_ND6_SEND_RA		1
+#define UIP_CONF_ND6_SEND_NA		1
+#define UIP_CONF_DS6_LL_NUD             0
+#else
+#define ND_BENCH_ENGINE_NAME            "RPL"
+#define UIP_ND6_CONF_ENGINE	UIP_ND6_ENGINE_RPL
+#undef UIP_CONF_ROUTER
+#define UIP_CONF_ROUTER                 1
+#undef UIP_CONF_ND6_SEND_RA
+#define UIP_CONF_ND6_SEND_RA		0
+#define UIP_CONF_ND6_SEND_NA		0
+#define UIP_CONF_DS6_LL_NUD             1
+#endif
+
+#define UIP_DS6_LL_NUD UIP_CONF_DS6_LL_NUD
+#define UIP_CONF_IPV6_RPL               1
+#define UIP_CONF_ND6_SEND_RA_PERIODIC   0
+#define UIP_CONF_IPV6_CHECKS	1
+
+#define NETSTACK_CONF_RDC nullrdc_driver
+#undef NETSTACK_CONF_RADIO
+#define NETSTACK_CONF_RADIO lossy_radio_driver
+
+/* Each node process reads its id from the environment */
+#define NATIVE_CONF_NODE_ID_ENV         "ND_BENCH_NODE"
+
+#define UIP_DS6_NBR_CONF_STATS          1
+
+#if ND_BENCH_NON_STORING && !ND_BENCH_ROOT
+/* Only the root keeps the DODAG in non-storing mode */
+#define RPL_NS_CONF_LINK_NUM            0
+#endif
+
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP 0
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,84 @@
+#!/bin/sh
+# Builds the ND engine benchmark for every engine and runs one simulated
+# network per engine. Prints one CSV row per node followed by one summary
+# row per engine. Parameters come from the environment:
+#   ENGINES             engines to compare (default "RPL 6Lo IPv6")
+#   ND_BENCH_NODES      number of nodes including the root (default 8)
+#   ND_BENCH_LOSS       per-receiver frame loss in percent (default 0)
+#   ND_BENCH_RANGE      radio range in node ids, 0 = all (default 0)
+#   ND_BENCH_DURATION   seconds per run (default 60)
+#   ND_BENCH_PORT       first UDP port of the loopback radio (default 20000)
+#   ND_BENCH_ROOT_DELAY seconds the root starts after the other nodes, to
+#                       measure a mass power-on (default 0)
+#   BUILD_FLAGS         extra make variables, e.g. "SOLICIT_TRICKLE=1"
+
+ENGINES=${ENGINES:-"RPL 6Lo IPv6"}
+export ND_BENCH_NODES=${ND_BENCH_NODES:-8}
+export ND_BENCH_LOSS=${ND_BENCH_LOSS:-0}
+export ND_BENCH_RANGE=${ND_BENCH_RANGE:-0}
+export ND_BENCH_DURATION=${ND_BENCH_DURATION:-60}
+ND_BENCH_ROOT_DELAY=${ND_BENCH_ROOT_DELAY:-0}
+
+cd $(dirname $0)
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+
+for engine in $ENGINES; do
+  for role in root node; do
+    make clean >/dev/null 2>&1
+    make TARGET=native ENGINE=$engine ROLE=$role $BUILD_FLAGS >$OUT/build.log 2>&1 || {
+      cat $OUT/build.log >&2
+      exit 1
+    }
+    cp nd-bench.native $OUT/nd-bench.$engine.$role
+  done
+done
+make clean >/dev/null 2>&1
+
+echo "engine,node,role,t_route_ms,t_join_ms,probes,ctrl_frames,ctrl_bytes,tx_frames,tx_bytes,rx_frames,lost,nbr_lookups,nbr_hits,routes,dodag_nodes,down_tx,down_rx,down_avg_ms,down_max_ms"
+for engine in $ENGINES; do
+  i=2
+  while [ $i -le $ND_BENCH_NODES ]; do
+    ND_BENCH_NODE=$i $OUT/nd-bench.$engine.node </dev/null >$OUT/$engine.$i &
+    i=$((i + 1))
+  done
+  sleep $ND_BENCH_ROOT_DELAY
+  ND_BENCH_NODE=1 ND_BENCH_DURATION=$((ND_BENCH_DURATION - ND_BENCH_ROOT_DELAY)) \
+    $OUT/nd-bench.$engine.root </dev/null >$OUT/$engine.1 &
+  wait
+  cat $OUT/$engine.* | grep "^nd-bench " | sed 's/^nd-bench //; s/[a-z_]*=//g; s/ /,/g' |
+    sort -t, -k2 -n | tee -a $OUT/all.csv
+done
+
+# Summary per engine: time to the first route in the network, join
+# latency distribution over the joining nodes (-1 when some never joined),
+# control bytes per node, the neighbor cache hit rate, and the share of
+# downward probes delivered with their mean and worst one-way latency.
+# Probes the root sends before a node's downward route is in place count
+# as lost, so short runs understate the delivered share.
+echo
+echo "engine,nodes,joined,t_first_route_ms,join_min_ms,join_p50_ms,join_p90_ms,join_max_ms,ctrl_bytes_per_node,nbr_hit_rate,down_delivered,down_avg_ms,down_max_ms"
+for engine in $ENGINES; do
+  grep "^$engine," $OUT/all.csv | sort -t, -k5 -n | awk -F, -v engine=$engine '
+    { nodes++; ctrl += $8; lookups += $13; hits += $14; down_tx += $17 }
+    $18 > 0 { down_rx += $18; down_sum += $18 * $19; if($20 > down_max) down_max = $20 }
+    $3 == "node" && $4 >= 0 && (first < 0 || $4 < first) { first = $4 }
+    $3 == "node" && $5 >= 0 { join[joined++] = $5 }
+    $3 == "node" && $5 < 0 { missing++ }
+    BEGIN { first = -1; down_max = -1 }
+    END {
+      if(joined == 0) {
+        min = p50 = p90 = max = -1
+      } else {
+        min = join[0]; max = missing ? -1 : join[joined - 1]
+        p50 = join[int((joined + missing - 1) * 0.5)]
+        p90 = join[int((joined + missing - 1) * 0.9)]
+        if(int((joined + missing - 1) * 0.5) >= joined) p50 = -1
+        if(int((joined + missing - 1) * 0.9) >= joined) p90 = -1
+      }
+      printf "%s,%d,%d,%d,%d,%d,%d,%d,%.1f,%.3f,%.3f,%d,%d\n", engine, nodes,
+             joined, first, min, p50, p90, max, nodes ? ctrl / nodes : 0,
+             lookups ? hits / lookups : 0, down_tx ? down_rx / down_tx : 0,
+             down_rx ? down_sum / down_rx : -1, down_max
+    }'
+done
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Native benchmark of uip_ds6_route_lookup(): fills the routing
+ *         table with host routes and reports the lookup cost against
+ *         the number of routes. Build with ROUTE_TRIE=1 to measure the
+ *         trie index instead of the linear route list.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_NEXTHOPS  8
+#define LOOKUPS       200000
+
+static const int route_counts[] = { 16, 64, 256, 1024, 4096 };
+
+static uip_ipaddr_t nexthops[NUM_NEXTHOPS];
+/*---------------------------------------------------------------------------*/
+PROCESS(route_lookup_bench_process, "Route lookup benchmark");
+AUTOSTART_PROCESSES(&route_lookup_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+route_addr(uip_ipaddr_t *addr, int i)
+{
+  uip_ip6addr(addr, 0xaaaa, 0, 0, 0, 0x0212, 0x7400, i >> 16, i & 0xffff);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_nexthops(void)
+{
+  uip_lladdr_t lladdr;
+  int i;
+
+  for(i = 0; i < NUM_NEXTHOPS; i++) {
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[0] = 0x02;
+    lladdr.addr[sizeof(lladdr.addr) - 1] = i + 1;
+    uip_ip6addr(&nexthops[i], 0xfe80, 0, 0, 0, 0, 0, 0, i + 1);
+    uip_ds6_nbr_add(&nexthops[i], &lladdr, 1, NBR_REACHABLE);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(int num_routes)
+{
+  uip_ipaddr_t addr;
+  unsigned long start, elapsed;
+  int i, found;
+
+  while(uip_ds6_route_head() != NULL) {
+    uip_ds6_route_rm(uip_ds6_route_head());
+  }
+  for(i = 0; i < num_routes; i++) {
+    route_addr(&addr, i);
+    uip_ds6_route_add(&addr, 128, &nexthops[i % NUM_NEXTHOPS]);
+  }
+
+  found = 0;
+  start = now_ns();
+  for(i = 0; i < LOOKUPS; i++) {
+    route_addr(&addr, random_rand() % num_routes);
+    if(uip_ds6_route_lookup(&addr) != NULL) {
+      found++;
+    }
+  }
+  elapsed = now_ns() - start;
+
+  printf("route-lookup trie %d routes %d found %d ns/op %lu\n",
+         UIP_DS6_ROUTE_TRIE, uip_ds6_route_num_routes(), found,
+         elapsed / LOOKUPS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_lookup_bench_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  add_nexthops();
+  for(i = 0; i < sizeof(route_counts) / sizeof(route_counts[0]); i++) {
+    if(route_counts[i] <= UIP_DS6_ROUTE_NB) {
+      run(route_counts[i]);
+    }
+  }
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the etimer and ctimer libraries: reports
+ *         the cost of setting, stopping and finding the next timer
+ *         against the number of pending timers, and checks that the
+ *         timers expire in order.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "sys/ctimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_TIMERS   4096
+#define OPERATIONS   200000
+/* The intervals of the timers in the expiry check, in ticks */
+#define EXPIRY_SPREAD 50
+
+static const int timer_counts[] = { 16, 64, 256, 1024, 4096 };
+
+static struct etimer etimers[MAX_TIMERS];
+static struct ctimer ctimers[MAX_TIMERS];
+static int fired;
+/*---------------------------------------------------------------------------*/
+PROCESS(timer_bench_process, "Timer benchmark");
+AUTOSTART_PROCESSES(&timer_bench_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+random_interval(void)
+{
+  /* Far enough away not to expire while measuring */
+  return 1000 * CLOCK_SECOND + random_rand() % (1000 * CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+static void
+ctimer_callback(void *ptr)
+{
+  fired++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(int num_timers)
+{
+  unsigned long start, set_ns, stop_ns, next_ns, cset_ns;
+  volatile clock_time_t next;
+  int i, n;
+
+  for(i = 0; i < num_timers; i++) {
+    etimer_set(&etimers[i], random_interval());
+    ctimer_set(&ctimers[i], random_interval(), ctimer_callback, NULL);
+  }
+
+  /* Set pending timers again */
+  start = now_ns();
+  for(i = 0; i < OPERATIONS; i++) {
+    etimer_set(&etimers[random_rand() % num_timers], random_interval());
+  }
+  set_ns = now_ns() - start;
+
+  /* Stop a pending timer and set it again */
+  start = now_ns();
+  for(i = 0; i < OPERATIONS; i++) {
+    n = random_rand() % num_timers;
+    etimer_stop(&etimers[n]);
+    etimer_set(&etimers[n], random_interval());
+  }
+  stop_ns = now_ns() - start;
+
+  start = now_ns();
+  for(i = 0; i < OPERATIONS; i++) {
+    next = etimer_next_expiration_time();
+  }
+  next_ns = now_ns() - start;
+  (void)next;
+
+  start = now_ns();
+  for(i = 0; i < OPERATIONS; i++) {
+    ctimer_set(&ctimers[random_rand() % num_timers], random_interval(),
+               ctimer_callback, NULL);
+  }
+  cset_ns = now_ns() - start;
+
+  for(i = 0; i < num_timers; i++) {
+    etimer_stop(&etimers[i]);
+    ctimer_stop(&ctimers[i]);
+  }
+
+  printf("timers %d etimer_set ns/op %lu stop+set ns/op %lu "
+         "next_expiration ns/op %lu ctimer_set ns/op %lu\n",
+         num_timers, set_ns / OPERATIONS, stop_ns / OPERATIONS,
+         next_ns / OPERATIONS, cset_ns / OPERATIONS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(timer_bench_process, ev, data)
+{
+  static int i, errors;
+  static clock_time_t last;
+  struct etimer *et;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < sizeof(timer_counts) / sizeof(timer_counts[0]); i++) {
+    run(timer_counts[i]);
+  }
+
+  /* Let timers expire, and check that each expires in order, after
+     its expiration time. Half of them are stopped on the way. */
+  for(i = 0; i < 256; i++) {
+    etimer_set(&etimers[i], 1 + random_rand() % EXPIRY_SPREAD);
+  }
+  for(i = 0; i < 256; i += 2) {
+    etimer_stop(&etimers[i]);
+  }
+  fired = 0;
+  for(i = 0; i < 64; i++) {
+    ctimer_set(&ctimers[i], 1 + random_rand() % EXPIRY_SPREAD,
+               ctimer_callback, NULL);
+  }
+  for(i = 0; i < 64; i += 4) {
+    ctimer_stop(&ctimers[i]);
+  }
+
+  errors = 0;
+  last = 0;
+  for(i = 0; i < 128;) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    et = data;
+    if(et < &etimers[0] || et >= &etimers[256] || (et - etimers) % 2 == 0 ||
+       !etimer_expired(et) ||
+       clock_time() - etimer_start_time(et) < et->timer.interval ||
+       (i > 0 && etimer_expiration_time(et) - last > EXPIRY_SPREAD)) {
+      errors++;
+    }
+    last = etimer_expiration_time(et);
+    i++;
+  }
+  while(fired < 48) {
+    PROCESS_PAUSE();
+  }
+
+  printf("expiry check: %d etimers, %d errors, %d of 48 ctimers fired\n",
+         i, errors, fired);
+  exit(errors != 0 || fired != 48);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Loopback benchmark of tools/tunslip6: a pseudo terminal pair
+ *         stands in for the serial line and a packet socket pair for
+ *         tun (tunslip6 -U). Frames are pushed through each direction as
+ *         fast as tunslip6 takes them, and the rate is reported.
+ *
+ *         usage: tunslip6-bench [-n frames] [-s size] tunslip6 [options]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+/* tunslip6 is built for tap: it strips an Ethernet header from the
+   packets it reads from tun */
+#define TAP_HEADER_LEN 14
+
+/* Frames written to the pseudo terminal at a time */
+#define BATCH 64
+
+/* Give up when nothing moves for this long */
+#define TIMEOUT_MS 2000
+
+static int frames = 20000;
+static int size = 100;
+
+/* The pseudo terminal master and our end of the fake tun */
+static int pty;
+static int tun;
+/*---------------------------------------------------------------------------*/
+static double
+now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill_packet(unsigned char *p, int len)
+{
+  int i;
+
+  /* An IPv6 packet, with bytes that need stuffing */
+  p[0] = 0x60;
+  for(i = 1; i < len; i++) {
+    p[i] = i * 37;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+slip_encode(unsigned char *out, const unsigned char *in, int len)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < len; i++) {
+    if(in[i] == SLIP_END) {
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_END;
+    } else if(in[i] == SLIP_ESC) {
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_ESC;
+    } else {
+      out[n++] = in[i];
+    }
+  }
+  out[n++] = SLIP_END;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static pid_t
+start_tunslip6(char **args, int nargs)
+{
+  char **argv;
+  char fd[16];
+  int sv[2];
+  pid_t pid;
+  int i, n;
+
+  pty = posix_openpt(O_RDWR | O_NOCTTY);
+  if(pty == -1 || grantpt(pty) == -1 || unlockpt(pty) == -1) {
+    perror("posix_openpt");
+    exit(1);
+  }
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+    perror("socketpair");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid == -1) {
+    perror("fork");
+    exit(1);
+  }
+  if(pid == 0) {
+    argv = calloc(nargs + 8, sizeof(char *));
+    n = 0;
+    for(i = 0; i < nargs; i++) {
+      argv[n++] = args[i];
+    }
+    snprintf(fd, sizeof(fd), "%d", sv[1]);
+    argv[n++] = "-v0";
+    argv[n++] = "-s";
+    argv[n++] = ptsname(pty);
+    argv[n++] = "-U";
+    argv[n++] = fd;
+    argv[n++] = "fd00::1/64";
+    close(pty);
+    close(sv[0]);
+    if(freopen("/dev/null", "w", stdout) == NULL) {
+      perror("/dev/null");
+    }
+    execv(argv[0], argv);
+    perror(argv[0]);
+    _exit(1);
+  }
+
+  close(sv[1]);
+  tun = sv[0];
+  fcntl(pty, F_SETFL, O_NONBLOCK);
+  fcntl(tun, F_SETFL, O_NONBLOCK);
+
+  /* Let tunslip6 set the line up, then drop what it sent on start */
+  usleep(500000);
+  while(read(pty, fd, sizeof(fd)) > 0);
+  return pid;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, int received, double us)
+{
+  printf("%s: %d frames of %d bytes in %.1f ms, %.0f frames/s, %.2f us/frame",
+         name, received, size, us / 1000, received / (us / 1e6),
+         received ? us / received : 0);
+  if(received < frames) {
+    printf(" (%d lost)", frames - received);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_serial_to_tun(void)
+{
+  static unsigned char batch[BATCH * (2 * 2000 + 1)];
+  unsigned char packet[2000];
+  struct pollfd fds[2];
+  long long total, written;
+  int batch_len, frame_len;
+  int received, n, i;
+  double start;
+
+  fill_packet(packet, size);
+  frame_len = slip_encode(batch, packet, size);
+  for(i = 1; i < BATCH; i++) {
+    memcpy(batch + i * frame_len, batch, frame_len);
+  }
+  batch_len = BATCH * frame_len;
+  total = (long long)frames * frame_len;
+
+  written = 0;
+  received = 0;
+  start = now_us();
+  while(received < frames) {
+    fds[0].fd = pty;
+    fds[0].events = written < total ? POLLOUT : 0;
+    fds[1].fd = tun;
+    fds[1].events = POLLIN;
+    if(poll(fds, 2, TIMEOUT_MS) <= 0) {
+      break;
+    }
+    if(fds[0].revents & POLLOUT) {
+      i = written % batch_len;
+      n = batch_len - i;
+      if(n > total - written) {
+        n = total - written;
+      }
+      n = write(pty, batch + i, n);
+      if(n > 0) {
+        written += n;
+      }
+    }
+    if(fds[1].revents & POLLIN) {
+      while((n = recv(tun, packet, sizeof(packet), 0)) > 0) {
+        if(n == size) {
+          received++;
+        }
+      }
+    }
+  }
+  report("serial->tun", received, now_us() - start);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_tun_to_serial(void)
+{
+  static unsigned char chunk[65536];
+  unsigned char packet[2000];
+  struct pollfd fds[2];
+  int sent, received, len, esc, n, i;
+  double start;
+
+  memset(packet, 0, TAP_HEADER_LEN);
+  fill_packet(packet + TAP_HEADER_LEN, size);
+
+  sent = 0;
+  received = 0;
+  len = 0;
+  esc = 0;
+  start = now_us();
+  while(received < frames) {
+    fds[0].fd = tun;
+    fds[0].events = sent < frames ? POLLOUT : 0;
+    fds[1].fd = pty;
+    fds[1].events = POLLIN;
+    if(poll(fds, 2, TIMEOUT_MS) <= 0) {
+      break;
+    }
+    if(fds[0].revents & POLLOUT) {
+      while(sent < frames &&
+            send(tun, packet, TAP_HEADER_LEN + size, 0) > 0) {
+        sent++;
+      }
+    }
+    if(fds[1].revents & POLLIN) {
+      n = read(pty, chunk, sizeof(chunk));
+      for(i = 0; i < n; i++) {
+        if(esc) {
+          esc = 0;
+          len++;
+        } else if(chunk[i] == SLIP_ESC) {
+          esc = 1;
+        } else if(chunk[i] == SLIP_END) {
+          if(len == size) {
+            received++;
+          }
+          len = 0;
+        } else {
+          len++;
+        }
+      }
+    }
+  }
+  report("tun->serial", received, now_us() - start);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  struct rusage usage;
+  pid_t pid;
+  int c;
+
+  while((c = getopt(argc, argv, "+n:s:")) != -1) {
+    switch(c) {
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 's':
+      size = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n frames] [-s size] tunslip6 [options]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if(optind >= argc || frames <= 0 || size < 2 ||
+     size > 2000 - TAP_HEADER_LEN) {
+    fprintf(stderr, "usage: %s [-n frames] [-s size] tunslip6 [options]\n",
+            argv[0]);
+    return 1;
+  }
+
+  pid = start_tunslip6(argv + optind, argc - optind);
+  bench_serial_to_tun();
+  bench_tun_to_serial();
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  getrusage(RUSAGE_CHILDREN, &usage);
+  printf("tunslip6 cpu: %.1f ms user, %.1f ms system, %.2f us/frame\n",
+         usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3,
+         usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3,
+         (usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec +
+          usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec) /
+         (2.0 * frames));
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
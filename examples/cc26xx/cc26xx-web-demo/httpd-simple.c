@@ -488,7 +488,7 @@ PT_THREAD(generate_index(struct httpd_state *s))
 
     PT_WAIT_THREAD(&s->generate_pt,
                    enqueue_chunk(s, 0,
-                                 ", lifetime=%lus", s->r->state.lifetime));
+                                 ", lifetime=%lus", uip_ds6_route_lifetime(s->r)));
   }
 
   PT_WAIT_THREAD(&s->generate_pt, enqueue_chunk(s, 0,
@@ -40,6 +40,9 @@
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
 #include "net/netstack.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "sys/ctimer.h"
 #include "packetutils.h"
 #include "border-router.h"
 #include <string.h>
@@ -52,63 +55,223 @@
 #define PRINTF(...)
 #endif
 
-#define MAX_CALLBACKS 16
-static int callback_pos;
+/* The number of frames that may be handed to the slip-radio before it
+   has reported on the first of them. Each report gives a credit back.
+   The slip-radio remembers the session ids of its last 16 frames. */
+#ifdef BORDER_ROUTER_RDC_CONF_WINDOW
+#define WINDOW BORDER_ROUTER_RDC_CONF_WINDOW
+#else
+#define WINDOW 8
+#endif
+
+/* The number of frames that may wait for a credit */
+#ifdef BORDER_ROUTER_RDC_CONF_BACKLOG
+#define BACKLOG BORDER_ROUTER_RDC_CONF_BACKLOG
+#else
+#define BACKLOG QUEUEBUF_NUM
+#endif
+
+/* The time after which a frame the slip-radio has not reported on is
+   given up */
+#ifdef BORDER_ROUTER_RDC_CONF_TIMEOUT
+#define TIMEOUT BORDER_ROUTER_RDC_CONF_TIMEOUT
+#else
+#define TIMEOUT (4 * CLOCK_SECOND)
+#endif
 
 /* a structure for calling back when packet data is coming back
    from radio... */
-struct tx_callback {
+struct tx_session {
   mac_callback_t cback;
   void *ptr;
+  clock_time_t sent;
+  uint8_t sid;
+  uint8_t in_use;
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
 };
 
-static struct tx_callback callbacks[MAX_CALLBACKS];
+/* a frame waiting for a credit */
+struct tx_pending {
+  struct tx_pending *next;
+  struct queuebuf *buf;
+  mac_callback_t cback;
+  void *ptr;
+};
+
+static struct tx_session sessions[WINDOW];
+static int in_flight;
+static uint8_t next_sid;
+/* The session ids that timed out and have not been reused since: a
+   report for one of them comes too late to be credited to anyone */
+static uint8_t expired[32];
+static struct ctimer timeout_timer;
+
+MEMB(pending_memb, struct tx_pending, BACKLOG);
+LIST(pending_list);
+
+/* for statistics */
+static unsigned long tx_sent, tx_reported, tx_lost, tx_late, tx_unknown,
+  tx_dropped;
+static int max_in_flight;
+
+static void transmit(mac_callback_t sent, void *ptr);
+static void check_timeouts(void *ptr);
 /*---------------------------------------------------------------------------*/
-void packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx)
+static struct tx_session *
+session_from_sid(uint8_t sid)
 {
-  if(sessionid < MAX_CALLBACKS) {
-    struct tx_callback *callback;
-    callback = &callbacks[sessionid];
-    packetbuf_clear();
-    packetbuf_attr_copyfrom(callback->attrs, callback->addrs);
-    mac_call_sent_callback(callback->cback, callback->ptr, status, tx);
+  int i;
+  for(i = 0; i < WINDOW; i++) {
+    if(sessions[i].in_use && sessions[i].sid == sid) {
+      return &sessions[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_timeout(void)
+{
+  clock_time_t now, left, next;
+  int i;
+
+  now = clock_time();
+  next = TIMEOUT;
+  for(i = 0; i < WINDOW; i++) {
+    if(sessions[i].in_use) {
+      left = now - sessions[i].sent >= TIMEOUT ? 0 :
+        TIMEOUT - (now - sessions[i].sent);
+      if(left < next) {
+        next = left;
+      }
+    }
+  }
+  if(in_flight > 0) {
+    ctimer_set(&timeout_timer, next, check_timeouts, NULL);
   } else {
-    PRINTF("*** ERROR: too high session id %d\n", sessionid);
+    ctimer_stop(&timeout_timer);
   }
 }
 /*---------------------------------------------------------------------------*/
-static int
-setup_callback(mac_callback_t sent, void *ptr)
+/* Sends the frames waiting for a credit, in order */
+static void
+send_pending(void)
+{
+  struct tx_pending *p;
+  mac_callback_t sent;
+  void *ptr;
+
+  while(in_flight < WINDOW && (p = list_pop(pending_list)) != NULL) {
+    queuebuf_to_packetbuf(p->buf);
+    queuebuf_free(p->buf);
+    sent = p->cback;
+    ptr = p->ptr;
+    memb_free(&pending_memb, p);
+    transmit(sent, ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Ends a session, and calls back with the attributes of its frame */
+static void
+session_done(struct tx_session *session, int status, int tx)
+{
+  session->in_use = 0;
+  in_flight--;
+  packetbuf_clear();
+  packetbuf_attr_copyfrom(session->attrs, session->addrs);
+  mac_call_sent_callback(session->cback, session->ptr, status, tx);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_timeouts(void *ptr)
+{
+  clock_time_t now;
+  int i;
+
+  now = clock_time();
+  for(i = 0; i < WINDOW; i++) {
+    if(sessions[i].in_use && now - sessions[i].sent >= TIMEOUT) {
+      PRINTF("br-rdc: no report for sid %u\n", sessions[i].sid);
+      tx_lost++;
+      expired[sessions[i].sid >> 3] |= 1 << (sessions[i].sid & 7);
+      /* Whether the frame went out is not known: report an error that
+         tells nothing about the link */
+      session_done(&sessions[i], MAC_TX_ERR, 0);
+    }
+  }
+  send_pending();
+  set_timeout();
+}
+/*---------------------------------------------------------------------------*/
+void packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx)
+{
+  struct tx_session *session;
+
+  session = session_from_sid(sessionid);
+  if(session == NULL) {
+    if(expired[sessionid >> 3] & (1 << (sessionid & 7))) {
+      expired[sessionid >> 3] &= ~(1 << (sessionid & 7));
+      tx_late++;
+      PRINTF("br-rdc: late report for sid %u\n", sessionid);
+    } else {
+      tx_unknown++;
+      PRINTF("br-rdc: report for unknown sid %u\n", sessionid);
+    }
+    return;
+  }
+
+  tx_reported++;
+  session_done(session, status, tx);
+  send_pending();
+  set_timeout();
+}
+/*---------------------------------------------------------------------------*/
+static struct tx_session *
+setup_session(mac_callback_t sent, void *ptr)
 {
-  struct tx_callback *callback;
-  int tmp = callback_pos;
-  callback = &callbacks[callback_pos];
-  callback->cback = sent;
-  callback->ptr = ptr;
-  packetbuf_attr_copyto(callback->attrs, callback->addrs);
+  struct tx_session *session;
+  int i;
 
-  callback_pos++;
-  if(callback_pos >= MAX_CALLBACKS) {
-    callback_pos = 0;
+  session = NULL;
+  for(i = 0; i < WINDOW; i++) {
+    if(!sessions[i].in_use) {
+      session = &sessions[i];
+      break;
+    }
+  }
+
+  /* The window is smaller than the session id space: a free one is
+     found among the next WINDOW ids */
+  while(session_from_sid(next_sid) != NULL) {
+    next_sid++;
   }
+  session->sid = next_sid++;
+  expired[session->sid >> 3] &= ~(1 << (session->sid & 7));
 
-  return tmp;
+  session->cback = sent;
+  session->ptr = ptr;
+  session->sent = clock_time();
+  session->in_use = 1;
+  packetbuf_attr_copyto(session->attrs, session->addrs);
+
+  in_flight++;
+  if(in_flight > max_in_flight) {
+    max_in_flight = in_flight;
+  }
+  if(in_flight == 1) {
+    set_timeout();
+  }
+  return session;
 }
 /*---------------------------------------------------------------------------*/
 static void
-send_packet(mac_callback_t sent, void *ptr)
+transmit(mac_callback_t sent, void *ptr)
 {
   int size;
   /* 3 bytes per packet attribute is required for serialization */
   uint8_t buf[PACKETBUF_NUM_ATTRS * 3 + PACKETBUF_SIZE + 3];
-  uint8_t sid;
-
-  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
-
-  /* ack or not ? */
-  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+  struct tx_session *session;
 
   if(NETSTACK_FRAMER.create() < 0) {
     /* Failed to allocate space for headers */
@@ -125,21 +288,57 @@ send_packet(mac_callback_t sent, void *ptr)
       PRINTF("br-rdc: send failed, too large header\n");
       mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
     } else {
-      sid = setup_callback(sent, ptr);
+      session = setup_session(sent, ptr);
 
       buf[0] = '!';
       buf[1] = 'S';
-      buf[2] = sid; /* sequence or session number for this packet */
+      buf[2] = session->sid; /* sequence or session number for this packet */
 
       /* Copy packet data */
       memcpy(&buf[3 + size], packetbuf_hdrptr(), packetbuf_totlen());
 
       write_to_slip(buf, packetbuf_totlen() + size + 3);
+      tx_sent++;
     }
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  struct tx_pending *p;
+
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+
+  /* ack or not ? */
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+
+  /* Frames that are already waiting go first */
+  if(in_flight < WINDOW && list_head(pending_list) == NULL) {
+    transmit(sent, ptr);
+    return;
+  }
+
+  p = memb_alloc(&pending_memb);
+  if(p != NULL) {
+    p->buf = queuebuf_new_from_packetbuf();
+    if(p->buf == NULL) {
+      memb_free(&pending_memb, p);
+      p = NULL;
+    }
+  }
+  if(p == NULL) {
+    PRINTF("br-rdc: no credit and no room to wait for one\n");
+    tx_dropped++;
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 0);
+    return;
+  }
+  p->cback = sent;
+  p->ptr = ptr;
+  list_add(pending_list, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
 send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 {
   if(buf_list != NULL) {
@@ -148,6 +347,17 @@ send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+border_router_rdc_print_stat(void)
+{
+  printf("frames sent to radio: %lu, reported: %lu, dropped: %lu\n",
+         tx_sent, tx_reported, tx_dropped);
+  printf("reports lost: %lu, late: %lu, unknown: %lu\n",
+         tx_lost, tx_late, tx_unknown);
+  printf("frames in flight: %d (max %d of %d), waiting: %d\n",
+         in_flight, max_in_flight, WINDOW, list_length(pending_list));
+}
+/*---------------------------------------------------------------------------*/
 static void
 packet_input(void)
 {
@@ -179,7 +389,9 @@ channel_check_interval(void)
 static void
 init(void)
 {
-  callback_pos = 0;
+  memb_init(&pending_memb);
+  list_init(pending_list);
+  in_flight = 0;
 }
 /*---------------------------------------------------------------------------*/
 const struct rdc_driver border_router_rdc_driver = {
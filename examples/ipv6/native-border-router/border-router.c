@@ -173,8 +173,8 @@ PT_THREAD(generate_routes(struct httpd_state *s))
     ipaddr_add(&r->ipaddr);
     ADD("/%u (via ", r->length);
     ipaddr_add(uip_ds6_route_nexthop(r));
-    if(r->state.lifetime < 600) {
-      ADD(") %lus\n", (unsigned long)r->state.lifetime);
+    if(uip_ds6_route_lifetime(r) < 600) {
+      ADD(") %lus\n", uip_ds6_route_lifetime(r));
     } else {
       ADD(")\n");
     }
@@ -258,6 +258,8 @@ border_router_print_stat()
 {
   printf("bytes received over SLIP: %ld\n", slip_received);
   printf("bytes sent over SLIP: %ld\n", slip_sent);
+  printf("events lost on a full event queue: %lu\n", process_overflows);
+  border_router_rdc_print_stat();
 }
 
 /*---------------------------------------------------------------------------*/
@@ -33,8 +33,10 @@
 #undef UIP_FALLBACK_INTERFACE
 #define UIP_FALLBACK_INTERFACE rpl_interface
 
+/* The frames waiting for a credit toward the slip-radio are kept in
+   queuebufs: room for the fragments of a full-size packet */
 #undef QUEUEBUF_CONF_NUM
-#define QUEUEBUF_CONF_NUM         4
+#define QUEUEBUF_CONF_NUM         16
 
 #undef UIP_CONF_BUFFER_SIZE
 #define UIP_CONF_BUFFER_SIZE    1280
@@ -42,6 +44,10 @@
 #undef UIP_CONF_RECEIVE_WINDOW
 #define UIP_CONF_RECEIVE_WINDOW  60
 
+/* Let the event queue grow during bursts rather than drop events */
+#undef PROCESS_CONF_MAXEVENTS
+#define PROCESS_CONF_MAXEVENTS  1024
+
 #define SLIP_DEV_CONF_SEND_DELAY (CLOCK_SECOND / 32)
 
 #undef WEBSERVER_CONF_CFS_CONNS
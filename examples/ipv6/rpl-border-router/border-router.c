@@ -245,8 +245,8 @@ PT_THREAD(generate_routes(struct httpd_state *s))
 #endif
     ADD("/%u (via ", r->length);
     ipaddr_add(uip_ds6_route_nexthop(r));
-    if(1 || (r->state.lifetime < 600)) {
-      ADD(") %lus\n", (unsigned long)r->state.lifetime);
+    if(1 || (uip_ds6_route_lifetime(r) < 600)) {
+      ADD(") %lus\n", uip_ds6_route_lifetime(r));
     } else {
       ADD(")\n");
     }
@@ -609,8 +609,8 @@ extern uip_ds6_netif_t uip_ds6_if;
 					ipaddr_add(&route->ipaddr);
 					PRINTF_P(PSTR("/%u (via "), route->length);
 					ipaddr_add(uip_ds6_route_nexthop(route));
-					if(route->state.lifetime < 600) {
-						PRINTF_P(PSTR(") %lus\n\r"), route->state.lifetime);
+					if(uip_ds6_route_lifetime(route) < 600) {
+						PRINTF_P(PSTR(") %lus\n\r"), uip_ds6_route_lifetime(route));
 					 } else {
 						PRINTF_P(PSTR(")\n\r"));
 					}
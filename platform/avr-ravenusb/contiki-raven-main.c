@@ -686,8 +686,8 @@ extern uip_ds6_netif_t uip_ds6_if;
       uip_debug_ipaddr_print(&r->ipaddr);
       PRINTA("/%u (via ", r->length);
       uip_debug_ipaddr_print(uip_ds6_route_nexthop(r));
- //     if(r->state.lifetime < 600) {
-        PRINTA(") %lus\n", r->state.lifetime);
+ //     if(uip_ds6_route_lifetime(r) < 600) {
+        PRINTA(") %lus\n", uip_ds6_route_lifetime(r));
  //     } else {
  //       PRINTA(")\n");
  //     }
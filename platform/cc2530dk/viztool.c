@@ -142,10 +142,10 @@ process_request() CC_NON_BANKED
         PRINTF(" - ");
         PRINT6ADDR(uip_ds6_route_nexthop(rt));
 
-        flip = uip_htonl(rt->state.lifetime);
+        flip = uip_htonl(uip_ds6_route_lifetime(rt));
         memcpy(buf + len, &flip, sizeof(flip));
         len += sizeof(flip);
-        PRINTF(" - %08lx", rt->state.lifetime);
+        PRINTF(" - %08lx", uip_ds6_route_lifetime(rt));
 
         memcpy(buf + len, &rt->state.learned_from,
                sizeof(rt->state.learned_from));
@@ -43,6 +43,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/select.h>
@@ -84,7 +85,13 @@ static int select_max = 0;
 SENSORS(&pir_sensor, &vib_sensor, &button_sensor);
 
 static uint8_t serial_id[] = {0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08};
-static uint16_t node_id = 0x0102;
+unsigned short node_id = 0x0102;
+
+/* Name of an environment variable that overrides the node id, so several
+   native nodes can run side by side with distinct link-layer addresses */
+#ifdef NATIVE_CONF_NODE_ID_ENV
+#define NODE_ID_ENV NATIVE_CONF_NODE_ID_ENV
+#endif
 /*---------------------------------------------------------------------------*/
 int
 select_set_callback(int fd, const struct select_callback *callback)
@@ -138,6 +145,20 @@ const static struct select_callback stdin_fd = {
   stdin_set_fd, stdin_handle_fd
 };
 /*---------------------------------------------------------------------------*/
+#ifdef NODE_ID_ENV
+static void
+set_node_id(void)
+{
+  char *id = getenv(NODE_ID_ENV);
+
+  if(id != NULL) {
+    node_id = strtoul(id, NULL, 0);
+    serial_id[6] = node_id >> 8;
+    serial_id[7] = node_id & 0xff;
+  }
+}
+#endif /* NODE_ID_ENV */
+/*---------------------------------------------------------------------------*/
 static void
 set_rime_addr(void)
 {
@@ -208,6 +229,9 @@ main(int argc, char **argv)
   process_start(&ctk_process, NULL);
 #endif
 
+#ifdef NODE_ID_ENV
+  set_node_id();
+#endif /* NODE_ID_ENV */
   set_rime_addr();
 
   netstack_init();
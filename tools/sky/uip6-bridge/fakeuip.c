@@ -11,6 +11,7 @@
 #define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 
 uip_buf_t uip_aligned_buf;
+uip_buf_t *uip_bufp = &uip_aligned_buf;
 
 uint16_t uip_len;
 
@@ -57,6 +57,10 @@
 
 #include <err.h>
 
+#ifdef linux
+#include <sys/epoll.h>
+#endif
+
 #define UIP_CONF_TAP  1
 #define UIP_CONF_TUN  0
 
@@ -67,6 +71,9 @@ int slipfd = 0;
 uint16_t basedelay=0,delaymsec=0;
 uint32_t startsec,startmsec,delaystartsec,delaystartmsec;
 int timestamp = 0, flowcontrol=0;
+int event_loop = 0;
+/* Packets from the serial line dropped because tun was busy */
+static unsigned long tun_dropped;
 
 int ssystem(const char *fmt, ...)
      __attribute__((__format__ (__printf__, 1, 2)));
@@ -101,6 +108,16 @@ ssystem(const char *fmt, ...)
 #define SLIP_ESC_END 0334
 #define SLIP_ESC_ESC 0335
 
+/* Byte classes for scanning SLIP data a run of plain bytes at a time */
+#define SLIP_CLASS_DATA 0
+#define SLIP_CLASS_END  1
+#define SLIP_CLASS_ESC  2
+
+static const unsigned char slip_class[256] = {
+  [SLIP_END] = SLIP_CLASS_END,
+  [SLIP_ESC] = SLIP_CLASS_ESC,
+};
+
 
 /* get sockaddr, IPv4 or IPv6: */
 void *
@@ -154,6 +171,113 @@ is_sensible_string(const unsigned char *s, int len)
   return 1;
 }
 
+/*
+ * Handle a frame received from the serial line: a request from the
+ * gateway, a debug message, or a packet that is written to tun.
+ */
+void
+slip_frame(unsigned char *inbuf, int inbufptr, int outfd)
+{
+  int i;
+
+  if(inbuf[0] == '!') {
+    if(inbuf[1] == 'M') {
+      /* Read gateway MAC address and autoconfigure tap0 interface */
+      char macs[24];
+      int i, pos;
+      for(i = 0, pos = 0; i < 16; i++) {
+	macs[pos++] = inbuf[2 + i];
+	if((i & 1) == 1 && i < 14) {
+	  macs[pos++] = ':';
+	}
+      }
+      if(timestamp) stamptime();
+      macs[pos] = '\0';
+      printf("*** Gateway's MAC address: %s\n", macs);
+      fprintf(stderr,"*** Gateway's MAC address: %s\n", macs);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s down", tundev);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s hw ether %s", tundev, &macs[6]);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s up", tundev);
+    }
+  } else if(inbuf[0] == '?') {
+    if(inbuf[1] == 'P') {
+      /* Prefix info requested */
+      struct in6_addr addr;
+      int i;
+      char *s = strchr(ipaddr, '/');
+      if(s != NULL) {
+	*s = '\0';
+      }
+      inet_pton(AF_INET6, ipaddr, &addr);
+      if(timestamp) stamptime();
+      fprintf(stderr,"*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
+//      printf("*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
+	     ipaddr, 
+	     addr.s6_addr[0], addr.s6_addr[1],
+	     addr.s6_addr[2], addr.s6_addr[3],
+	     addr.s6_addr[4], addr.s6_addr[5],
+	     addr.s6_addr[6], addr.s6_addr[7]);
+      slip_send(slipfd, '!');
+      slip_send(slipfd, 'P');
+      for(i = 0; i < 8; i++) {
+	/* need to call the slip_send_char for stuffing */
+	slip_send_char(slipfd, addr.s6_addr[i]);
+      }
+      slip_send(slipfd, SLIP_END);
+    }
+#define DEBUG_LINE_MARKER '\r'
+  } else if(inbuf[0] == DEBUG_LINE_MARKER) {  
+    fwrite(inbuf + 1, inbufptr - 1, 1, stdout);
+  } else if(is_sensible_string(inbuf, inbufptr)) {
+    /* strings already echoed as they came in for verbose>1, except with
+       the event loop which only looks at whole frames */
+    if(verbose==1 || (event_loop && verbose>1)) {
+      if (timestamp) stamptime();
+      fwrite(inbuf, inbufptr, 1, stdout);
+    }
+  } else {
+    if(verbose>2) {
+      if (timestamp) stamptime();
+      printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
+      if (verbose>4) {
+#if WIRESHARK_IMPORT_FORMAT
+        printf("0000");
+	for(i = 0; i < inbufptr; i++) printf(" %02x",inbuf[i]);
+#else
+        printf("         ");
+        for(i = 0; i < inbufptr; i++) {
+          printf("%02x", inbuf[i]);
+          if((i & 3) == 3) printf(" ");
+          if((i & 15) == 15) printf("\n         ");
+        }
+#endif
+        printf("\n");
+      }
+    }
+    ssize_t size = write(outfd, inbuf, inbufptr);
+    if(size < 0 && errno == EAGAIN) {
+      /* tun is non-blocking with the event loop: drop, as a full
+         queue in the kernel would */
+      tun_dropped++;
+      if(timestamp) stamptime();
+      fprintf(stderr, "*** tun busy, dropping %d byte packet (%lu dropped)\n",
+              inbufptr, tun_dropped);
+      return;
+    }
+    if ( size < 0 ) {
+      printf("writing to tun : Failed\n");
+      printf ("Error no is : %d\n", size);
+      printf("Error description is : %s\n",strerror(size));
+    }
+    if(size != inbufptr) {
+      err(1, "serial_to_tun: write");
+    }
+  }
+}
+
 /*
  * Read from serial, when we have a packet write it to tun. No output
  * buffering, input buffered by stdio.
@@ -164,11 +288,8 @@ serial_to_tun(FILE *inslip, int outfd)
   static union {
     unsigned char inbuf[2000];
   } uip;
-  static union{
-    unsigned char inbuf[2000];
-} tunoutput;
   static int inbufptr = 0;
-  int ret,i;
+  int ret;
   unsigned char c;
 
 #ifdef linux
@@ -198,103 +319,7 @@ serial_to_tun(FILE *inslip, int outfd)
   switch(c) {
   case SLIP_END:
     if(inbufptr > 0) {
-      if(uip.inbuf[0] == '!') {
-	if(uip.inbuf[1] == 'M') {
-	  /* Read gateway MAC address and autoconfigure tap0 interface */
-	  char macs[24];
-	  int i, pos;
-	  for(i = 0, pos = 0; i < 16; i++) {
-	    macs[pos++] = uip.inbuf[2 + i];
-	    if((i & 1) == 1 && i < 14) {
-	      macs[pos++] = ':';
-	    }
-	  }
-          if(timestamp) stamptime();
-	  macs[pos] = '\0';
-	  printf("*** Gateway's MAC address: %s\n", macs);
-	  fprintf(stderr,"*** Gateway's MAC address: %s\n", macs);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s down", tundev);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s hw ether %s", tundev, &macs[6]);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s up", tundev);
-	}
-      } else if(uip.inbuf[0] == '?') {
-	if(uip.inbuf[1] == 'P') {
-          /* Prefix info requested */
-          struct in6_addr addr;
-	  int i;
-	  char *s = strchr(ipaddr, '/');
-	  if(s != NULL) {
-	    *s = '\0';
-	  }
-          inet_pton(AF_INET6, ipaddr, &addr);
-          if(timestamp) stamptime();
-          fprintf(stderr,"*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
- //         printf("*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
-		 ipaddr, 
-		 addr.s6_addr[0], addr.s6_addr[1],
-		 addr.s6_addr[2], addr.s6_addr[3],
-		 addr.s6_addr[4], addr.s6_addr[5],
-		 addr.s6_addr[6], addr.s6_addr[7]);
-	  slip_send(slipfd, '!');
-	  slip_send(slipfd, 'P');
-	  for(i = 0; i < 8; i++) {
-	    /* need to call the slip_send_char for stuffing */
-	    slip_send_char(slipfd, addr.s6_addr[i]);
-	  }
-	  slip_send(slipfd, SLIP_END);
-        }
-#define DEBUG_LINE_MARKER '\r'
-      } else if(uip.inbuf[0] == DEBUG_LINE_MARKER) {  
-	printf("we go here! DEBUG_LINE_MARKER!\n");  
-	fwrite(uip.inbuf + 1, inbufptr - 1, 1, stdout);
-      } else if(is_sensible_string(uip.inbuf, inbufptr)) {
-        if(verbose==1) {   /* strings already echoed below for verbose>1 */
-	printf("we go here! sensible string verbose 1!\n");  
-          if (timestamp) stamptime();
-          fwrite(uip.inbuf, inbufptr, 1, stdout);
-        }
-      } else {
-        if(verbose>2) {
-	printf("we go here! not sensible string verbose bigger than 2!\n"); 
-          if (timestamp) stamptime();
-          printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
-          if (verbose>4) {
-	printf("we go here! not sensible string verbose bigger than 4!\n");  
-#if WIRESHARK_IMPORT_FORMAT
-            printf("0000");
-	        for(i = 0; i < inbufptr; i++) printf(" %02x",uip.inbuf[i]);
-#else
-            printf("         ");
-            for(i = 0; i < inbufptr; i++) {
-              printf("%02x", uip.inbuf[i]);
-              if((i & 3) == 3) printf(" ");
-              if((i & 15) == 15) printf("\n         ");
-            }
-#endif
-            printf("\n");
-          }
-//	printf("we go here! try to add ethernet header for this packet!\n");
-//	uint8_t data[14] = {202,1,14,129,0,28,0,80,86,192,0,1,134,221};
-//	memcpy((void *)tunoutput.inbuf, (void *)data, 14);
-//	memcpy(tunoutput.inbuf + 14, uip.inbuf, inbufptr);
-        }
-	printf("we go here! write to tun outfd!\n");  	
-	ssize_t size = write(outfd, uip.inbuf, inbufptr);
-//	ssize_t size = write(outfd, tunoutput.inbuf, inbufptr + 14);
-	if ( size < 0 ) {
-        printf("writing to tun : Failed\n");
-        printf ("Error no is : %d\n", size);
-        printf("Error description is : %s\n",strerror(size));
-        }
-	printf("we have size of %d to write!\n", inbufptr);
-	printf("write size of %d to tun!\n", size);
-	if(size != inbufptr) {
-	  err(1, "serial_to_tun: write");
-	}
-      }
+      slip_frame(uip.inbuf, inbufptr, outfd);
       inbufptr = 0;
     }
     break;
@@ -342,9 +367,13 @@ serial_to_tun(FILE *inslip, int outfd)
   goto read_more;
 }
 
-unsigned char slip_buf[2000];
+/* Room for several frames, the event loop queues all tun has at once */
+unsigned char slip_buf[16384];
 int slip_end, slip_begin;
 
+/* Size of the largest frame a packet read from tun is encoded into */
+#define SLIP_MAX_FRAME (2 * 2000 + 1)
+
 void
 slip_send_char(int fd, unsigned char c)
 {
@@ -379,6 +408,41 @@ slip_empty()
   return slip_end == 0;
 }
 
+/* Is there room in slip_buf for one more packet? */
+int
+slip_room()
+{
+  return slip_end + SLIP_MAX_FRAME <= sizeof(slip_buf);
+}
+
+/*
+ * Append a packet to slip_buf as one frame. The bytes that need no
+ * stuffing are copied a run at a time.
+ */
+void
+slip_encode(const unsigned char *p, int len)
+{
+  const unsigned char *end = p + len;
+  const unsigned char *run;
+
+  if(slip_end + 2 * len + 1 > sizeof(slip_buf)) {
+    err(1, "slip_encode overflow");
+  }
+  while(p < end) {
+    run = p;
+    while(p < end && slip_class[*p] == SLIP_CLASS_DATA) {
+      p++;
+    }
+    memcpy(slip_buf + slip_end, run, p - run);
+    slip_end += p - run;
+    if(p < end) {
+      slip_buf[slip_end++] = SLIP_ESC;
+      slip_buf[slip_end++] = *p++ == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+    }
+  }
+  slip_buf[slip_end++] = SLIP_END;
+}
+
 void
 slip_flushbuf(int fd)
 {
@@ -406,8 +470,8 @@ void
 write_to_serial(int outfd, void *inbuf, int len)
 {
   u_int8_t *p = inbuf;
-  int i;
 #if 0
+  int i;
   if(verbose>2) {
     if (timestamp) stamptime();
     printf("Packet from TUN of length %d - write SLIP\n", len);
@@ -432,42 +496,21 @@ write_to_serial(int outfd, void *inbuf, int len)
    */
   /* slip_send(outfd, SLIP_END); */
 
-  for(i = 0; i < len; i++) {
-    switch(p[i]) {
-    case SLIP_END:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_END);
-      break;
-    case SLIP_ESC:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_ESC);
-      break;
-    default:
-      slip_send(outfd, p[i]);
-      break;
-    }
-  }
-  slip_send(outfd, SLIP_END);
+  slip_encode(p, len);
   PROGRESS("t");
 }
 
 
 /*
- * Read from tun, write to slip.
+ * Queue a packet read from tun for slip.
  */
 int
-tun_to_serial(int infd, int outfd)
+packet_to_serial(int outfd, unsigned char *inbuf, int size)
 {
-  struct {
-    unsigned char inbuf[2000];
-  } uip;
-  int size;
   int i;
 
-  if((size = read(infd, uip.inbuf, 2000)) == -1) err(1, "tun_to_serial: read");
-
 #if UIP_CONF_TUN == 1
-  write_to_serial(outfd, uip.inbuf, size);
+  write_to_serial(outfd, inbuf, size);
   return size;
 #endif
 #if UIP_CONF_TAP == 1
@@ -476,15 +519,31 @@ tun_to_serial(int infd, int outfd)
     printf("Packet from TUN of length %d - write SLIP\n", size);
     if (verbose>4) {
       printf("0000");
-	  for(i = 0; i < size; i++) printf(" %02x", uip.inbuf);
+	  for(i = 0; i < size; i++) printf(" %02x", inbuf);
 	}
 }
-  write_to_serial(outfd, &uip.inbuf[14], size-14);
+  write_to_serial(outfd, &inbuf[14], size-14);
   return (size-14);
 #endif
 
 }
 
+/*
+ * Read from tun, write to slip.
+ */
+int
+tun_to_serial(int infd, int outfd)
+{
+  struct {
+    unsigned char inbuf[2000];
+  } uip;
+  int size;
+
+  if((size = read(infd, uip.inbuf, 2000)) == -1) err(1, "tun_to_serial: read");
+
+  return packet_to_serial(outfd, uip.inbuf, size);
+}
+
 #ifndef BAUDRATE
 #define BAUDRATE B115200
 #endif
@@ -526,7 +585,8 @@ stty_telos(int fd)
   if(tcsetattr(fd, TCSAFLUSH, &tty) == -1) err(1, "tcsetattr");
 
   i = TIOCM_DTR;
-  if(ioctl(fd, TIOCMBIS, &i) == -1) err(1, "ioctl");
+  /* Pseudo terminals have no modem control lines */
+  if(ioctl(fd, TIOCMBIS, &i) == -1 && errno != ENOTTY) err(1, "ioctl");
 #endif
 
   usleep(10*1000);		/* Wait for hardware 10ms. */
@@ -741,6 +801,179 @@ ifconf(const char *tundev, const char *ipaddr)
   ssystem("ifconfig %s\n", tundev);
 }
 
+#ifdef linux
+/* SLIP decoder state of the event loop */
+struct slip_rx {
+  unsigned char buf[2000];
+  int len;
+  /* The last byte was SLIP_ESC */
+  int esc;
+  /* The frame is too large, skip it up to the next SLIP_END */
+  int drop;
+};
+
+static void
+slip_rx_append(struct slip_rx *rx, const unsigned char *p, int n)
+{
+  if(rx->drop) {
+    return;
+  }
+  if(rx->len + n > sizeof(rx->buf)) {
+    if(timestamp) stamptime();
+    fprintf(stderr, "*** dropping large %d byte packet\n", rx->len + n);
+    rx->drop = 1;
+    return;
+  }
+  memcpy(rx->buf + rx->len, p, n);
+  rx->len += n;
+}
+
+/*
+ * Decode a chunk read from the serial line. The runs of plain bytes
+ * between SLIP_END and SLIP_ESC are copied at once, each frame that
+ * completes is handed to slip_frame().
+ */
+static void
+slip_decode(struct slip_rx *rx, const unsigned char *p, int n, int outfd)
+{
+  const unsigned char *end = p + n;
+  const unsigned char *run;
+  unsigned char c;
+
+  while(p < end) {
+    if(rx->esc) {
+      rx->esc = 0;
+      c = *p++;
+      if(c == SLIP_ESC_END) {
+        c = SLIP_END;
+      } else if(c == SLIP_ESC_ESC) {
+        c = SLIP_ESC;
+      }
+      slip_rx_append(rx, &c, 1);
+      continue;
+    }
+    run = p;
+    while(p < end && slip_class[*p] == SLIP_CLASS_DATA) {
+      p++;
+    }
+    slip_rx_append(rx, run, p - run);
+    if(p == end) {
+      break;
+    }
+    if(slip_class[*p++] == SLIP_CLASS_ESC) {
+      rx->esc = 1;
+      continue;
+    }
+    if(rx->len > 0 && !rx->drop) {
+      slip_frame(rx->buf, rx->len, outfd);
+    }
+    rx->len = 0;
+    rx->drop = 0;
+  }
+}
+
+static void
+event_loop_watch(int epfd, int fd, uint32_t events, uint32_t *current)
+{
+  struct epoll_event ev;
+
+  if(events == *current) {
+    return;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if(epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+    err(1, "epoll_ctl");
+  }
+  *current = events;
+}
+
+/*
+ * The main loop of -E. Each wakeup reads the serial line in one large
+ * chunk and writes every frame completed in it to tun. Packets are read
+ * from tun as long as slip_buf has room and go out in one write.
+ */
+void
+event_loop_run(int slipfd, int tunfd)
+{
+  static struct slip_rx rx;
+  static unsigned char chunk[8192];
+  struct epoll_event ev, events[2];
+  uint32_t slip_events, tun_events;
+  int epfd, n, i, size;
+
+  if(fcntl(slipfd, F_SETFL, fcntl(slipfd, F_GETFL) | O_NONBLOCK) == -1 ||
+     fcntl(tunfd, F_SETFL, fcntl(tunfd, F_GETFL) | O_NONBLOCK) == -1) {
+    err(1, "event_loop_run: fcntl");
+  }
+
+  epfd = epoll_create1(0);
+  if(epfd == -1) {
+    err(1, "epoll_create1");
+  }
+  memset(&ev, 0, sizeof(ev));
+  slip_events = ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = slipfd;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, slipfd, &ev) == -1) {
+    err(1, "epoll_ctl");
+  }
+  tun_events = ev.events = EPOLLIN;
+  ev.data.fd = tunfd;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, tunfd, &ev) == -1) {
+    err(1, "epoll_ctl");
+  }
+
+  while(1) {
+    slip_flushbuf(slipfd);
+    /* Wait for the serial line to drain before reading more from tun */
+    event_loop_watch(epfd, slipfd, EPOLLIN | EPOLLRDHUP |
+                     (slip_empty() ? 0 : EPOLLOUT), &slip_events);
+    event_loop_watch(epfd, tunfd, slip_room() ? EPOLLIN : 0, &tun_events);
+
+    n = epoll_wait(epfd, events, 2, -1);
+    if(n == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      err(1, "epoll_wait");
+    }
+
+    for(i = 0; i < n; i++) {
+      if(events[i].data.fd == slipfd && (events[i].events & EPOLLIN)) {
+        size = read(slipfd, chunk, sizeof(chunk));
+        if(size == -1 && errno != EAGAIN && errno != EINTR) {
+          err(1, "serial_to_tun: read");
+        }
+        if(size > 0) {
+          slip_decode(&rx, chunk, size, tunfd);
+        } else if(size == 0 && (events[i].events & (EPOLLRDHUP | EPOLLHUP))) {
+          errx(1, "serial_to_tun: connection closed");
+        }
+      } else if(events[i].data.fd == tunfd) {
+        while(slip_room()) {
+          size = read(tunfd, chunk, 2000);
+          if(size == -1) {
+            if(errno == EAGAIN || errno == EINTR) {
+              break;
+            }
+            err(1, "tun_to_serial: read");
+          }
+          if(size == 0) {
+            break;
+          }
+          if(size <= 14) {
+            /* Not even the Ethernet header of a tap frame */
+            continue;
+          }
+          packet_to_serial(slipfd, chunk, size);
+        }
+      }
+    }
+  }
+}
+#endif /* linux */
+
 int
 main(int argc, char **argv)
 {
@@ -755,17 +988,22 @@ main(int argc, char **argv)
   const char *prog;
   int baudrate = -2;
   int tap = 0;
+  int given_tunfd = -1;
   slipfd = 0;
 
   prog = argv[0];
   setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
 
-  while((c = getopt(argc, argv, "B:HLhs:t:v::d::a:p:T")) != -1) {
+  while((c = getopt(argc, argv, "B:EHLhs:t:U:v::d::a:p:T")) != -1) {
     switch(c) {
     case 'B':
       baudrate = atoi(optarg);
       break;
 
+    case 'E':
+      event_loop=1;
+      break;
+
     case 'H':
       flowcontrol=1;
       break;
@@ -811,6 +1049,10 @@ main(int argc, char **argv)
     case 'T':
       tap = 1;
       break;
+
+    case 'U':
+      given_tunfd = atoi(optarg);
+      break;
  
     case '?':
     case 'h':
@@ -823,11 +1065,15 @@ fprintf(stderr," -B baudrate    9600,19200,38400,57600,115200 (default),230400,4
 #else
 fprintf(stderr," -B baudrate    9600,19200,38400,57600,115200 (default),230400\n");
 #endif
+#ifdef linux
+fprintf(stderr," -E             Event loop: batch the reads and writes with epoll\n");
+#endif
 fprintf(stderr," -H             Hardware CTS/RTS flow control (default disabled)\n");
 fprintf(stderr," -L             Log output format (adds time stamps)\n");
 fprintf(stderr," -s siodev      Serial device (default /dev/ttyUSB0)\n");
 fprintf(stderr," -T             Make tap interface (default is tun interface)\n");
 fprintf(stderr," -t tundev      Name of interface (default tap0 or tun0)\n");
+fprintf(stderr," -U fd          Use the open descriptor fd as tun, configure no interface\n");
 fprintf(stderr," -v[level]      Verbosity level\n");
 fprintf(stderr,"    -v0         No messages\n");
 fprintf(stderr,"    -v1         Encapsulated SLIP debug messages (default)\n");
@@ -836,6 +1082,7 @@ fprintf(stderr,"    -v3         Printable strings and SLIP packet notifications\
 fprintf(stderr,"    -v4         All printable characters as they are received\n");
 fprintf(stderr,"    -v5         All SLIP packets in hex\n");
 fprintf(stderr,"    -v          Equivalent to -v3\n");
+fprintf(stderr,"                With -E, strings are only printed once their frame ends.\n");
 fprintf(stderr," -d[basedelay]  Minimum delay between outgoing SLIP packets.\n");
 fprintf(stderr,"                Actual delay is basedelay*(#6LowPAN fragments) milliseconds.\n");
 fprintf(stderr,"                -d is equivalent to -d10.\n");
@@ -853,6 +1100,15 @@ exit(1);
   }
   ipaddr = argv[1];
 
+#ifndef linux
+  if(event_loop) {
+    errx(1, "-E needs epoll");
+  }
+#endif
+  if(event_loop && basedelay) {
+    errx(1, "-d cannot be used with -E");
+  }
+
   switch(baudrate) {
   case -2:
     break;			/* Use default. */
@@ -971,18 +1227,30 @@ exit(1);
   inslip = fdopen(slipfd, "r");
   if(inslip == NULL) err(1, "main: fdopen");
 
-  tunfd = tun_alloc(tundev, tap);
-  if(tunfd == -1) err(1, "main: open");
-  if (timestamp) stamptime();
-  fprintf(stderr, "opened %s device ``/dev/%s''\n",
-          tap ? "tap" : "tun", tundev);
+  if(given_tunfd >= 0) {
+    tunfd = given_tunfd;
+  } else {
+    tunfd = tun_alloc(tundev, tap);
+    if(tunfd == -1) err(1, "main: open");
+    if (timestamp) stamptime();
+    fprintf(stderr, "opened %s device ``/dev/%s''\n",
+            tap ? "tap" : "tun", tundev);
+    atexit(cleanup);
+  }
 
-  atexit(cleanup);
   signal(SIGHUP, sigcleanup);
   signal(SIGTERM, sigcleanup);
   signal(SIGINT, sigcleanup);
   signal(SIGALRM, sigalarm);
-  ifconf(tundev, ipaddr);
+  if(given_tunfd < 0) {
+    ifconf(tundev, ipaddr);
+  }
+
+#ifdef linux
+  if(event_loop) {
+    event_loop_run(slipfd, tunfd);
+  }
+#endif
 
   while(1) {
     maxfd = 0;